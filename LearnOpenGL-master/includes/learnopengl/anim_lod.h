@@ -0,0 +1,83 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/skeleton.h>
+
+// Animation level of detail. Smaller characters on screen are evaluated less often, with the
+// palettes in between interpolated, and without their detail joints (fingers, face, toes);
+// characters off screen only advance their clocks.
+enum class AnimLod { Full, Half, Quarter, Eighth, Offscreen, Count };
+
+struct AnimLodSettings
+{
+	// smallest projected size (see computeProjectedSize() in entity.h) of Full, Half and
+	// Quarter, anything smaller is Eighth
+	float minSize[3] = { 0.25f, 0.12f, 0.06f };
+	float detailSize = 0.15f;	// below this the detail joints keep their bind pose
+	// joints that count as detail, each with everything below it, e.g. { "feetl.l", "feetl.r",
+	// "tail2" } on the necoarc rig. Which joints can freeze unnoticed depends on the rig, so
+	// none are stripped unless they are listed.
+	std::vector<std::string> detailJoints;
+};
+
+// evaluated every this many frames, 0 for Offscreen
+inline int GetAnimLodInterval(AnimLod lod)
+{
+	static const int intervals[] = { 1, 2, 4, 8, 0 };
+	return intervals[(int)lod];
+}
+
+inline const char* GetAnimLodName(AnimLod lod)
+{
+	static const char* names[] = { "full", "1/2", "1/4", "1/8", "offscreen" };
+	return names[(int)lod];
+}
+
+inline AnimLod SelectAnimLod(float projectedSize, bool visible, const AnimLodSettings& settings)
+{
+	if (!visible)
+		return AnimLod::Offscreen;
+	for (int i = 0; i < 3; i++)
+	{
+		if (projectedSize >= settings.minSize[i])
+			return (AnimLod)i;
+	}
+	return AnimLod::Eighth;
+}
+
+// copy of channels (joint -> channel) without the detailJoints and the joints below them.
+// Those joints then sample no keys and keep their bind pose. Names the skeleton doesn't
+// have are reported.
+inline std::vector<int> StripDetailChannels(const Skeleton& skeleton, std::vector<int> channels, const std::vector<std::string>& detailJoints)
+{
+	std::vector<bool> detail(skeleton.GetJointCount(), false);
+	for (const std::string& name : detailJoints)
+	{
+		int joint = skeleton.FindJoint(name);
+		if (joint < 0)
+			std::cout << "ERROR::ANIM_LOD::JOINT_NOT_FOUND: " << name << std::endl;
+		else
+			detail[joint] = true;
+	}
+	// parents come before their children, so a child inherits its parent's mark in one pass
+	for (int joint = 0; joint < skeleton.GetJointCount(); joint++)
+	{
+		int parent = skeleton.m_Parents[joint];
+		if (parent >= 0 && detail[parent])
+			detail[joint] = true;
+		if (detail[joint])
+			channels[joint] = -1;
+	}
+	return channels;
+}
+
+// CPU time spent per tier in the last AnimationSystem::Update()
+struct AnimLodStats
+{
+	double milliseconds[(int)AnimLod::Count] = {};
+	unsigned int instances[(int)AnimLod::Count] = {};
+	unsigned int evaluated[(int)AnimLod::Count] = {};	// instances that sampled a pose this frame
+};
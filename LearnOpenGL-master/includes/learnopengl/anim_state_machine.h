@@ -0,0 +1,567 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/animation.h>
+#include <learnopengl/skeleton.h>
+#include <learnopengl/pose.h>
+
+// -- asset --------------------------------------------------------------------------------
+// What a state machine file describes, by name. Only used while loading; Compile() turns it
+// into the flat tables of AnimStateMachine.
+
+enum class AnimParameterType { Float, Bool, Trigger };
+enum class AnimCompare { Greater, GreaterEqual, Less, LessEqual, Equal, NotEqual };
+
+struct AnimStateMachineDesc
+{
+	struct Parameter
+	{
+		std::string name;
+		AnimParameterType type = AnimParameterType::Float;
+		float defaultValue = 0.0f;
+	};
+
+	struct State
+	{
+		std::string name;
+		std::string clip;	// key into the clips given to Compile()
+		bool loop = true;
+		float speed = 1.0f;
+	};
+
+	struct Condition
+	{
+		std::string parameter;
+		AnimCompare compare = AnimCompare::NotEqual;
+		float value = 0.0f;
+	};
+
+	struct Transition
+	{
+		std::string from;	// "*" for any state
+		std::string to;
+		float duration = 0.2f;	// crossfade, seconds
+		float exitTime = -1.0f;	// normalized time of the source state it waits for, < 0 for none
+		std::vector<Condition> conditions;	// all have to hold
+	};
+
+	std::vector<Parameter> parameters;
+	std::vector<State> states;
+	std::vector<Transition> transitions;
+	std::string start;	// first state if empty
+
+	// Reads the line based text format, '#' starts a comment:
+	//
+	//     parameter float speed 0
+	//     parameter trigger grab
+	//     state idle "Breathing Idle" loop
+	//     state stop "Rifle Run To Stop" once
+	//     start idle
+	//     transition idle run 0.25 speed > 0.1
+	//     transition stop idle 0.3 exit 0.9
+	//     transition * grab 0.2 grab
+	//
+	// A transition lists its source, target and crossfade duration, then its conditions joined
+	// by "and"; a bare parameter name means it is set. Returns false if the file can't be read.
+	bool Load(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			std::cout << "ERROR::ANIM_STATE_MACHINE::FILE_NOT_FOUND: " << path << std::endl;
+			return false;
+		}
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(file, line))
+		{
+			lineNumber++;
+			std::vector<std::string> tokens = Tokenize(line);
+			if (tokens.empty())
+				continue;
+			bool parsed;
+			try
+			{
+				parsed = ParseLine(tokens);
+			}
+			catch (const std::exception&)	// a number that isn't one
+			{
+				parsed = false;
+			}
+			if (!parsed)
+				std::cout << "ERROR::ANIM_STATE_MACHINE::PARSE: " << path << ":" << lineNumber << ": " << line << std::endl;
+		}
+		return true;
+	}
+
+private:
+	static std::vector<std::string> Tokenize(const std::string& line)
+	{
+		std::vector<std::string> tokens;
+		size_t i = 0;
+		while (i < line.size())
+		{
+			if (isspace((unsigned char)line[i]))
+				i++;
+			else if (line[i] == '#')
+				break;
+			else if (line[i] == '"')
+			{
+				size_t end = line.find('"', i + 1);
+				if (end == std::string::npos)
+					end = line.size();
+				tokens.push_back(line.substr(i + 1, end - i - 1));
+				i = end + 1;
+			}
+			else
+			{
+				size_t end = i;
+				while (end < line.size() && !isspace((unsigned char)line[end]))
+					end++;
+				tokens.push_back(line.substr(i, end - i));
+				i = end;
+			}
+		}
+		return tokens;
+	}
+
+	static bool ParseCompare(const std::string& token, AnimCompare& compare)
+	{
+		static const char* names[] = { ">", ">=", "<", "<=", "==", "!=" };
+		for (int i = 0; i < 6; i++)
+		{
+			if (token == names[i])
+			{
+				compare = (AnimCompare)i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ParseLine(const std::vector<std::string>& tokens)
+	{
+		const std::string& keyword = tokens[0];
+		if (keyword == "parameter" && tokens.size() >= 3)
+		{
+			Parameter parameter;
+			if (tokens[1] == "float")
+				parameter.type = AnimParameterType::Float;
+			else if (tokens[1] == "bool")
+				parameter.type = AnimParameterType::Bool;
+			else if (tokens[1] == "trigger")
+				parameter.type = AnimParameterType::Trigger;
+			else
+				return false;
+			parameter.name = tokens[2];
+			if (tokens.size() >= 4)
+				parameter.defaultValue = std::stof(tokens[3]);
+			parameters.push_back(parameter);
+			return true;
+		}
+		if (keyword == "state" && tokens.size() >= 3)
+		{
+			State state;
+			state.name = tokens[1];
+			state.clip = tokens[2];
+			for (size_t i = 3; i < tokens.size(); i++)
+			{
+				if (tokens[i] == "loop")
+					state.loop = true;
+				else if (tokens[i] == "once")
+					state.loop = false;
+				else if (tokens[i] == "speed" && i + 1 < tokens.size())
+					state.speed = std::stof(tokens[++i]);
+				else
+					return false;
+			}
+			states.push_back(state);
+			return true;
+		}
+		if (keyword == "start" && tokens.size() == 2)
+		{
+			start = tokens[1];
+			return true;
+		}
+		if (keyword == "transition" && tokens.size() >= 4)
+		{
+			Transition transition;
+			transition.from = tokens[1];
+			transition.to = tokens[2];
+			transition.duration = std::stof(tokens[3]);
+			for (size_t i = 4; i < tokens.size(); i++)
+			{
+				if (tokens[i] == "and")
+					continue;
+				if (tokens[i] == "exit" && i + 1 < tokens.size())
+				{
+					transition.exitTime = std::stof(tokens[++i]);
+					continue;
+				}
+				Condition condition;
+				condition.parameter = tokens[i];
+				if (i + 2 < tokens.size() && ParseCompare(tokens[i + 1], condition.compare))
+				{
+					condition.value = std::stof(tokens[i + 2]);
+					i += 2;
+				}
+				transition.conditions.push_back(condition);
+			}
+			transitions.push_back(transition);
+			return true;
+		}
+		return false;
+	}
+};
+
+// -- runtime ------------------------------------------------------------------------------
+
+// Per character state of an AnimStateMachine: the parameter block the game writes, the
+// current and fading out states with their clocks, and the pose buffers. Create it with
+// AnimStateMachine::CreateInstance(); parameter indices come from FindParameter() at load.
+struct AnimStateInstance
+{
+	std::vector<float> parameters;
+	int state = 0;
+	float time = 0.0f;	// ticks into the state's clip
+	int previousState = -1;	// fading out, -1 when there is no crossfade or it fades from frozenPose
+	float previousTime = 0.0f;
+	bool fadeFromFrozen = false;	// a crossfade was interrupted, frozenPose fades out instead
+	float fade = 0.0f, fadeDuration = 0.0f;	// seconds
+
+	std::vector<BoneCursor> cursors, previousCursors;
+	Pose pose, previousPose;
+	Pose frozenPose;	// the blend the interrupted crossfade had reached
+	std::vector<glm::mat4> globalTransforms;
+
+	void SetFloat(int parameter, float value) { parameters[parameter] = value; }
+	void SetBool(int parameter, bool value) { parameters[parameter] = value ? 1.0f : 0.0f; }
+	// holds for the next AnimStateMachine::Update() only, which clears it whether a transition
+	// used it or not
+	void SetTrigger(int parameter) { parameters[parameter] = 1.0f; }
+	float GetFloat(int parameter) const { return parameters[parameter]; }
+};
+
+// A state machine compiled into flat arrays: every state owns a contiguous range of
+// transitions, every transition a contiguous range of conditions, and conditions refer to
+// parameters by index. Update() walks the current state's range (then the any-state range)
+// with a handful of branches per transition and no strings, maps or virtual calls, so one
+// machine can drive hundreds of instances. The machine itself is read-only after Compile()
+// and can be shared between threads, each instance belongs to one thread at a time.
+class AnimStateMachine
+{
+public:
+	AnimStateMachine() = default;
+
+	// resolves the names of desc against clips. Every clip is retargeted onto skeleton (by
+	// joint name), which has to outlive the machine. States whose clip is missing are
+	// reported and play the bind pose, transitions to unknown states or with a condition on an
+	// unknown parameter are dropped.
+	bool Compile(const AnimStateMachineDesc& desc, const std::map<std::string, Animation*>& clips, const Skeleton& skeleton)
+	{
+		bool ok = true;
+		m_Skeleton = &skeleton;
+		m_Parameters.clear();
+		m_TriggerParameters.clear();
+		m_ParameterNames.clear();
+		for (const AnimStateMachineDesc::Parameter& parameter : desc.parameters)
+		{
+			m_Parameters.push_back(parameter.defaultValue);
+			if (parameter.type == AnimParameterType::Trigger)
+				m_TriggerParameters.push_back((int)m_Parameters.size() - 1);
+			m_ParameterNames.push_back(parameter.name);
+		}
+
+		m_States.clear();
+		m_StateNames.clear();
+		m_Clips.clear();
+		m_ClipChannels.clear();
+		for (const AnimStateMachineDesc::State& stateDesc : desc.states)
+		{
+			State state;
+			state.loop = stateDesc.loop;
+			state.speed = stateDesc.speed;
+			auto clip = clips.find(stateDesc.clip);
+			if (clip != clips.end() && clip->second)
+			{
+				state.clip = (int)m_Clips.size();
+				m_Clips.push_back(clip->second);
+				m_ClipChannels.push_back(clip->second->BuildChannelMap(skeleton));
+				state.duration = clip->second->GetDuration();
+				state.ticksPerSecond = clip->second->GetTicksPerSecond();
+			}
+			else
+			{
+				std::cout << "ERROR::ANIM_STATE_MACHINE::CLIP_NOT_FOUND: " << stateDesc.clip << std::endl;
+				ok = false;
+			}
+			m_States.push_back(state);
+			m_StateNames.push_back(stateDesc.name);
+		}
+
+		// transitions grouped by source state, any-state transitions last
+		m_Transitions.clear();
+		m_Conditions.clear();
+		for (int source = 0; source <= (int)m_States.size(); source++)
+		{
+			bool any = source == (int)m_States.size();
+			int first = (int)m_Transitions.size();
+			for (const AnimStateMachineDesc::Transition& transitionDesc : desc.transitions)
+			{
+				if (any ? transitionDesc.from != "*" : transitionDesc.from != m_StateNames[source])
+					continue;
+				Transition transition;
+				transition.target = FindState(transitionDesc.to);
+				if (transition.target < 0)
+				{
+					std::cout << "ERROR::ANIM_STATE_MACHINE::STATE_NOT_FOUND: " << transitionDesc.to << std::endl;
+					ok = false;
+					continue;
+				}
+				transition.duration = transitionDesc.duration;
+				transition.exitTime = transitionDesc.exitTime;
+				transition.firstCondition = (int)m_Conditions.size();
+				bool resolved = true;
+				for (const AnimStateMachineDesc::Condition& conditionDesc : transitionDesc.conditions)
+				{
+					Condition condition;
+					condition.parameter = FindParameter(conditionDesc.parameter);
+					if (condition.parameter < 0)
+					{
+						std::cout << "ERROR::ANIM_STATE_MACHINE::PARAMETER_NOT_FOUND: " << conditionDesc.parameter << std::endl;
+						resolved = false;
+						continue;
+					}
+					condition.compare = conditionDesc.compare;
+					condition.value = conditionDesc.value;
+					m_Conditions.push_back(condition);
+				}
+				// without all of its conditions the transition would fire too often, drop it
+				if (!resolved)
+				{
+					m_Conditions.resize(transition.firstCondition);
+					ok = false;
+					continue;
+				}
+				transition.conditionCount = (int)m_Conditions.size() - transition.firstCondition;
+				m_Transitions.push_back(transition);
+			}
+			if (any)
+			{
+				m_AnyFirst = first;
+				m_AnyCount = (int)m_Transitions.size() - first;
+			}
+			else
+			{
+				m_States[source].firstTransition = first;
+				m_States[source].transitionCount = (int)m_Transitions.size() - first;
+			}
+		}
+
+		m_Start = desc.start.empty() ? 0 : std::max(FindState(desc.start), 0);
+		return ok;
+	}
+
+	// load time lookups, -1 if there is none with this name
+	int FindParameter(const std::string& name) const
+	{
+		for (int i = 0; i < (int)m_ParameterNames.size(); i++)
+		{
+			if (m_ParameterNames[i] == name)
+				return i;
+		}
+		return -1;
+	}
+
+	int FindState(const std::string& name) const
+	{
+		for (int i = 0; i < (int)m_StateNames.size(); i++)
+		{
+			if (m_StateNames[i] == name)
+				return i;
+		}
+		return -1;
+	}
+
+	AnimStateInstance CreateInstance() const
+	{
+		AnimStateInstance instance;
+		instance.parameters = m_Parameters;
+		instance.state = m_Start;
+		return instance;
+	}
+
+	// advances the clocks and takes at most one transition. Triggers are cleared afterwards, so
+	// one set for a state that doesn't test it doesn't fire on a later return to a state that does.
+	void Update(AnimStateInstance& instance, float dt) const
+	{
+		const State& state = m_States[instance.state];
+		instance.time = Advance(state, instance.time, dt);
+		if (instance.previousState >= 0 || instance.fadeFromFrozen)
+		{
+			if (instance.previousState >= 0)
+				instance.previousTime = Advance(m_States[instance.previousState], instance.previousTime, dt);
+			instance.fade += dt;
+			if (instance.fade >= instance.fadeDuration)
+			{
+				instance.previousState = -1;
+				instance.fadeFromFrozen = false;
+			}
+		}
+
+		float normalizedTime = state.duration > 0.0f ? instance.time / state.duration : 1.0f;
+		int taken = FindTransition(instance, state.firstTransition, state.transitionCount, normalizedTime);
+		if (taken < 0)
+			taken = FindTransition(instance, m_AnyFirst, m_AnyCount, normalizedTime);
+		if (taken >= 0)
+			Start(instance, m_Transitions[taken]);
+		for (int parameter : m_TriggerParameters)
+			instance.parameters[parameter] = 0.0f;
+	}
+
+	// samples the current state, crossfades from the previous one and writes the palette
+	void EvaluatePalette(AnimStateInstance& instance, glm::mat4* palette, int paletteSize) const
+	{
+		SampleState(instance.state, instance.time, instance.cursors, instance.pose);
+		if (SampleFade(instance))
+			ComposePalette(*m_Skeleton, instance.previousPose, instance.globalTransforms, palette, paletteSize);
+		else
+			ComposePalette(*m_Skeleton, instance.pose, instance.globalTransforms, palette, paletteSize);
+	}
+
+	const std::string& GetStateName(int state) const { return m_StateNames[state]; }
+	int GetStateCount() const { return (int)m_States.size(); }
+	int GetParameterCount() const { return (int)m_Parameters.size(); }
+	const Skeleton& GetSkeleton() const { return *m_Skeleton; }
+
+private:
+	struct State
+	{
+		int clip = -1;	// -1 plays the bind pose
+		float duration = 0.0f, ticksPerSecond = 25.0f;
+		float speed = 1.0f;
+		bool loop = true;
+		int firstTransition = 0, transitionCount = 0;
+	};
+
+	struct Transition
+	{
+		int target = 0;
+		float duration = 0.0f;
+		float exitTime = -1.0f;
+		int firstCondition = 0, conditionCount = 0;
+	};
+
+	struct Condition
+	{
+		int parameter = 0;
+		AnimCompare compare = AnimCompare::NotEqual;
+		float value = 0.0f;
+	};
+
+	const Skeleton* m_Skeleton = nullptr;
+	std::vector<State> m_States;
+	std::vector<Transition> m_Transitions;
+	std::vector<Condition> m_Conditions;
+	std::vector<float> m_Parameters;	// defaults of a new instance
+	std::vector<int> m_TriggerParameters;	// cleared at the end of every Update()
+	std::vector<Animation*> m_Clips;
+	std::vector<std::vector<int>> m_ClipChannels;	// per clip, joint -> channel
+	int m_AnyFirst = 0, m_AnyCount = 0;
+	int m_Start = 0;
+	std::vector<std::string> m_StateNames, m_ParameterNames;	// load time only
+
+	static float Advance(const State& state, float time, float dt)
+	{
+		if (state.duration <= 0.0f)
+			return 0.0f;
+		time += state.ticksPerSecond * state.speed * dt;
+		if (state.loop)
+			return std::fmod(time, state.duration);
+		return std::min(time, state.duration);
+	}
+
+	static bool Test(const Condition& condition, float value)
+	{
+		switch (condition.compare)
+		{
+		case AnimCompare::Greater: return value > condition.value;
+		case AnimCompare::GreaterEqual: return value >= condition.value;
+		case AnimCompare::Less: return value < condition.value;
+		case AnimCompare::LessEqual: return value <= condition.value;
+		case AnimCompare::Equal: return value == condition.value;
+		case AnimCompare::NotEqual: return value != condition.value;
+		}
+		return false;
+	}
+
+	int FindTransition(const AnimStateInstance& instance, int first, int count, float normalizedTime) const
+	{
+		for (int t = first; t < first + count; t++)
+		{
+			const Transition& transition = m_Transitions[t];
+			if (transition.target == instance.state || normalizedTime < transition.exitTime)
+				continue;
+			bool pass = true;
+			for (int c = transition.firstCondition; c < transition.firstCondition + transition.conditionCount && pass; c++)
+				pass = Test(m_Conditions[c], instance.parameters[m_Conditions[c].parameter]);
+			if (pass)
+				return t;
+		}
+		return -1;
+	}
+
+	// blends the fading out pose (a state or the frozen blend) towards instance.pose into
+	// instance.previousPose; false when there is no crossfade
+	bool SampleFade(AnimStateInstance& instance) const
+	{
+		if (instance.previousState >= 0)
+			SampleState(instance.previousState, instance.previousTime, instance.previousCursors, instance.previousPose);
+		else if (instance.fadeFromFrozen)
+			instance.previousPose = instance.frozenPose;
+		else
+			return false;
+		float weight = instance.fadeDuration > 0.0f ? instance.fade / instance.fadeDuration : 1.0f;
+		LerpPose(instance.previousPose, instance.pose, glm::clamp(weight, 0.0f, 1.0f));
+		return true;
+	}
+
+	void Start(AnimStateInstance& instance, const Transition& transition) const
+	{
+		// interrupting a crossfade: what is on screen now fades out, frozen, or it would pop
+		bool fading = instance.previousState >= 0 || instance.fadeFromFrozen;
+		instance.fadeFromFrozen = fading && transition.duration > 0.0f;
+		if (instance.fadeFromFrozen)
+		{
+			SampleState(instance.state, instance.time, instance.cursors, instance.pose);
+			SampleFade(instance);
+			std::swap(instance.frozenPose, instance.previousPose);
+		}
+
+		// otherwise the state being left fades out from where it is; cursors are swapped, not copied
+		instance.previousState = transition.duration > 0.0f && !instance.fadeFromFrozen ? instance.state : -1;
+		instance.previousTime = instance.time;
+		std::swap(instance.cursors, instance.previousCursors);
+		instance.state = transition.target;
+		instance.time = 0.0f;
+		instance.fade = 0.0f;
+		instance.fadeDuration = transition.duration;
+	}
+
+	void SampleState(int stateIndex, float time, std::vector<BoneCursor>& cursors, Pose& pose) const
+	{
+		const State& state = m_States[stateIndex];
+		if (state.clip < 0)
+			pose.SetBindPose(*m_Skeleton);
+		else
+			SamplePose(*m_Clips[state.clip], m_ClipChannels[state.clip], time, cursors, *m_Skeleton, pose);
+	}
+};
@@ -7,6 +7,9 @@
 #include <learnopengl/bone.h>
 #include <functional>
 #include <learnopengl/animdata.h>
+#include <learnopengl/skeleton.h>
+#include <learnopengl/clip_compression.h>
+#include <memory>
 #include <learnopengl/model_animation.h>
 
 struct AssimpNodeData
@@ -34,6 +37,8 @@ public:
 		globalTransformation = globalTransformation.Inverse();
 		ReadHierarchyData(m_RootNode, scene->mRootNode);
 		ReadMissingBones(animation, *model);
+		m_Skeleton = Skeleton(m_RootNode, m_BoneInfoMap);
+		m_JointChannels = BuildChannelMap(m_Skeleton);
 	}
 
 	~Animation()
@@ -52,10 +57,81 @@ public:
 		else return &(*iter);
 	}
 
-	
+	// joint -> index into GetBones(), -1 where no channel animates the joint. Resolved once
+	// per skeleton so evaluating a pose needs no name lookups.
+	std::vector<int> BuildChannelMap(const Skeleton& skeleton) const
+	{
+		std::map<std::string, int> channelsByName;
+		for (int i = 0; i < (int)m_Bones.size(); i++)
+			channelsByName[m_Bones[i].GetBoneName()] = i;
+
+		std::vector<int> channels(skeleton.GetJointCount(), -1);
+		for (int joint = 0; joint < skeleton.GetJointCount(); joint++)
+		{
+			auto channel = channelsByName.find(skeleton.m_Names[joint]);
+			if (channel != channelsByName.end())
+				channels[joint] = channel->second;
+		}
+		return channels;
+	}
+
+	// samples one channel (an index into GetBones()) into its local transform parts, from the
+	// compressed clip if there is one. Const, so animators can share the clip on any thread.
+	void SampleChannel(int channel, float animationTime, BoneCursor& cursor, glm::vec3& position, glm::quat& rotation, glm::vec3& scale) const
+	{
+		if (m_Compressed)
+			m_Compressed->Sample(channel, animationTime, cursor, position, rotation, scale);
+		else
+			m_Bones[channel].Sample(animationTime, cursor, position, rotation, scale);
+	}
+
+	// replaces the raw keys with a CompressedClip. With a cachePath the compressed clip is
+	// read from there if it was made from the same keys and settings and written there
+	// otherwise, so the compression itself only runs once per clip.
+	void Compress(const ClipCompressionSettings& settings = ClipCompressionSettings(), const std::string& cachePath = "")
+	{
+		// a cache file made from other keys or with other settings is compressed again
+		auto compressed = std::make_shared<CompressedClip>();
+		if (cachePath.empty() || !compressed->Load(cachePath, CompressedClip::SourceHash(m_Bones, m_Duration, settings)))
+		{
+			compressed = std::make_shared<CompressedClip>(m_Bones, m_Duration, settings);
+			if (!cachePath.empty())
+				compressed->Save(cachePath);
+		}
+		m_Compressed = compressed;
+		for (Bone& bone : m_Bones)
+			bone.ReleaseKeys();
+	}
+
+	int GetChannelCount() const { return (int)m_Bones.size(); }
+
+	bool IsCompressed() const { return m_Compressed != nullptr; }
+
+	// memory used by the keyframes, compressed or not
+	size_t GetKeyMemoryBytes() const
+	{
+		if (m_Compressed)
+			return m_Compressed->GetMemoryBytes();
+		size_t bytes = 0;
+		for (const Bone& bone : m_Bones)
+			bytes += bone.GetKeyMemoryBytes();
+		return bytes;
+	}
+
+	// resamples every channel at sampleRate keys per second for constant time key lookups.
+	void ResampleUniform(float sampleRate)
+	{
+		float step = (m_TicksPerSecond > 0 ? m_TicksPerSecond : 25.0f) / sampleRate;
+		for (Bone& bone : m_Bones)
+			bone.ResampleUniform(step);
+	}
+
 	inline float GetTicksPerSecond() { return m_TicksPerSecond; }
 	inline float GetDuration() { return m_Duration;}
 	inline const AssimpNodeData& GetRootNode() { return m_RootNode; }
+	inline const Skeleton& GetSkeleton() { return m_Skeleton; }
+	inline const std::vector<int>& GetJointChannels() { return m_JointChannels; }
+	inline std::vector<Bone>& GetBones() { return m_Bones; }
 	inline const std::map<std::string,BoneInfo>& GetBoneIDMap() 
 	{ 
 		return m_BoneInfoMap;
@@ -107,5 +183,8 @@ private:
 	std::vector<Bone> m_Bones;
 	AssimpNodeData m_RootNode;
 	std::map<std::string, BoneInfo> m_BoneInfoMap;
+	Skeleton m_Skeleton;
+	std::vector<int> m_JointChannels;
+	std::shared_ptr<const CompressedClip> m_Compressed;
 };
 
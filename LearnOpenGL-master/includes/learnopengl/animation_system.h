@@ -0,0 +1,476 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <future>
+#include <vector>
+#include <learnopengl/animator.h>
+#include <learnopengl/gl_resource.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/pose_cache.h>
+#include <learnopengl/anim_lod.h>
+#include <learnopengl/skinned_bounds.h>
+#include <learnopengl/thread_pool.h>
+
+// Updates many animators at once. Every frame the active animators are split into one
+// batch per worker and evaluated in parallel on a ThreadPool; each writes its palette
+// straight into one buffer that holds the palettes of all characters, so nothing is copied
+// on the GL thread. On GL 4.4 the buffer is persistently mapped and split into three regions
+// that are rotated per frame and guarded by fences; older contexts fill a client side copy
+// and upload it with one glBufferSubData.
+// Vertex shaders read the palettes through a texture buffer (GL 3.3): BindPalettes() once
+// per shader and frame, then SetPalette() per draw. Instances with consecutive ids can be
+// drawn instanced, the shader steps maxBones matrices per gl_InstanceID. On GL 4.3 the same
+// buffer can be bound as a shader storage buffer with BindPaletteStorage().
+// Palettes are stored as full matrices, 3x4 matrices or dual quaternions (PaletteFormat);
+// the compact formats are encoded while the palette is written into the buffer.
+// Instances can be given an animation LOD (SetLod()): reduced tiers are evaluated every
+// 2nd, 4th or 8th frame, staggered by id, and interpolate their palettes in between.
+// Instances given the bone boxes of their model (SetBounds()) also get a bounding box of the
+// current pose, computed from the palette by the worker that evaluated it.
+class AnimationSystem
+{
+public:
+	typedef unsigned int InstanceId;
+
+	AnimationSystem(ThreadPool& pool, unsigned int maxInstances, int maxBones = 100, PaletteFormat format = PaletteFormat::Mat4)
+		: m_Pool(pool), m_MaxInstances(maxInstances), m_MaxBones(maxBones), m_Format(format), m_Texels(GetPaletteTexels(format))
+	{
+		m_Persistent = GLAD_GL_VERSION_4_4 != 0;
+		m_RegionCount = m_Persistent ? 3 : 1;
+		size_t texels = (size_t)maxBones * m_Texels * maxInstances * m_RegionCount;
+		size_t size = texels * sizeof(glm::vec4);
+
+		// GL 3.3 only guarantees 64K texels
+		GLint maxTexels = 65536;
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+		if (texels > (size_t)maxTexels)
+			std::cout << "ERROR::ANIMATION_SYSTEM::PALETTES_EXCEED_TEXTURE_BUFFER_SIZE: " << texels << " > " << maxTexels << std::endl;
+
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		m_Buffer = CreateBuffer(GL_TEXTURE_BUFFER, size, NULL, GpuCategory::Uniform, m_Persistent ? flags : GL_DYNAMIC_STORAGE_BIT);
+		if (m_Persistent)
+		{
+			glBindBuffer(GL_TEXTURE_BUFFER, m_Buffer.Get());
+			m_Mapped = static_cast<unsigned char*>(glMapBufferRange(GL_TEXTURE_BUFFER, 0, size, flags));
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		}
+		else
+			m_Staging.resize(size);
+
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		m_Texture = GLTexture(texture);
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_Buffer.Get());
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+		m_Animators.resize(maxInstances, nullptr);
+		m_Active.resize(maxInstances, false);
+		m_Lods.resize(maxInstances, AnimLod::Full);
+		m_LodStates.resize(maxInstances);
+		m_Bounds.resize(maxInstances, nullptr);
+		m_PoseBounds.resize(maxInstances);
+		m_CpuPalettes.resize(maxInstances);
+		m_HeldPalettes.resize(maxInstances);
+		for (unsigned int i = maxInstances; i > 0; i--)
+			m_FreeSlots.push_back(i - 1);
+		for (GLsync& fence : m_Fences)
+			fence = 0;
+	}
+
+	AnimationSystem(const AnimationSystem&) = delete;
+	AnimationSystem& operator=(const AnimationSystem&) = delete;
+
+	~AnimationSystem()
+	{
+		for (GLsync fence : m_Fences)
+		{
+			if (fence)
+				glDeleteSync(fence);
+		}
+		if (m_Mapped)
+		{
+			glBindBuffer(GL_TEXTURE_BUFFER, m_Buffer.Get());
+			glUnmapBuffer(GL_TEXTURE_BUFFER);
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		}
+	}
+
+	// registers an animator, which stays owned by the caller. Returns an id, or
+	// GetMaxInstances() when every slot is taken.
+	InstanceId Add(Animator* animator)
+	{
+		if (m_FreeSlots.empty())
+			return m_MaxInstances;
+		InstanceId id = m_FreeSlots.back();
+		m_FreeSlots.pop_back();
+		m_Animators[id] = animator;
+		m_Active[id] = true;
+		m_Lods[id] = AnimLod::Full;
+		m_LodStates[id].hasHistory = false;
+		m_Bounds[id] = nullptr;
+		m_CpuPalettes[id].clear();
+		m_HeldPalettes[id].clear();
+		// bones the skeleton never writes keep the identity
+		for (unsigned int region = 0; region < m_RegionCount; region++)
+		{
+			glm::vec4* palette = GetPalette(region, id);
+			for (int i = 0; i < m_MaxBones; i++)
+				EncodeSkinMatrix(glm::mat4(1.0f), m_Format, palette + i * m_Texels);
+		}
+		return id;
+	}
+
+	void Remove(InstanceId id)
+	{
+		m_Animators[id] = nullptr;
+		m_Active[id] = false;
+		m_HeldPalettes[id].clear();
+		m_FreeSlots.push_back(id);
+	}
+
+	// inactive instances keep their last palette, e.g. while they are culled
+	void SetActive(InstanceId id, bool active)
+	{
+		active = active && m_Animators[id];
+		if (m_Active[id] && !active)
+			HoldPalette(id);
+		else if (active)
+			m_HeldPalettes[id].clear();
+		m_Active[id] = active;
+	}
+
+	// picks the tier from the projected size (computeProjectedSize() in entity.h), call
+	// before Update() whenever the camera or the instance moved
+	void SetLod(InstanceId id, float projectedSize, bool visible)
+	{
+		SetLod(id, SelectAnimLod(projectedSize, visible, m_LodSettings), projectedSize < m_LodSettings.detailSize);
+	}
+
+	void SetLod(InstanceId id, AnimLod lod, bool skipDetailJoints)
+	{
+		if (m_Animators[id])
+			m_Animators[id]->SetSkipDetailJoints(skipDetailJoints, m_LodSettings.detailJoints);
+		if (lod == m_Lods[id])
+			return;
+		// palettes interpolated at another rate are still fine, anything else is stale
+		LodState& state = m_LodStates[id];
+		int interval = GetAnimLodInterval(lod);
+		if (interval <= 1 || GetAnimLodInterval(m_Lods[id]) <= 1)
+			state.hasHistory = false;
+		state.stagger = interval > 1 ? (int)(id % interval) : 0;
+		state.frame = state.stagger;
+		m_Lods[id] = lod;
+	}
+
+	// bounds (Model::GetSkinnedBounds(), owned by the caller) to fit around id's pose every
+	// time it is written, null to stop
+	void SetBounds(InstanceId id, const SkinnedBounds* bounds)
+	{
+		m_Bounds[id] = bounds;
+		m_PoseBounds[id].valid = false;
+	}
+
+	// model space box around id's current pose, false before its first evaluation. Offscreen
+	// instances keep the box of the last pose they were evaluated in.
+	bool GetBounds(InstanceId id, glm::vec3& min, glm::vec3& max) const
+	{
+		const PoseBounds& bounds = m_PoseBounds[id];
+		if (!bounds.valid)
+			return false;
+		min = bounds.min;
+		max = bounds.max;
+		return true;
+	}
+
+	// keeps a copy of id's skinning matrices in system memory, for CPU work on the pose such
+	// as CpuSkinnedModel. The animators write into the palette buffer, so their own
+	// GetFinalBoneMatrices() is never updated.
+	void SetCpuCopy(InstanceId id, bool keep) { m_CpuPalettes[id].assign(keep ? m_MaxBones : 0, glm::mat4(1.0f)); }
+
+	// GetMaxBones() full matrices of id's last written pose, null without SetCpuCopy()
+	const glm::mat4* GetCpuPalette(InstanceId id) const { return m_CpuPalettes[id].empty() ? nullptr : m_CpuPalettes[id].data(); }
+
+	void SetLodSettings(const AnimLodSettings& settings) { m_LodSettings = settings; }
+	const AnimLodSettings& GetLodSettings() const { return m_LodSettings; }
+	const AnimLodStats& GetLodStats() const { return m_LodStats; }
+
+	// evaluates every active animator. call once per frame on the GL thread, before drawing.
+	void Update(float dt)
+	{
+		BeginRegion();
+		if (m_PoseCache)
+			m_PoseCache->BeginFrame();
+
+		m_Batch.clear();
+		for (InstanceId id = 0; id < m_MaxInstances; id++)
+		{
+			if (m_Active[id])
+				m_Batch.push_back(id);
+		}
+
+		// one batch per worker plus one for this thread
+		size_t batchCount = std::min<size_t>(m_Pool.GetThreadCount() + 1, m_Batch.size());
+		size_t batchSize = batchCount ? (m_Batch.size() + batchCount - 1) / batchCount : 0;
+		m_BatchStats.assign(std::max<size_t>(batchCount, 1), AnimLodStats());
+		if (m_BatchScratch.size() < m_BatchStats.size())
+			m_BatchScratch.resize(m_BatchStats.size());
+		m_Jobs.clear();
+		for (size_t begin = batchSize, batch = 1; begin < m_Batch.size(); begin += batchSize, batch++)
+		{
+			size_t end = std::min(begin + batchSize, m_Batch.size());
+			m_Jobs.push_back(m_Pool.Enqueue([this, begin, end, dt, batch] { EvaluateBatch(begin, end, dt, batch); }));
+		}
+		EvaluateBatch(0, std::min(batchSize, m_Batch.size()), dt, 0);
+		for (std::future<void>& job : m_Jobs)
+			job.wait();
+
+		m_LodStats = AnimLodStats();
+		for (const AnimLodStats& stats : m_BatchStats)
+		{
+			for (int tier = 0; tier < (int)AnimLod::Count; tier++)
+			{
+				m_LodStats.milliseconds[tier] += stats.milliseconds[tier];
+				m_LodStats.instances[tier] += stats.instances[tier];
+				m_LodStats.evaluated[tier] += stats.evaluated[tier];
+			}
+		}
+
+		if (!m_Persistent && !m_Batch.empty())
+		{
+			glBindBuffer(GL_TEXTURE_BUFFER, m_Buffer.Get());
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, m_Staging.size(), m_Staging.data());
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		}
+	}
+
+	// binds all palettes to textureUnit for shader (bonePalettes in 1.model_loading.vs)
+	void BindPalettes(Shader& shader, int textureUnit) const
+	{
+		glActiveTexture(GL_TEXTURE0 + textureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, m_Texture.Get());
+		glActiveTexture(GL_TEXTURE0);
+		shader.setInt("bonePalettes", textureUnit);
+		shader.setInt("paletteBones", m_MaxBones);
+		shader.setInt("paletteStride", m_MaxBones);
+		shader.setInt("paletteFormat", (int)m_Format);
+	}
+
+	// selects the palette of id (and of the ids after it for instanced draws)
+	void SetPalette(Shader& shader, InstanceId id) const
+	{
+		shader.setInt("paletteOffset", (int)GetPaletteOffset(id));
+	}
+
+	// GL 4.3: binds the whole buffer as a shader storage buffer, index with GetPaletteOffset()
+	void BindPaletteStorage(GLuint bindingPoint) const
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bindingPoint, m_Buffer.Get());
+	}
+
+	// the cache the animators share (Animator::SetPoseCache()), reset at the start of Update()
+	void SetPoseCache(PoseCache* cache) { m_PoseCache = cache; }
+
+	unsigned int GetPaletteBuffer() const { return m_Buffer.Get(); }
+	// first bone of id's palette in the current frame's region, GetPaletteFormat() decides
+	// how many texels each bone takes
+	size_t GetPaletteOffset(InstanceId id) const { return ((size_t)m_Region * m_MaxInstances + id) * m_MaxBones; }
+	unsigned int GetMaxInstances() const { return m_MaxInstances; }
+	int GetMaxBones() const { return m_MaxBones; }
+	PaletteFormat GetPaletteFormat() const { return m_Format; }
+	// bytes of palettes written per frame when every slot is active
+	size_t GetPaletteBytes() const { return (size_t)m_MaxInstances * m_MaxBones * m_Texels * sizeof(glm::vec4); }
+
+private:
+	ThreadPool& m_Pool;
+	unsigned int m_MaxInstances;
+	int m_MaxBones;
+	PaletteFormat m_Format;
+	int m_Texels;	// per bone
+
+	GLBuffer m_Buffer;
+	GLTexture m_Texture;	// texture buffer view of m_Buffer
+	bool m_Persistent = false;
+	unsigned char* m_Mapped = nullptr;
+	std::vector<unsigned char> m_Staging;	// without persistent mapping
+	unsigned int m_RegionCount = 1;
+	unsigned int m_Region = 0;
+	GLsync m_Fences[3];
+
+	std::vector<Animator*> m_Animators;	// by slot, null when free
+	std::vector<bool> m_Active;
+	std::vector<InstanceId> m_FreeSlots;
+	std::vector<InstanceId> m_Batch;	// active ids of this frame
+	std::vector<AnimLodStats> m_BatchStats;	// per batch, summed after the jobs finish
+	std::vector<std::vector<glm::mat4>> m_BatchScratch;	// per batch, matrices to encode
+	std::vector<std::future<void>> m_Jobs;
+	PoseCache* m_PoseCache = nullptr;
+
+	// reduced tiers evaluate into next, keep the one before in previous and write a blend of
+	// both to the palette on the frames in between
+	struct LodState
+	{
+		int frame = 0;	// frames since the last evaluation
+		int stagger = 0;	// spreads the evaluations of a tier over its interval
+		float elapsed = 0.0f;	// time the animator hasn't been advanced by yet
+		bool hasHistory = false;
+		std::vector<glm::mat4> previous, next;
+	};
+	std::vector<const SkinnedBounds*> m_Bounds;	// by slot
+	struct PoseBounds
+	{
+		glm::vec3 min, max;
+		bool valid = false;
+	};
+	std::vector<PoseBounds> m_PoseBounds;	// by slot, written by the worker of the slot
+	std::vector<std::vector<glm::mat4>> m_CpuPalettes;	// by slot, empty unless SetCpuCopy()
+	std::vector<std::vector<glm::vec4>> m_HeldPalettes;	// by slot, encoded palette while inactive
+	std::vector<glm::mat4> m_HoldScratch;
+	std::vector<AnimLod> m_Lods;
+	std::vector<LodState> m_LodStates;
+	AnimLodSettings m_LodSettings;
+	AnimLodStats m_LodStats;
+
+	glm::vec4* GetPalette(unsigned int region, InstanceId id)
+	{
+		unsigned char* base = m_Persistent ? m_Mapped : m_Staging.data();
+		return reinterpret_cast<glm::vec4*>(base) + ((size_t)region * m_MaxInstances + id) * m_MaxBones * m_Texels;
+	}
+
+	// fences the region the last frame's draws read from and moves on to the next one,
+	// waiting if the GPU still reads from it (three frames behind)
+	void BeginRegion()
+	{
+		if (!m_Persistent)
+			return;
+		m_Fences[m_Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_Region = (m_Region + 1) % m_RegionCount;
+		if (m_Fences[m_Region])
+		{
+			glClientWaitSync(m_Fences[m_Region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+			glDeleteSync(m_Fences[m_Region]);
+			m_Fences[m_Region] = 0;
+		}
+		// inactive instances are not evaluated, carry their last palette forward. The mapping
+		// is write only, so the palette comes from the copy made when they were paused.
+		for (InstanceId id = 0; id < m_MaxInstances; id++)
+		{
+			if (m_Animators[id] && !m_Active[id] && !m_HeldPalettes[id].empty())
+				std::memcpy(GetPalette(m_Region, id), m_HeldPalettes[id].data(), m_HeldPalettes[id].size() * sizeof(glm::vec4));
+		}
+	}
+
+	// keeps the encoded palette id shows now in system memory for BeginRegion(). The pose is
+	// rebuilt from the animator's clock (or the LOD history it interpolates) instead of being
+	// read back from the write-only mapping. Only the rotating regions need it.
+	void HoldPalette(InstanceId id)
+	{
+		if (!m_Persistent)
+			return;
+		m_HoldScratch.assign(m_MaxBones, glm::mat4(1.0f));
+		const LodState& state = m_LodStates[id];
+		int interval = GetAnimLodInterval(m_Lods[id]);
+		if (interval > 1 && state.hasHistory)
+		{
+			float t = (float)state.frame / interval;
+			for (int i = 0; i < m_MaxBones; i++)
+				m_HoldScratch[i] = state.previous[i] * (1.0f - t) + state.next[i] * t;
+		}
+		else
+			m_Animators[id]->WritePalette(m_HoldScratch.data(), m_MaxBones);
+		m_HeldPalettes[id].resize((size_t)m_MaxBones * m_Texels);
+		EncodePalette(m_HoldScratch.data(), m_MaxBones, m_Format, m_HeldPalettes[id].data());
+	}
+
+	// runs on a worker or on the GL thread, touches only its own animators and palettes
+	void EvaluateBatch(size_t begin, size_t end, float dt, size_t batch)
+	{
+		AnimLodStats& stats = m_BatchStats[batch];
+		std::vector<glm::mat4>& scratch = m_BatchScratch[batch];
+		scratch.resize(m_MaxBones, glm::mat4(1.0f));
+		for (size_t i = begin; i < end; i++)
+		{
+			InstanceId id = m_Batch[i];
+			int tier = (int)m_Lods[id];
+			auto start = std::chrono::steady_clock::now();
+			stats.evaluated[tier] += EvaluateInstance(id, dt, scratch.data()) ? 1 : 0;
+			stats.milliseconds[tier] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			stats.instances[tier]++;
+		}
+	}
+
+	// returns whether a pose was evaluated. Full matrices are written straight into the
+	// buffer, compact formats go through scratch (maxBones matrices) and are encoded. So do
+	// instances with bounds or a CPU copy, the mapped buffer is write only.
+	bool EvaluateInstance(InstanceId id, float dt, glm::mat4* scratch)
+	{
+		Animator* animator = m_Animators[id];
+		glm::vec4* target = GetPalette(m_Region, id);
+		bool direct = m_Format == PaletteFormat::Mat4 && !m_Bounds[id] && m_CpuPalettes[id].empty();
+		glm::mat4* palette = direct ? reinterpret_cast<glm::mat4*>(target) : scratch;
+		int interval = GetAnimLodInterval(m_Lods[id]);
+		if (interval == 0)
+		{
+			// not drawn, its palette can go stale
+			animator->Advance(dt);
+			return false;
+		}
+		if (interval == 1)
+		{
+			// bones the animator doesn't write have to stay the identity
+			if (palette == scratch)
+				std::fill(scratch, scratch + m_MaxBones, glm::mat4(1.0f));
+			animator->Evaluate(dt, palette, m_MaxBones);
+			if (palette == scratch)
+				WritePalette(id, scratch, target);
+			return true;
+		}
+
+		LodState& state = m_LodStates[id];
+		state.elapsed += dt;
+		bool evaluate = !state.hasHistory || ++state.frame >= interval;
+		if (evaluate)
+		{
+			state.previous.swap(state.next);
+			state.next.resize(m_MaxBones, glm::mat4(1.0f));
+			animator->Evaluate(state.elapsed, state.next.data(), m_MaxBones);
+			state.elapsed = 0.0f;
+			state.frame = 0;
+			if (!state.hasHistory)
+			{
+				state.previous = state.next;
+				state.hasHistory = true;
+				state.frame = state.stagger;
+			}
+		}
+
+		// one interval behind the clock, so there is always a pose to blend towards
+		float t = (float)state.frame / interval;
+		for (int i = 0; i < m_MaxBones; i++)
+			palette[i] = state.previous[i] * (1.0f - t) + state.next[i] * t;
+		if (palette == scratch)
+			WritePalette(id, scratch, target);
+		return evaluate;
+	}
+
+	// fits id's bounds around the pose in scratch and stores it in the buffer (and the CPU copy)
+	void WritePalette(InstanceId id, const glm::mat4* scratch, glm::vec4* target)
+	{
+		if (!m_CpuPalettes[id].empty())
+			std::copy(scratch, scratch + m_MaxBones, m_CpuPalettes[id].begin());
+		if (m_Bounds[id])
+		{
+			PoseBounds& bounds = m_PoseBounds[id];
+			bounds.valid = m_Bounds[id]->Compute(scratch, m_MaxBones, bounds.min, bounds.max);
+		}
+		if (m_Format == PaletteFormat::Mat4)
+			std::memcpy(target, scratch, m_MaxBones * sizeof(glm::mat4));
+		else
+			EncodePalette(scratch, m_MaxBones, m_Format, target);
+	}
+};
@@ -5,12 +5,19 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <assimp/scene.h>
 #include <assimp/Importer.hpp>
 #include <learnopengl/animation.h>
 #include <learnopengl/bone.h>
+#include <learnopengl/skeleton.h>
+#include <learnopengl/pose.h>
+#include <learnopengl/blend_tree.h>
+#include <learnopengl/anim_state_machine.h>
+#include <learnopengl/pose_cache.h>
+#include <learnopengl/anim_lod.h>
 
 class Animator
 {
@@ -22,16 +29,35 @@ public:
 		m_CurrentAnimation2 = NULL;
 		m_blendAmount = 0;
 
-		m_FinalBoneMatrices.reserve(100);
-
-		for (int i = 0; i < 100; i++)
-			m_FinalBoneMatrices.push_back(glm::mat4(1.0f));
+		// at least 100 entries, more for skeletons with more bones
+		size_t boneCount = animation ? std::max<size_t>(100, animation->GetBoneIDMap().size()) : 100;
+		m_FinalBoneMatrices.assign(boneCount, glm::mat4(1.0f));
 	}
 
 	void UpdateAnimation(float dt)
+	{
+		Evaluate(dt, m_FinalBoneMatrices.data(), (int)m_FinalBoneMatrices.size());
+	}
+
+	// advances the clocks and writes the pose into palette instead of m_FinalBoneMatrices.
+	// Only touches this animator's state, so different animators can be evaluated on
+	// different threads even when they play the same clips.
+	void Evaluate(float dt, glm::mat4* palette, int paletteSize)
+	{
+		Advance(dt);
+		WritePalette(palette, paletteSize);
+	}
+
+	// advances the clocks (and the state machine) without evaluating a pose, for animators
+	// that aren't drawn this frame
+	void Advance(float dt)
 	{
 		m_DeltaTime = dt;
-		if (m_CurrentAnimation)
+		if (m_StateMachine)
+			m_StateMachine->Update(*m_StateInstance, dt);
+		else if (m_BlendTree)
+			m_BlendTree->Advance(dt);
+		else if (m_CurrentAnimation)
 		{
 			m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
 			m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
@@ -41,8 +67,31 @@ public:
 				m_CurrentTime2 += m_CurrentAnimation2->GetTicksPerSecond() * dt;
 				m_CurrentTime2 = fmod(m_CurrentTime2, m_CurrentAnimation2->GetDuration());
 			}
+		}
+	}
 
-			CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+	// writes the pose at the current clock into palette
+	void WritePalette(glm::mat4* palette, int paletteSize)
+	{
+		if (m_StateMachine)
+			m_StateMachine->EvaluatePalette(*m_StateInstance, palette, paletteSize);
+		else if (m_BlendTree)
+			m_BlendTree->EvaluatePalette(palette, paletteSize);
+		else if (m_CurrentAnimation)
+		{
+			// a single clip can come from the shared cache, blends are sampled per animator. The
+			// cache holds full poses, without detail joints the pose is sampled here as well.
+			if (m_PoseCache && !m_CurrentAnimation2 && !m_SkipDetailJoints)
+			{
+				float time = GetSampleTime(*m_CurrentAnimation, m_CurrentTime);
+				const glm::mat4* cached = m_PoseCache->GetPalette(*m_CurrentAnimation, time);
+				if (cached)
+				{
+					std::copy(cached, cached + std::min(paletteSize, m_PoseCache->GetMaxBones()), palette);
+					return;
+				}
+			}
+			CalculatePose(palette, paletteSize);
 		}
 	}
 
@@ -53,70 +102,86 @@ public:
 		m_CurrentAnimation2 = pAnimation2;
 		m_CurrentTime2 = time2;
 		m_blendAmount = blend;
+
+		// the second clip is mapped onto the joints of the first, only when the pair changes
+		if (pAnimation2 && (pAnimation != m_BlendChannelsFor[0] || pAnimation2 != m_BlendChannelsFor[1]))
+		{
+			m_BlendChannels = pAnimation2->BuildChannelMap(pAnimation->GetSkeleton());
+			m_BlendChannelsFor[0] = pAnimation;
+			m_BlendChannelsFor[1] = pAnimation2;
+		}
 	}
 
-	glm::mat4 UpdateBlend(Bone* Bone1, Bone* Bone2) {
-		glm::vec3 bonePos1, bonePos2, finalPos;
-		glm::vec3 boneScale1, boneScale2, finalScale;
-		glm::quat boneRot1, boneRot2, finalRot;
-
-		Bone1->InterpolatePosition(m_CurrentTime, bonePos1);
-		Bone2->InterpolatePosition(m_CurrentTime2, bonePos2);
-		Bone1->InterpolateRotation(m_CurrentTime, boneRot1);
-		Bone2->InterpolateRotation(m_CurrentTime2, boneRot2);
-		Bone1->InterpolateScaling(m_CurrentTime, boneScale1);
-		Bone2->InterpolateScaling(m_CurrentTime2, boneScale2);
-
-		finalPos = glm::mix(bonePos1, bonePos2, m_blendAmount);
-		finalRot = glm::slerp(boneRot1, boneRot2, m_blendAmount);
-		finalRot = glm::normalize(finalRot);
-		finalScale = glm::mix(boneScale1, boneScale2, m_blendAmount);
-
-		glm::mat4 translation = glm::translate(glm::mat4(1.0f), finalPos);
-		glm::mat4 rotation = glm::toMat4(finalRot);
-		glm::mat4 scale = glm::scale(glm::mat4(1.0f), finalScale);
-
-		glm::mat4 TRS = glm::mat4(1.0f);
-		TRS = translation * rotation * scale;
-		return TRS;
+	// hands the pose over to a blend tree (owned by the caller) instead of the two clips of
+	// PlayAnimation(), null to go back
+	void SetBlendTree(BlendTree* tree) { m_BlendTree = tree; }
+	BlendTree* GetBlendTree() const { return m_BlendTree; }
+
+	// lets a state machine pick and crossfade the clips, instance holds this character's
+	// parameters and clocks. Both stay owned by the caller; null to go back.
+	void SetStateMachine(const AnimStateMachine* machine, AnimStateInstance* instance)
+	{
+		m_StateMachine = instance ? machine : NULL;
+		m_StateInstance = instance;
 	}
 
-	void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform)
+	// shares sampled poses with other animators playing the same clip. phaseOffset (seconds,
+	// see PoseCache::GetPhaseOffset()) shifts this animator so a crowd doesn't move in sync.
+	void SetPoseCache(PoseCache* cache, float phaseOffset = 0.0f)
 	{
-		std::string nodeName = node->name;
-		glm::mat4 nodeTransform = node->transformation;
+		m_PoseCache = cache;
+		m_PhaseOffset = phaseOffset;
+	}
 
-		Bone* Bone1 = m_CurrentAnimation->FindBone(nodeName);
-		Bone* Bone2 = NULL;
-		if (m_CurrentAnimation2) {
-			Bone2 = m_CurrentAnimation2->FindBone(nodeName);
-		}
-		
-		if (Bone1)
+	// distant characters leave their detail joints (AnimLodSettings::detailJoints, see
+	// StripDetailChannels()) in the bind pose; applies to the clips of PlayAnimation()
+	void SetSkipDetailJoints(bool skip, const std::vector<std::string>& detailJoints)
+	{
+		m_SkipDetailJoints = skip && !detailJoints.empty();
+		if (m_SkipDetailJoints && m_DetailJoints != detailJoints)
 		{
-			Bone1->Update(m_CurrentTime);
-			nodeTransform = Bone1->GetLocalTransform();
+			m_DetailJoints = detailJoints;
+			m_ReducedChannelsFor = NULL;
+		}
+	}
 
-			if (Bone2) {
-				nodeTransform = UpdateBlend(Bone1, Bone2);
+	// samples the clips into the SoA pose buffers, blends them, then composes the palette.
+	// The skeleton stores parents before children, so composing is one forward pass without
+	// recursion, name lookups or allocations (after the first call). Channels are sampled
+	// through the animation, which reads compressed clips directly.
+	void CalculatePose(glm::mat4* palette, int paletteSize)
+	{
+		const Skeleton& skeleton = m_CurrentAnimation->GetSkeleton();
+		const std::vector<int>* channels = &m_CurrentAnimation->GetJointChannels();
+		if (m_SkipDetailJoints)
+		{
+			if (m_ReducedChannelsFor != m_CurrentAnimation)
+			{
+				m_ReducedChannels = StripDetailChannels(skeleton, *channels, m_DetailJoints);
+				m_ReducedChannelsFor = m_CurrentAnimation;
 			}
+			channels = &m_ReducedChannels;
 		}
-
-		glm::mat4 globalTransformation = parentTransform * nodeTransform;
-
-		auto boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end())
+		// offset like the cached poses, so a full cache doesn't shift the character
+		SamplePose(*m_CurrentAnimation, *channels, GetSampleTime(*m_CurrentAnimation, m_CurrentTime), m_Cursors, skeleton, m_Pose);
+		if (m_CurrentAnimation2)
 		{
-			int index = boneInfoMap[nodeName].id;
-			glm::mat4 offset = boneInfoMap[nodeName].offset;
-			m_FinalBoneMatrices[index] = globalTransformation * offset;
+			// joints the second clip doesn't animate keep the first clip's pose
+			SamplePose(*m_CurrentAnimation2, m_BlendChannels, GetSampleTime(*m_CurrentAnimation2, m_CurrentTime2), m_Cursors2, skeleton, m_Pose2, &m_Pose);
+			BlendPoses(m_Pose, m_Pose2, m_blendAmount);
 		}
+		ComposePalette(skeleton, m_Pose, m_GlobalTransforms, palette, paletteSize);
+	}
 
-		for (int i = 0; i < node->childrenCount; i++)
-			CalculateBoneTransform(&node->children[i], globalTransformation);
+	// clip time the pose is sampled at, clock shifted by the phase offset of SetPoseCache()
+	float GetSampleTime(Animation& animation, float clock) const
+	{
+		if (m_PhaseOffset == 0.0f)
+			return clock;
+		return fmod(clock + m_PhaseOffset * animation.GetTicksPerSecond(), animation.GetDuration());
 	}
 
-	std::vector<glm::mat4> GetFinalBoneMatrices()
+	const std::vector<glm::mat4>& GetFinalBoneMatrices()
 	{
 		return m_FinalBoneMatrices;
 	}
@@ -129,5 +194,19 @@ public:
 	float m_CurrentTime2;
 	float m_DeltaTime;
 	float m_blendAmount;
+	std::vector<glm::mat4> m_GlobalTransforms;	// per joint, reused every frame
+	Pose m_Pose, m_Pose2;	// local poses of the two clips
+	std::vector<int> m_BlendChannels;	// joint -> channel of m_CurrentAnimation2
+	std::vector<BoneCursor> m_Cursors, m_Cursors2;	// per channel key cursors of this animator
+	Animation* m_BlendChannelsFor[2] = { NULL, NULL };
+	BlendTree* m_BlendTree = NULL;
+	const AnimStateMachine* m_StateMachine = NULL;
+	AnimStateInstance* m_StateInstance = NULL;
+	PoseCache* m_PoseCache = NULL;
+	float m_PhaseOffset = 0.0f;
+	bool m_SkipDetailJoints = false;
+	std::vector<std::string> m_DetailJoints;
+	std::vector<int> m_ReducedChannels;	// joint channels without the detail joints
+	Animation* m_ReducedChannelsFor = NULL;
 
 };
@@ -0,0 +1,415 @@
+#ifndef ASSET_MANAGER_H
+#define ASSET_MANAGER_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/animation.h>
+#include <learnopengl/bvh.h>
+#include <learnopengl/model_animation.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class AssetStatus { Queued, Importing, Uploading, Ready, Failed };
+
+// shared state of one streamed model or animation
+struct AssetRecord
+{
+    std::string path;
+    bool gamma = false;
+    bool buildBvh = false;
+    std::atomic<AssetStatus> status{ AssetStatus::Queued };
+    std::atomic<float> progress{ 0.0f };
+    float priority = 0.0f;                  // lower loads first, guarded by the manager's mutex
+
+    std::unique_ptr<Model> model;
+    std::unique_ptr<ModelBvh> bvh;          // for models loaded with buildBvh
+    std::unique_ptr<Animation> animation;
+    std::shared_ptr<AssetRecord> owner;     // for animations: the model whose bone map they extend
+    std::mutex boneMutex;                   // for models: serializes animations reading into the bone map
+    std::atomic<int> pendingAnimations{ 0 }; // for models: imports that still write the bone map, Ready waits for them
+
+    // only touched on the thread that calls AssetManager::Update()
+    std::function<void(float)> onProgress;
+    std::function<void(bool)> onComplete;
+    float reportedProgress = -1.0f;
+    GLsync uploadFence = 0;
+};
+
+// returned immediately by AssetManager; Get() stays null until the asset is ready.
+template<typename T>
+class AssetHandle
+{
+    static_assert(std::is_same<T, Model>::value || std::is_same<T, Animation>::value, "AssetHandle holds a Model or an Animation");
+
+public:
+    AssetHandle() = default;
+
+    bool IsValid() const { return m_Record != nullptr; }
+    bool IsReady() const { return m_Record && m_Record->status == AssetStatus::Ready; }
+    bool IsFailed() const { return m_Record && m_Record->status == AssetStatus::Failed; }
+    float GetProgress() const { return m_Record ? m_Record->progress.load() : 0.0f; }
+
+    T* Get() const
+    {
+        if (!IsReady())
+            return nullptr;
+        if constexpr (std::is_same<T, Model>::value)
+            return m_Record->model.get();
+        else
+            return m_Record->animation.get();
+    }
+
+    // ray queries against a model in its bind pose, null unless it was loaded with buildBvh
+    const ModelBvh* GetBvh() const { return IsReady() ? m_Record->bvh.get() : nullptr; }
+
+private:
+    friend class AssetManager;
+    explicit AssetHandle(std::shared_ptr<AssetRecord> record) : m_Record(std::move(record)) {}
+
+    std::shared_ptr<AssetRecord> m_Record;
+};
+
+// Streams models and animations in the background. Assimp imports and mesh conversion
+// run on import threads, textures and vertex buffers are created on an upload thread with
+// its own GL context that shares objects with the render context, and the render thread
+// only creates the vertex array objects in Update(). Pending requests are served in
+// priority order, which SetPriority() derives from camera distance and visibility.
+class AssetManager
+{
+public:
+    // makeUploadContextCurrent runs once on the upload thread and must make a context current
+    // that shares objects with the render context, e.g. a hidden GLFW window created with the
+    // main window as its share. Without it the uploads happen inside Update(), one model per call.
+    AssetManager(std::function<void()> makeUploadContextCurrent = nullptr, unsigned int importThreads = 0)
+    {
+        if (importThreads == 0)
+            importThreads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int i = 0; i < importThreads; i++)
+            m_Importers.emplace_back([this] { ImportLoop(); });
+        if (makeUploadContextCurrent)
+            m_Uploader = std::thread([this, makeUploadContextCurrent] { makeUploadContextCurrent(); UploadLoop(); });
+    }
+
+    AssetManager(const AssetManager&) = delete;
+    AssetManager& operator=(const AssetManager&) = delete;
+
+    // needs the render context to be current.
+    ~AssetManager()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stop = true;
+        }
+        m_ImportCondition.notify_all();
+        m_UploadCondition.notify_all();
+        for (std::thread& importer : m_Importers)
+            importer.join();
+        if (m_Uploader.joinable())
+            m_Uploader.join();
+        for (std::shared_ptr<AssetRecord>& record : m_Uploaded)
+            glDeleteSync(record->uploadFence);
+        for (std::shared_ptr<AssetRecord>& record : m_UploadDone)
+            glDeleteSync(record->uploadFence);
+    }
+
+    // with buildBvh the import thread also builds the model's BVH (see GetBvh()), so models
+    // imported at the same time build theirs in parallel
+    AssetHandle<Model> LoadModel(const std::string& path, float priority = 0.0f, bool gamma = false, bool buildBvh = false)
+    {
+        auto record = std::make_shared<AssetRecord>();
+        record->path = path;
+        record->gamma = gamma;
+        record->buildBvh = buildBvh;
+        record->priority = priority;
+        Enqueue(record);
+        return AssetHandle<Model>(record);
+    }
+
+    // the animation is imported once its model has been imported, as it adds missing bones to the model;
+    // the model is not ready before the animations requested until then are done. Animations requested
+    // for a ready model are imported on the import threads as well and may still grow its bone map, read
+    // it under LockBones() in the meantime.
+    AssetHandle<Animation> LoadAnimation(const std::string& path, const AssetHandle<Model>& model, float priority = 0.0f)
+    {
+        auto record = std::make_shared<AssetRecord>();
+        record->path = path;
+        record->priority = priority;
+        record->owner = model.m_Record;
+        record->owner->pendingAnimations++;
+        Enqueue(record);
+        return AssetHandle<Animation>(record);
+    }
+
+    // holds off animation imports that add bones to model, e.g. while an Animation is created on
+    // it by hand or Model::GetBoneCount() is read for baking.
+    std::unique_lock<std::mutex> LockBones(const AssetHandle<Model>& model)
+    {
+        return std::unique_lock<std::mutex>(model.m_Record->boneMutex);
+    }
+
+    // visible assets always go before hidden ones, then nearer before farther.
+    template<typename T>
+    void SetPriority(const AssetHandle<T>& handle, float distance, bool visible)
+    {
+        const float hiddenBias = 1.0e6f;
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        handle.m_Record->priority = visible ? distance : distance + hiddenBias;
+    }
+
+    // callbacks are invoked from Update(). onComplete receives false if the import failed.
+    template<typename T>
+    void SetCallbacks(const AssetHandle<T>& handle, std::function<void(float)> onProgress, std::function<void(bool)> onComplete)
+    {
+        handle.m_Record->onProgress = std::move(onProgress);
+        handle.m_Record->onComplete = std::move(onComplete);
+    }
+
+    // call once per frame on the render thread.
+    void Update()
+    {
+        std::vector<std::shared_ptr<AssetRecord>> imported;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (!m_Uploader.joinable() && !m_UploadQueue.empty())
+                imported.push_back(PopHighestPriority(m_UploadQueue));
+            for (std::shared_ptr<AssetRecord>& record : m_UploadDone)
+                m_Uploaded.push_back(record);
+            m_UploadDone.clear();
+        }
+
+        // no upload context: do the whole upload here
+        for (std::shared_ptr<AssetRecord>& record : imported)
+        {
+            record->model->UploadTextures();
+            record->model->UploadBuffers();
+            record->model->CreateVertexArrays();
+            m_Finished.push_back(record);
+        }
+
+        // uploads from the other context are usable once their fence has passed
+        for (auto it = m_Uploaded.begin(); it != m_Uploaded.end();)
+        {
+            std::shared_ptr<AssetRecord>& record = *it;
+            GLenum state = glClientWaitSync(record->uploadFence, 0, 0);
+            if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+            {
+                ++it;
+                continue;
+            }
+            glDeleteSync(record->uploadFence);
+            record->uploadFence = 0;
+            record->model->CreateVertexArrays();
+            m_Finished.push_back(record);
+            it = m_Uploaded.erase(it);
+        }
+
+        // a model is published once no animation import is writing its bone map anymore
+        for (auto it = m_Finished.begin(); it != m_Finished.end();)
+        {
+            if ((*it)->pendingAnimations > 0)
+            {
+                ++it;
+                continue;
+            }
+            (*it)->status = AssetStatus::Ready;
+            (*it)->progress = 1.0f;
+            it = m_Finished.erase(it);
+        }
+
+        // animations need no GL work, they are published here so callbacks stay on this thread
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            for (std::shared_ptr<AssetRecord>& record : m_Active)
+            {
+                if (record->owner && record->status == AssetStatus::Uploading)
+                {
+                    record->status = AssetStatus::Ready;
+                    record->progress = 1.0f;
+                }
+            }
+        }
+
+        // report progress and completion, then forget finished assets
+        for (auto it = m_Active.begin(); it != m_Active.end();)
+        {
+            AssetRecord& record = **it;
+            float progress = record.progress;
+            if (progress != record.reportedProgress && record.onProgress)
+                record.onProgress(progress);
+            record.reportedProgress = progress;
+
+            AssetStatus status = record.status;
+            if (status == AssetStatus::Ready || status == AssetStatus::Failed)
+            {
+                if (record.onComplete)
+                    record.onComplete(status == AssetStatus::Ready);
+                it = m_Active.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    // number of requested assets that are not ready or failed yet.
+    unsigned int GetPendingCount() const { return static_cast<unsigned int>(m_Active.size()); }
+
+private:
+    std::vector<std::thread> m_Importers;
+    std::thread m_Uploader;
+    std::mutex m_Mutex;
+    std::condition_variable m_ImportCondition;
+    std::condition_variable m_UploadCondition;
+    bool m_Stop = false;
+
+    std::vector<std::shared_ptr<AssetRecord>> m_ImportQueue;
+    std::vector<std::shared_ptr<AssetRecord>> m_UploadQueue;
+    std::vector<std::shared_ptr<AssetRecord>> m_UploadDone;
+    std::vector<std::shared_ptr<AssetRecord>> m_Active;      // render thread's view of everything in flight
+    std::vector<std::shared_ptr<AssetRecord>> m_Uploaded;    // render thread only, waiting on their fences
+    std::vector<std::shared_ptr<AssetRecord>> m_Finished;    // render thread only, waiting on animation imports
+
+    void Enqueue(const std::shared_ptr<AssetRecord>& record)
+    {
+        m_Active.push_back(record);
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_ImportQueue.push_back(record);
+        }
+        m_ImportCondition.notify_one();
+    }
+
+    static std::shared_ptr<AssetRecord> PopHighestPriority(std::vector<std::shared_ptr<AssetRecord>>& queue)
+    {
+        auto best = std::min_element(queue.begin(), queue.end(),
+            [](const std::shared_ptr<AssetRecord>& a, const std::shared_ptr<AssetRecord>& b) { return a->priority < b->priority; });
+        std::shared_ptr<AssetRecord> record = *best;
+        queue.erase(best);
+        return record;
+    }
+
+    // an animation has to wait until its model's bone map exists
+    static bool IsImportable(const AssetRecord& record)
+    {
+        if (!record.owner)
+            return true;
+        AssetStatus ownerStatus = record.owner->status;
+        return ownerStatus != AssetStatus::Queued && ownerStatus != AssetStatus::Importing;
+    }
+
+    // caller holds m_Mutex
+    std::shared_ptr<AssetRecord> PopImportable()
+    {
+        std::shared_ptr<AssetRecord> best;
+        size_t bestIndex = 0;
+        for (size_t i = 0; i < m_ImportQueue.size(); i++)
+        {
+            if (IsImportable(*m_ImportQueue[i]) && (!best || m_ImportQueue[i]->priority < best->priority))
+            {
+                best = m_ImportQueue[i];
+                bestIndex = i;
+            }
+        }
+        if (best)
+            m_ImportQueue.erase(m_ImportQueue.begin() + bestIndex);
+        return best;
+    }
+
+    void ImportLoop()
+    {
+        for (;;)
+        {
+            std::shared_ptr<AssetRecord> record;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_ImportCondition.wait(lock, [this, &record] { return m_Stop || (record = PopImportable()) != nullptr; });
+                if (m_Stop)
+                    return;
+            }
+
+            record->status = AssetStatus::Importing;
+            record->progress = 0.1f;
+            if (record->owner)
+                ImportAnimation(*record);
+            else
+                ImportModel(record);
+
+            // finished models may unblock queued animations
+            m_ImportCondition.notify_all();
+        }
+    }
+
+    void ImportModel(const std::shared_ptr<AssetRecord>& record)
+    {
+        record->model = std::make_unique<Model>(record->path, record->gamma, nullptr, true);
+        if (record->model->meshes.empty())
+        {
+            record->status = AssetStatus::Failed;
+            return;
+        }
+        if (record->buildBvh)
+        {
+            record->bvh = std::make_unique<ModelBvh>();
+            record->bvh->Build(*record->model);
+        }
+        record->progress = 0.5f;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            record->status = AssetStatus::Uploading;
+            m_UploadQueue.push_back(record);
+        }
+        m_UploadCondition.notify_one();
+    }
+
+    void ImportAnimation(AssetRecord& record)
+    {
+        if (record.owner->status == AssetStatus::Failed)
+        {
+            record.status = AssetStatus::Failed;
+            record.owner->pendingAnimations--;
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(record.owner->boneMutex);
+            record.animation = std::make_unique<Animation>(record.path, record.owner->model.get());
+        }
+        record.progress = 0.9f;
+        record.status = AssetStatus::Uploading;
+        record.owner->pendingAnimations--;
+    }
+
+    // runs on the upload thread with the shared context current
+    void UploadLoop()
+    {
+        for (;;)
+        {
+            std::shared_ptr<AssetRecord> record;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_UploadCondition.wait(lock, [this] { return m_Stop || !m_UploadQueue.empty(); });
+                if (m_Stop)
+                    return;
+                record = PopHighestPriority(m_UploadQueue);
+            }
+
+            record->model->UploadTextures();
+            record->model->UploadBuffers();
+            record->uploadFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            // make sure the fence reaches the GPU, the render context waits on it
+            glFlush();
+            record->progress = 0.9f;
+
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_UploadDone.push_back(record);
+        }
+    }
+};
+#endif
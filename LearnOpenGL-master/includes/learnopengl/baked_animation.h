@@ -0,0 +1,181 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <learnopengl/animation.h>
+#include <learnopengl/gl_resource.h>
+#include <learnopengl/pose.h>
+#include <learnopengl/shader.h>
+
+// Clips baked into a float texture for crowds that animate entirely on the GPU. Every row
+// holds the palette of one frame, three texels (the rows of the 3x4 bone matrix) per bone;
+// the clips are stacked on top of each other. The vertex shader (1.baked_crowd.vs) picks
+// the two frames around an instance's time and interpolates, so playing a clip costs no CPU
+// time at all once baked.
+class BakedAnimationSet
+{
+public:
+	static const int MaxClips = 32;	// MAX_BAKED_CLIPS in the shader
+
+	// boneCount is the number of palette entries to bake (Model::GetBoneCount())
+	BakedAnimationSet(int boneCount, float framesPerSecond = 30.0f)
+		: m_BoneCount(boneCount), m_FramesPerSecond(framesPerSecond) {}
+
+	// samples animation into rows on the CPU, returns its clip index or -1 when full.
+	// Call Upload() once every clip is added.
+	int AddClip(Animation& animation, bool loop = true)
+	{
+		if ((int)m_Clips.size() == MaxClips)
+			return -1;
+		float seconds = animation.GetDuration() / animation.GetTicksPerSecond();
+		int segments = std::max(1, (int)std::ceil(seconds * m_FramesPerSecond));
+		int firstRow = m_RowCount;
+
+		const Skeleton& skeleton = animation.GetSkeleton();
+		std::vector<BoneCursor> cursors;
+		std::vector<glm::mat4> globals, palette(m_BoneCount, glm::mat4(1.0f));
+		Pose pose;
+		for (int frame = 0; frame <= segments; frame++)
+		{
+			// the last frame of a loop is its first one again, so the shader can always
+			// interpolate towards frame + 1
+			float time = std::min(frame / m_FramesPerSecond * animation.GetTicksPerSecond(), animation.GetDuration());
+			if (loop && frame == segments)
+				time = 0.0f;
+			SamplePose(animation, animation.GetJointChannels(), time, cursors, skeleton, pose);
+			ComposePalette(skeleton, pose, globals, palette.data(), m_BoneCount);
+			for (const glm::mat4& bone : palette)
+			{
+				for (int row = 0; row < 3; row++)
+					m_Texels.push_back(glm::vec4(bone[0][row], bone[1][row], bone[2][row], bone[3][row]));
+			}
+		}
+		m_RowCount += segments + 1;
+
+		m_Clips.push_back(glm::vec4((float)firstRow, (float)segments, m_FramesPerSecond, loop ? 1.0f : 0.0f));
+		return (int)m_Clips.size() - 1;
+	}
+
+	void Upload()
+	{
+		m_Texture = CreateTexture2D(1, GL_RGBA32F, m_BoneCount * 3, m_RowCount, GpuCategory::Texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_BoneCount * 3, m_RowCount, GL_RGBA, GL_FLOAT, m_Texels.data());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		std::vector<glm::vec4>().swap(m_Texels);
+	}
+
+	// binds the palettes to textureUnit and sets the clip table; the table only changes
+	// with the clips, so this can be done once per shader
+	void Bind(Shader& shader, int textureUnit) const
+	{
+		glActiveTexture(GL_TEXTURE0 + textureUnit);
+		glBindTexture(GL_TEXTURE_2D, m_Texture.Get());
+		glActiveTexture(GL_TEXTURE0);
+		shader.setInt("bakedPalettes", textureUnit);
+		shader.setInt("bakedBoneCount", m_BoneCount);
+		if (!m_Clips.empty())
+			glUniform4fv(glGetUniformLocation(shader.ID, "bakedClips"), (GLsizei)m_Clips.size(), &m_Clips[0].x);
+	}
+
+	int GetClipCount() const { return (int)m_Clips.size(); }
+	int GetRowCount() const { return m_RowCount; }
+	size_t GetGpuBytes() const { return TextureBytes(GL_RGBA32F, m_BoneCount * 3, m_RowCount, 1); }
+
+private:
+	int m_BoneCount;
+	float m_FramesPerSecond;
+	int m_RowCount = 0;
+	std::vector<glm::vec4> m_Texels;	// until uploaded
+	std::vector<glm::vec4> m_Clips;	// first row, segments, frames per second, loop
+	GLTexture m_Texture;
+};
+
+// Instances of one model playing baked clips: model matrix, clip, time offset and speed,
+// kept in a texture buffer the vertex shader reads by gl_InstanceID. Nothing is uploaded
+// unless instances change; every frame only the time uniform is set and the model drawn
+// instanced.
+class BakedCrowd
+{
+public:
+	explicit BakedCrowd(unsigned int maxInstances) : m_MaxInstances(maxInstances), m_DirtyBegin(maxInstances)
+	{
+		m_Buffer = CreateBuffer(GL_TEXTURE_BUFFER, maxInstances * TexelsPerInstance * sizeof(glm::vec4), NULL, GpuCategory::Other, GL_DYNAMIC_STORAGE_BIT);
+		unsigned int id;
+		glGenTextures(1, &id);
+		m_Texture = GLTexture(id);
+		glBindTexture(GL_TEXTURE_BUFFER, id);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_Buffer.Get());
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	// returns the instance index, or GetMaxInstances() when full. timeOffset (seconds)
+	// keeps instances playing the same clip apart.
+	unsigned int Add(const glm::mat4& model, int clip, float timeOffset, float speed = 1.0f)
+	{
+		if (m_Texels.size() / TexelsPerInstance == m_MaxInstances)
+			return m_MaxInstances;
+		unsigned int index = GetInstanceCount();
+		m_Texels.resize(m_Texels.size() + TexelsPerInstance);
+		Set(index, model, clip, timeOffset, speed);
+		return index;
+	}
+
+	void Set(unsigned int index, const glm::mat4& model, int clip, float timeOffset, float speed = 1.0f)
+	{
+		glm::vec4* texels = &m_Texels[index * TexelsPerInstance];
+		for (int column = 0; column < 4; column++)
+			texels[column] = model[column];
+		texels[4] = glm::vec4((float)clip, timeOffset, speed, 0.0f);
+		m_DirtyBegin = std::min(m_DirtyBegin, index);
+		m_DirtyEnd = std::max(m_DirtyEnd, index + 1);
+	}
+
+	void Clear()
+	{
+		m_Texels.clear();
+		m_DirtyBegin = m_MaxInstances;
+		m_DirtyEnd = 0;
+	}
+
+	// uploads the instances changed since the last draw, binds everything and draws model
+	// once per instance. time is in seconds.
+	void Draw(Model& model, Shader& shader, const BakedAnimationSet& clips, float time, int paletteUnit = 14, int instanceUnit = 15)
+	{
+		if (m_DirtyBegin < m_DirtyEnd)
+		{
+			glBindBuffer(GL_TEXTURE_BUFFER, m_Buffer.Get());
+			glBufferSubData(GL_TEXTURE_BUFFER, m_DirtyBegin * TexelsPerInstance * sizeof(glm::vec4),
+				(m_DirtyEnd - m_DirtyBegin) * TexelsPerInstance * sizeof(glm::vec4), &m_Texels[m_DirtyBegin * TexelsPerInstance]);
+			glBindBuffer(GL_TEXTURE_BUFFER, 0);
+			m_DirtyBegin = m_MaxInstances;
+			m_DirtyEnd = 0;
+		}
+		if (GetInstanceCount() == 0)
+			return;
+
+		clips.Bind(shader, paletteUnit);
+		glActiveTexture(GL_TEXTURE0 + instanceUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, m_Texture.Get());
+		glActiveTexture(GL_TEXTURE0);
+		shader.setInt("bakedInstances", instanceUnit);
+		shader.setFloat("time", time);
+		model.Draw(shader, GetInstanceCount());
+	}
+
+	unsigned int GetInstanceCount() const { return (unsigned int)(m_Texels.size() / TexelsPerInstance); }
+	unsigned int GetMaxInstances() const { return m_MaxInstances; }
+
+private:
+	static const int TexelsPerInstance = 5;	// model matrix columns, then clip / offset / speed
+
+	unsigned int m_MaxInstances;
+	std::vector<glm::vec4> m_Texels;
+	unsigned int m_DirtyBegin, m_DirtyEnd = 0;	// instances to upload
+	GLBuffer m_Buffer;
+	GLTexture m_Texture;
+};
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/animation.h>
+#include <learnopengl/skeleton.h>
+#include <learnopengl/pose.h>
+
+// per joint weights of a layer, 0 leaves the joint to the layers below
+struct BoneMask
+{
+	std::vector<float> weights;
+
+	// the joint called rootName and everything below it, e.g. the spine for an upper body layer.
+	// An unknown name is reported and masks out every joint.
+	static BoneMask FromJoint(const Skeleton& skeleton, const std::string& rootName, float weight = 1.0f)
+	{
+		BoneMask mask;
+		mask.weights.assign(skeleton.GetJointCount(), 0.0f);
+		int root = skeleton.FindJoint(rootName);
+		if (root < 0)
+		{
+			std::cout << "ERROR::BLEND_TREE::JOINT_NOT_FOUND: " << rootName << std::endl;
+			return mask;
+		}
+		for (int joint = 0; joint < skeleton.GetJointCount(); joint++)
+		{
+			int parent = skeleton.m_Parents[joint];
+			// parents come first, so a child inherits its parent's weight in one pass
+			if (joint == root || (parent >= 0 && mask.weights[parent] > 0.0f))
+				mask.weights[joint] = weight;
+		}
+		return mask;
+	}
+};
+
+// Evaluates a tree of clips, N-way blends, additive layers and masked override layers into
+// one local pose over the SoA streams of Pose, and composes it to matrices once at the end.
+// The cost of a blend is a multiply-add per bone and clip, not a matrix product per bone and
+// clip. Nodes are created bottom up, children first; the last node added (or SetRoot()) is
+// the output. One tree holds the clocks and key cursors of one character, build one per
+// instance. Evaluate() doesn't allocate once every node has run.
+//
+//     BlendTree tree(rifleRun.GetSkeleton());
+//     int legs = tree.AddBlend({ tree.AddClip(&idle), tree.AddClip(&rifleRun) });
+//     int aim = tree.AddClip(&grab);
+//     tree.AddLayer(legs, aim, BoneMask::FromJoint(rifleRun.GetSkeleton(), "spineu"));
+class BlendTree
+{
+public:
+	typedef int NodeId;
+
+	// all clips are retargeted by joint name onto skeleton, which has to outlive the tree
+	explicit BlendTree(const Skeleton& skeleton) : m_Skeleton(&skeleton) {}
+
+	NodeId AddClip(Animation* animation, bool loop = true)
+	{
+		Node node;
+		node.type = NodeType::Clip;
+		node.clip = (int)m_Clips.size();
+		Clip clip;
+		clip.animation = animation;
+		clip.channels = animation->BuildChannelMap(*m_Skeleton);
+		clip.loop = loop;
+		m_Clips.push_back(clip);
+		return AddNode(node);
+	}
+
+	// weights start at one for the first child and zero for the others; they are normalized
+	// when evaluated, so only the ratios matter
+	NodeId AddBlend(const std::vector<NodeId>& children)
+	{
+		Node node;
+		node.type = NodeType::Blend;
+		node.children = children;
+		node.weights.assign(children.size(), 0.0f);
+		if (!children.empty())
+			node.weights[0] = 1.0f;
+		return AddNode(node);
+	}
+
+	// adds the difference between additive and its reference pose on top of base. The reference
+	// is the first frame of the additive clip unless SetReferenceTime() picks another one.
+	// additive has to be a clip node; anything else is reported and base is returned unchanged.
+	NodeId AddAdditive(NodeId base, NodeId additive, float weight = 1.0f, const BoneMask* mask = nullptr)
+	{
+		if (m_Nodes[additive].type != NodeType::Clip)
+		{
+			std::cout << "ERROR::BLEND_TREE::ADDITIVE_NOT_A_CLIP: node " << additive << std::endl;
+			return base;
+		}
+		Node node;
+		node.type = NodeType::Additive;
+		node.children = { base, additive };
+		node.weight = weight;
+		if (mask)
+			node.mask = mask->weights;
+		node.reference = (int)m_References.size();
+		m_References.emplace_back();
+		NodeId id = AddNode(node);
+		SetReferenceTime(id, 0.0f);
+		return id;
+	}
+
+	// overrides base with overlay where mask is set, e.g. aiming with the upper body while the
+	// legs keep running
+	NodeId AddLayer(NodeId base, NodeId overlay, const BoneMask& mask, float weight = 1.0f)
+	{
+		Node node;
+		node.type = NodeType::Layer;
+		node.children = { base, overlay };
+		node.weight = weight;
+		node.mask = mask.weights;
+		return AddNode(node);
+	}
+
+	void SetRoot(NodeId node) { m_Root = node; }
+	NodeId GetRoot() const { return m_Root; }
+
+	// weight of one child of a blend node
+	void SetWeight(NodeId blend, int child, float weight) { m_Nodes[blend].weights[child] = weight; }
+
+	// weight of an additive or layer node
+	void SetWeight(NodeId node, float weight) { m_Nodes[node].weight = weight; }
+
+	// blend weights from a single parameter: the children are spread evenly over [0, 1] and
+	// the two around t get weights, e.g. idle - walk - run driven by speed
+	void SetBlendParameter(NodeId blend, float t)
+	{
+		Node& node = m_Nodes[blend];
+		int count = (int)node.weights.size();
+		std::fill(node.weights.begin(), node.weights.end(), 0.0f);
+		if (count == 1)
+			node.weights[0] = 1.0f;
+		if (count <= 1)
+			return;
+		float position = glm::clamp(t, 0.0f, 1.0f) * (count - 1);
+		int lower = std::min((int)position, count - 2);
+		float fraction = position - lower;
+		node.weights[lower] = 1.0f - fraction;
+		node.weights[lower + 1] = fraction;
+	}
+
+	// clip time in ticks of the clip node
+	void SetTime(NodeId clip, float time) { m_Clips[m_Nodes[clip].clip].time = time; }
+	float GetTime(NodeId clip) const { return m_Clips[m_Nodes[clip].clip].time; }
+	void SetSpeed(NodeId clip, float speed) { m_Clips[m_Nodes[clip].clip].speed = speed; }
+
+	// resamples the reference pose of an additive node from its additive clip
+	void SetReferenceTime(NodeId additive, float time)
+	{
+		const Node& node = m_Nodes[additive];
+		Clip& clip = m_Clips[m_Nodes[node.children[1]].clip];
+		std::vector<BoneCursor> cursors;
+		SamplePose(*clip.animation, clip.channels, time, cursors, *m_Skeleton, m_References[node.reference]);
+	}
+
+	// advances every clip, also the ones weighted out, so they stay in step
+	void Advance(float dt)
+	{
+		for (Clip& clip : m_Clips)
+		{
+			clip.time += clip.animation->GetTicksPerSecond() * clip.speed * dt;
+			float duration = clip.animation->GetDuration();
+			if (clip.loop)
+			{
+				clip.time = std::fmod(clip.time, duration);
+				if (clip.time < 0.0f)
+					clip.time += duration;
+			}
+			else
+				clip.time = glm::clamp(clip.time, 0.0f, duration);
+		}
+	}
+
+	// evaluates the tree into pose, in local space
+	void Evaluate(Pose& pose)
+	{
+		if (m_Root < 0)
+		{
+			pose.SetBindPose(*m_Skeleton);
+			return;
+		}
+		EvaluateNode(m_Root, pose, 0);
+	}
+
+	// evaluates the tree and writes the skinning matrices into palette
+	void EvaluatePalette(glm::mat4* palette, int paletteSize)
+	{
+		Evaluate(m_Pose);
+		ComposePalette(*m_Skeleton, m_Pose, m_GlobalTransforms, palette, paletteSize);
+	}
+
+	const Skeleton& GetSkeleton() const { return *m_Skeleton; }
+	int GetNodeCount() const { return (int)m_Nodes.size(); }
+
+private:
+	enum class NodeType { Clip, Blend, Additive, Layer };
+
+	struct Node
+	{
+		NodeType type = NodeType::Clip;
+		std::vector<NodeId> children;
+		std::vector<float> weights;	// blend
+		float weight = 1.0f;	// additive, layer
+		std::vector<float> mask;	// per joint, empty for all joints
+		int clip = -1;
+		int reference = -1;	// additive
+	};
+
+	struct Clip
+	{
+		Animation* animation = nullptr;
+		std::vector<int> channels;	// joint -> channel
+		std::vector<BoneCursor> cursors;
+		float time = 0.0f;
+		float speed = 1.0f;
+		bool loop = true;
+	};
+
+	const Skeleton* m_Skeleton;
+	std::vector<Node> m_Nodes;
+	std::vector<Clip> m_Clips;
+	std::vector<Pose> m_References;
+	std::vector<Pose> m_Scratch;	// one pose per tree level
+	Pose m_Pose;
+	std::vector<glm::mat4> m_GlobalTransforms;
+	NodeId m_Root = -1;
+
+	NodeId AddNode(const Node& node)
+	{
+		m_Nodes.push_back(node);
+		m_Root = (NodeId)m_Nodes.size() - 1;
+		return m_Root;
+	}
+
+	int GetDepth(NodeId id) const
+	{
+		int depth = 0;
+		for (NodeId child : m_Nodes[id].children)
+			depth = std::max(depth, GetDepth(child) + 1);
+		return depth;
+	}
+
+	void EvaluateNode(NodeId id, Pose& out, int depth)
+	{
+		// sized up front, the recursion holds references into it
+		if (depth == 0)
+		{
+			size_t levels = (size_t)GetDepth(id) + 1;
+			if (m_Scratch.size() < levels)
+				m_Scratch.resize(levels);
+		}
+
+		Node& node = m_Nodes[id];
+		int jointCount = m_Skeleton->GetJointCount();
+		const float* mask = node.mask.empty() ? nullptr : node.mask.data();
+		switch (node.type)
+		{
+		case NodeType::Clip:
+		{
+			Clip& clip = m_Clips[node.clip];
+			SamplePose(*clip.animation, clip.channels, clip.time, clip.cursors, *m_Skeleton, out);
+			break;
+		}
+		case NodeType::Blend:
+		{
+			float total = 0.0f;
+			for (float weight : node.weights)
+				total += std::max(weight, 0.0f);
+			if (total <= 0.0f)
+			{
+				out.SetBindPose(*m_Skeleton);
+				break;
+			}
+
+			// a single contributing child is evaluated straight into out
+			int contributing = 0, last = -1;
+			for (size_t i = 0; i < node.weights.size(); i++)
+			{
+				if (node.weights[i] > 0.0f)
+				{
+					contributing++;
+					last = (int)i;
+				}
+			}
+			if (contributing == 1)
+			{
+				EvaluateNode(node.children[last], out, depth + 1);
+				break;
+			}
+
+			ClearPose(out, jointCount);
+			Pose& child = m_Scratch[depth];
+			for (size_t i = 0; i < node.children.size(); i++)
+			{
+				if (node.weights[i] <= 0.0f)
+					continue;
+				EvaluateNode(node.children[i], child, depth + 1);
+				AccumulatePose(out, child, node.weights[i] / total);
+			}
+			NormalizePose(out);
+			break;
+		}
+		case NodeType::Additive:
+		{
+			EvaluateNode(node.children[0], out, depth + 1);
+			if (node.weight <= 0.0f)
+				break;
+			Pose& additive = m_Scratch[depth];
+			EvaluateNode(node.children[1], additive, depth + 1);
+			AddPose(out, additive, m_References[node.reference], node.weight, mask);
+			break;
+		}
+		case NodeType::Layer:
+		{
+			EvaluateNode(node.children[0], out, depth + 1);
+			if (node.weight <= 0.0f)
+				break;
+			Pose& overlay = m_Scratch[depth];
+			EvaluateNode(node.children[1], overlay, depth + 1);
+			LerpPose(out, overlay, node.weight, mask);
+			break;
+		}
+		}
+	}
+};
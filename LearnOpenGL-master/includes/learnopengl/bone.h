@@ -3,6 +3,8 @@
 /* Container for bone data */
 
 #include <vector>
+#include <algorithm>
+#include <cmath>
 #include <assimp/scene.h>
 #include <list>
 #include <glm/glm.hpp>
@@ -28,6 +30,16 @@ struct KeyScale
 	float timeStamp;
 };
 
+// last segment used per track. Playback is mostly monotonic, so the next lookup usually
+// hits the same or the following segment and skips the search. Bones keep one cursor of
+// their own; samplers that play a clip at several times keep one per instance.
+struct BoneCursor
+{
+	int position = 0;
+	int rotation = 0;
+	int scale = 0;
+};
+
 class Bone
 {
 public:
@@ -72,111 +84,133 @@ public:
 		}
 	}
 	
+	// samples the bone through its own cursor. After ReleaseKeys() the bone has no keys left
+	// and keeps its last local transform; compressed clips are sampled through the Animation.
 	void Update(float animationTime)
 	{
-		glm::vec3 tmp;
-		glm::quat tmpR;
-		glm::mat4 translation = InterpolatePosition(animationTime, tmp);
-		glm::mat4 rotation = InterpolateRotation(animationTime, tmpR);
-		glm::mat4 scale = InterpolateScaling(animationTime, tmp);
-		m_LocalTransform = translation * rotation * scale;
+		if (m_Positions.empty() || m_Rotations.empty() || m_Scales.empty())
+			return;
+		glm::vec3 position, scale;
+		glm::quat rotation;
+		Sample(animationTime, m_Cursor, position, rotation, scale);
+		m_LocalTransform = glm::translate(glm::mat4(1.0f), position) * glm::toMat4(rotation) * glm::scale(glm::mat4(1.0f), scale);
 	}
 	glm::mat4 GetLocalTransform() { return m_LocalTransform; }
 	std::string GetBoneName() const { return m_Name; }
 	int GetBoneID() { return m_ID; }
-	
-
 
-	int GetPositionIndex(float animationTime)
+	// samples all three tracks without touching the bone, safe to call from several threads
+	// as long as each uses its own cursor.
+	void Sample(float animationTime, BoneCursor& cursor, glm::vec3& position, glm::quat& rotation, glm::vec3& scale) const
 	{
-		for (int index = 0; index < m_NumPositions - 1; ++index)
+		position = SampleTrack(m_Positions, animationTime, cursor.position, &KeyPosition::position);
+		scale = SampleTrack(m_Scales, animationTime, cursor.scale, &KeyScale::scale);
+		if (m_Rotations.size() == 1)
 		{
-			if (animationTime < m_Positions[index + 1].timeStamp)
-				return index;
+			rotation = glm::normalize(m_Rotations[0].orientation);
+			return;
 		}
-		assert(0);
+		int p0Index = FindKeyIndex(m_Rotations, animationTime, cursor.rotation);
+		float scaleFactor = GetScaleFactor(m_Rotations[p0Index].timeStamp, m_Rotations[p0Index + 1].timeStamp, animationTime);
+		rotation = glm::normalize(glm::slerp(m_Rotations[p0Index].orientation, m_Rotations[p0Index + 1].orientation, scaleFactor));
 	}
 
-	int GetRotationIndex(float animationTime)
+	// drops the keys once the clip has been compressed; afterwards only the name and id are valid.
+	void ReleaseKeys()
 	{
-		for (int index = 0; index < m_NumRotations - 1; ++index)
-		{
-			if (animationTime < m_Rotations[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		std::vector<KeyPosition>().swap(m_Positions);
+		std::vector<KeyRotation>().swap(m_Rotations);
+		std::vector<KeyScale>().swap(m_Scales);
+		m_NumPositions = m_NumRotations = m_NumScalings = 0;
 	}
 
-	int GetScaleIndex(float animationTime)
+	size_t GetKeyMemoryBytes() const
 	{
-		for (int index = 0; index < m_NumScalings - 1; ++index)
-		{
-			if (animationTime < m_Scales[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return m_Positions.size() * sizeof(KeyPosition) + m_Rotations.size() * sizeof(KeyRotation) + m_Scales.size() * sizeof(KeyScale);
+	}
+
+	// rewrites every track with keys at a fixed step (in ticks), after which a key lookup is a
+	// single division instead of a search. Done once after loading; it trades memory for speed,
+	// tracks with a single key are left alone.
+	void ResampleUniform(float step)
+	{
+		BoneCursor cursor;
+		m_InvUniformStep = 0.0f;
+		ResampleTrack(m_Positions, step, [&](float time, KeyPosition& key) { glm::quat r; glm::vec3 s; Sample(time, cursor, key.position, r, s); });
+		ResampleTrack(m_Rotations, step, [&](float time, KeyRotation& key) { glm::vec3 p, s; Sample(time, cursor, p, key.orientation, s); });
+		ResampleTrack(m_Scales, step, [&](float time, KeyScale& key) { glm::quat r; glm::vec3 p; Sample(time, cursor, p, r, key.scale); });
+		m_NumPositions = (int)m_Positions.size();
+		m_NumRotations = (int)m_Rotations.size();
+		m_NumScalings = (int)m_Scales.size();
+		m_InvUniformStep = 1.0f / step;
+		m_Cursor = BoneCursor();
 	}
 
 
 //private:
 
-	float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
+	static float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
 	{
 		float scaleFactor = 0.0f;
 		float midWayLength = animationTime - lastTimeStamp;
 		float framesDiff = nextTimeStamp - lastTimeStamp;
 		scaleFactor = midWayLength / framesDiff;
-		return scaleFactor;
+		// times before the first or after the last key hold the end pose
+		return glm::clamp(scaleFactor, 0.0f, 1.0f);
 	}
 
-	glm::mat4 InterpolatePosition(float animationTime, glm::vec3 &finalPos)
+	// index of the key that starts the segment containing animationTime. Times outside the
+	// track clamp to the first or last segment. Needs at least two keys.
+	template <typename Key>
+	int FindKeyIndex(const std::vector<Key>& keys, float animationTime, int& cursor) const
 	{
-		if (1 == m_NumPositions)
-			return glm::translate(glm::mat4(1.0f), m_Positions[0].position);
-
-		int p0Index = GetPositionIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Positions[p0Index].timeStamp,
-			m_Positions[p1Index].timeStamp, animationTime);
-		glm::vec3 finalPosition = glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position
-			, scaleFactor);
-		finalPos = finalPosition;
-		return glm::translate(glm::mat4(1.0f), finalPosition);
-	}
+		int lastSegment = (int)keys.size() - 2;
+		if (m_InvUniformStep > 0.0f)
+		{
+			int index = (int)((animationTime - keys[0].timeStamp) * m_InvUniformStep);
+			return std::min(std::max(index, 0), lastSegment);
+		}
 
-	glm::mat4 InterpolateRotation(float animationTime, glm::quat &finalQuat)
-	{
-		if (1 == m_NumRotations)
+		int c = std::min(cursor, lastSegment);
+		if (keys[c].timeStamp <= animationTime)
 		{
-			auto rotation = glm::normalize(m_Rotations[0].orientation);
-			return glm::toMat4(rotation);
+			// same segment as last time, or the next one
+			if (c == lastSegment || animationTime < keys[c + 1].timeStamp)
+				return cursor = c;
+			if (c + 1 == lastSegment || animationTime < keys[c + 2].timeStamp)
+				return cursor = c + 1;
 		}
 
-		int p0Index = GetRotationIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Rotations[p0Index].timeStamp,
-			m_Rotations[p1Index].timeStamp, animationTime);
-		glm::quat finalRotation = glm::slerp(m_Rotations[p0Index].orientation, m_Rotations[p1Index].orientation
-			, scaleFactor);
-		finalRotation = glm::normalize(finalRotation);
-		finalQuat = finalRotation;
-		return glm::toMat4(finalRotation);
+		// a seek or a loop: binary search for the first key after animationTime
+		auto next = std::upper_bound(keys.begin() + 1, keys.end() - 1, animationTime,
+			[](float time, const Key& key) { return time < key.timeStamp; });
+		return cursor = (int)(next - keys.begin()) - 1;
+	}
 
+	template <typename Key>
+	glm::vec3 SampleTrack(const std::vector<Key>& keys, float animationTime, int& cursor, glm::vec3 Key::* value) const
+	{
+		if (keys.size() == 1)
+			return keys[0].*value;
+		int p0Index = FindKeyIndex(keys, animationTime, cursor);
+		float scaleFactor = GetScaleFactor(keys[p0Index].timeStamp, keys[p0Index + 1].timeStamp, animationTime);
+		return glm::mix(keys[p0Index].*value, keys[p0Index + 1].*value, scaleFactor);
 	}
 
-	glm::mat4 InterpolateScaling(float animationTime, glm::vec3 &finalScaling)
+	template <typename Key, typename Evaluate>
+	static void ResampleTrack(std::vector<Key>& keys, float step, Evaluate evaluate)
 	{
-		if (1 == m_NumScalings)
-			return glm::scale(glm::mat4(1.0f), m_Scales[0].scale);
-
-		int p0Index = GetScaleIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Scales[p0Index].timeStamp,
-			m_Scales[p1Index].timeStamp, animationTime);
-		glm::vec3 finalScale = glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale
-			, scaleFactor);
-		finalScaling = finalScale;
-		return glm::scale(glm::mat4(1.0f), finalScale);
+		if (keys.size() < 2)
+			return;
+		float start = keys.front().timeStamp;
+		int count = (int)std::ceil((keys.back().timeStamp - start) / step) + 1;
+		std::vector<Key> resampled(count);
+		for (int i = 0; i < count; i++)
+		{
+			resampled[i].timeStamp = start + i * step;
+			evaluate(resampled[i].timeStamp, resampled[i]);
+		}
+		keys.swap(resampled);
 	}
 
 	std::vector<KeyPosition> m_Positions;
@@ -185,6 +219,8 @@ public:
 	int m_NumPositions;
 	int m_NumRotations;
 	int m_NumScalings;
+	BoneCursor m_Cursor;
+	float m_InvUniformStep = 0.0f;	// > 0 once the tracks have been resampled uniformly
 
 	glm::mat4 m_LocalTransform;
 	std::string m_Name;
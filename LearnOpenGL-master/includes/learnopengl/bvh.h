@@ -0,0 +1,512 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <future>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/model_animation.h>
+#include <learnopengl/thread_pool.h>
+#include <learnopengl/simd.h>
+
+// origin + direction * t for t in [0, maxDistance]. direction doesn't have to be normalized,
+// distances are then in multiples of its length.
+struct Ray
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+	float maxDistance = FLT_MAX;
+};
+
+struct RayHit
+{
+	int mesh = -1;	// index into Model::meshes
+	int triangle = -1;	// index of the triangle's first index / 3
+	float u = 0.0f, v = 0.0f;	// barycentrics of the second and third vertex
+	float distance = FLT_MAX;
+
+	bool IsHit() const { return triangle >= 0; }
+};
+
+// ray into the space of inverseModel (the inverse of a model matrix); distances along it stay
+// those of the original ray
+inline Ray TransformRay(const Ray& ray, const glm::mat4& inverseModel)
+{
+	Ray local;
+	local.origin = glm::vec3(inverseModel * glm::vec4(ray.origin, 1.0f));
+	local.direction = glm::vec3(inverseModel * glm::vec4(ray.direction, 0.0f));
+	local.maxDistance = ray.maxDistance;
+	return local;
+}
+
+// Bounding volume hierarchy over the triangles of one mesh, built with the surface area
+// heuristic evaluated over binned centroids. Nodes are 32 bytes in one array, the children
+// of a node next to each other and after it; triangles are stored in leaf order with the
+// edges Moller-Trumbore needs precomputed. Rays are traced in packets of four, one per SSE
+// lane, so a node or triangle is fetched once for the whole packet. Refit() moves the
+// triangles to new vertex positions (e.g. a skinned pose) and fixes the boxes without
+// rebuilding the tree.
+class MeshBvh
+{
+public:
+	static const int MaxLeafTriangles = 4;
+	static const int BinCount = 12;
+	// deeper nodes are halved without the SAH, so traversal stacks stay bounded
+	static const int MaxSahDepth = 64;
+	static const int StackSize = MaxSahDepth + 40;
+
+	void Build(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+	{
+		std::vector<glm::vec3> positions(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+			positions[i] = vertices[i].Position;
+		Build(positions.data(), indices);
+	}
+
+	void Build(const glm::vec3* positions, const std::vector<unsigned int>& indices)
+	{
+		m_Indices = indices;
+		unsigned int triangleCount = (unsigned int)(indices.size() / 3);
+		m_Nodes.clear();
+		m_Order.resize(triangleCount);
+		m_Centroids.resize(triangleCount);
+		m_Bounds.resize(triangleCount);
+		for (unsigned int i = 0; i < triangleCount; i++)
+		{
+			const glm::vec3& a = positions[indices[i * 3]];
+			const glm::vec3& b = positions[indices[i * 3 + 1]];
+			const glm::vec3& c = positions[indices[i * 3 + 2]];
+			m_Order[i] = i;
+			m_Bounds[i].min = glm::min(a, glm::min(b, c));
+			m_Bounds[i].max = glm::max(a, glm::max(b, c));
+			m_Centroids[i] = (a + b + c) / 3.0f;
+		}
+		if (triangleCount == 0)
+		{
+			m_Triangles.clear();
+			return;
+		}
+
+		m_Nodes.reserve(triangleCount * 2);
+		m_Nodes.push_back(Node(0, triangleCount));
+		std::vector<std::pair<uint32_t, int>> stack(1, std::make_pair(0u, 0));
+		while (!stack.empty())
+		{
+			uint32_t node = stack.back().first;
+			int depth = stack.back().second;
+			stack.pop_back();
+			if (Split(node, depth >= MaxSahDepth))
+			{
+				stack.push_back(std::make_pair(m_Nodes[node].first, depth + 1));
+				stack.push_back(std::make_pair(m_Nodes[node].first + 1, depth + 1));
+			}
+		}
+		std::vector<glm::vec3>().swap(m_Centroids);
+		std::vector<Box>().swap(m_Bounds);
+		Refit(positions);
+	}
+
+	// moves the triangles to positions (same vertices, same order as when built) and refits
+	// every box bottom up; the tree gets looser the further positions are from the build
+	void Refit(const glm::vec3* positions)
+	{
+		m_Triangles.resize(m_Order.size());
+		for (size_t i = 0; i < m_Order.size(); i++)
+		{
+			unsigned int triangle = m_Order[i];
+			const glm::vec3& a = positions[m_Indices[triangle * 3]];
+			m_Triangles[i].v0 = a;
+			m_Triangles[i].e1 = positions[m_Indices[triangle * 3 + 1]] - a;
+			m_Triangles[i].e2 = positions[m_Indices[triangle * 3 + 2]] - a;
+		}
+		// children always come after their parent
+		for (size_t i = m_Nodes.size(); i-- > 0;)
+		{
+			Node& node = m_Nodes[i];
+			if (node.count > 0)
+			{
+				node.min = glm::vec3(FLT_MAX);
+				node.max = glm::vec3(-FLT_MAX);
+				for (uint32_t t = node.first; t < node.first + node.count; t++)
+				{
+					const Triangle& triangle = m_Triangles[t];
+					node.min = glm::min(node.min, glm::min(triangle.v0, glm::min(triangle.v0 + triangle.e1, triangle.v0 + triangle.e2)));
+					node.max = glm::max(node.max, glm::max(triangle.v0, glm::max(triangle.v0 + triangle.e1, triangle.v0 + triangle.e2)));
+				}
+			}
+			else
+			{
+				const Node& left = m_Nodes[node.first];
+				const Node& right = m_Nodes[node.first + 1];
+				node.min = glm::min(left.min, right.min);
+				node.max = glm::max(left.max, right.max);
+			}
+		}
+	}
+
+	// closest hit of every ray in front of the one already in hits (pass default RayHits to
+	// start); meshIndex goes into the hits it finds
+	void Intersect(const Ray* rays, RayHit* hits, size_t count, int meshIndex) const
+	{
+		if (m_Nodes.empty())
+			return;
+		size_t i = 0;
+#ifdef SIMD_SSE2
+		for (; i + 4 <= count; i += 4)
+			IntersectPacket(rays + i, hits + i, 4, meshIndex);
+		if (i < count)
+			IntersectPacket(rays + i, hits + i, count - i, meshIndex);
+#else
+		for (; i < count; i++)
+			IntersectSingle(rays[i], hits[i], meshIndex);
+#endif
+	}
+
+	bool IsEmpty() const { return m_Nodes.empty(); }
+	size_t GetNodeCount() const { return m_Nodes.size(); }
+	size_t GetTriangleCount() const { return m_Order.size(); }
+	glm::vec3 GetMin() const { return m_Nodes.empty() ? glm::vec3(0.0f) : m_Nodes[0].min; }
+	glm::vec3 GetMax() const { return m_Nodes.empty() ? glm::vec3(0.0f) : m_Nodes[0].max; }
+
+private:
+	struct Node
+	{
+		glm::vec3 min;
+		uint32_t first;	// first triangle of a leaf, left child of an inner node
+		glm::vec3 max;
+		uint32_t count : 30;	// triangles, 0 for inner nodes
+		uint32_t axis : 2;	// split axis of inner nodes
+
+		Node(uint32_t first, uint32_t count) : min(FLT_MAX), first(first), max(-FLT_MAX), count(count), axis(0) {}
+	};
+
+	struct Triangle
+	{
+		glm::vec3 v0, e1, e2;
+	};
+
+	struct Box
+	{
+		glm::vec3 min = glm::vec3(FLT_MAX);
+		glm::vec3 max = glm::vec3(-FLT_MAX);
+
+		void Grow(const Box& other)
+		{
+			min = glm::min(min, other.min);
+			max = glm::max(max, other.max);
+		}
+
+		float Area() const
+		{
+			glm::vec3 size = max - min;
+			return size.x < 0.0f ? 0.0f : size.x * size.y + size.y * size.z + size.z * size.x;
+		}
+	};
+
+	std::vector<Node> m_Nodes;
+	std::vector<Triangle> m_Triangles;	// in leaf order
+	std::vector<unsigned int> m_Order;	// leaf order -> triangle
+	std::vector<unsigned int> m_Indices;	// of the mesh, for Refit()
+	std::vector<glm::vec3> m_Centroids;	// by triangle, while building
+	std::vector<Box> m_Bounds;	// by triangle, while building
+
+	// splits node where the SAH is lowest (or in half when tooDeep), false when it stays a leaf
+	bool Split(uint32_t index, bool tooDeep)
+	{
+		uint32_t first = m_Nodes[index].first, count = m_Nodes[index].count;
+		Box centroidBox, nodeBox;
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			centroidBox.Grow(Box{ m_Centroids[m_Order[i]], m_Centroids[m_Order[i]] });
+			nodeBox.Grow(m_Bounds[m_Order[i]]);
+		}
+		m_Nodes[index].min = nodeBox.min;
+		m_Nodes[index].max = nodeBox.max;
+		if (count <= 1)
+			return false;
+
+		// cost relative to testing every triangle of the node
+		float bestCost = FLT_MAX;
+		int bestAxis = -1, bestSplit = 0;
+		for (int axis = 0; axis < 3 && !tooDeep; axis++)
+		{
+			float low = centroidBox.min[axis], extent = centroidBox.max[axis] - low;
+			if (extent <= 0.0f)
+				continue;
+			Box bins[BinCount];
+			uint32_t binCounts[BinCount] = {};
+			float scale = BinCount / extent;
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				int bin = std::min(BinCount - 1, (int)((m_Centroids[m_Order[i]][axis] - low) * scale));
+				bins[bin].Grow(m_Bounds[m_Order[i]]);
+				binCounts[bin]++;
+			}
+			// areas and counts left of every plane, then sweep from the right
+			float leftArea[BinCount - 1];
+			uint32_t leftCount[BinCount - 1];
+			Box left;
+			uint32_t sum = 0;
+			for (int i = 0; i < BinCount - 1; i++)
+			{
+				left.Grow(bins[i]);
+				sum += binCounts[i];
+				leftArea[i] = left.Area();
+				leftCount[i] = sum;
+			}
+			Box right;
+			sum = 0;
+			for (int i = BinCount - 1; i > 0; i--)
+			{
+				right.Grow(bins[i]);
+				sum += binCounts[i];
+				float cost = leftArea[i - 1] * leftCount[i - 1] + right.Area() * sum;
+				if (leftCount[i - 1] > 0 && sum > 0 && cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = i;
+				}
+			}
+		}
+
+		// leaves stay small, past MaxLeafTriangles the best split is taken even if it costs more
+		float leafCost = nodeBox.Area() * count;
+		if (count <= (uint32_t)MaxLeafTriangles && (bestAxis < 0 || bestCost >= leafCost || tooDeep))
+			return false;
+
+		uint32_t middle;
+		if (bestAxis >= 0)
+		{
+			float low = centroidBox.min[bestAxis];
+			float scale = BinCount / (centroidBox.max[bestAxis] - low);
+			unsigned int* begin = &m_Order[first];
+			unsigned int* split = std::partition(begin, begin + count, [&](unsigned int triangle)
+			{
+				return std::min(BinCount - 1, (int)((m_Centroids[triangle][bestAxis] - low) * scale)) < bestSplit;
+			});
+			middle = first + (uint32_t)(split - begin);
+		}
+		else
+		{
+			// every centroid in one place (or too deep), any halves will do
+			bestAxis = 0;
+			middle = first + count / 2;
+		}
+
+		uint32_t child = (uint32_t)m_Nodes.size();
+		m_Nodes.push_back(Node(first, middle - first));
+		m_Nodes.push_back(Node(middle, first + count - middle));
+		m_Nodes[index].first = child;
+		m_Nodes[index].count = 0;
+		m_Nodes[index].axis = (uint32_t)bestAxis;
+		return true;
+	}
+
+	void IntersectSingle(const Ray& ray, RayHit& hit, int meshIndex) const
+	{
+		glm::vec3 inverse = 1.0f / ray.direction;
+		uint32_t stack[StackSize];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const Node& node = m_Nodes[stack[--top]];
+			glm::vec3 t1 = (node.min - ray.origin) * inverse, t2 = (node.max - ray.origin) * inverse;
+			glm::vec3 near = glm::min(t1, t2), far = glm::max(t1, t2);
+			float entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+			float exit = std::min(std::min(far.x, far.y), far.z);
+			if (entry > exit || entry >= std::min(hit.distance, ray.maxDistance))
+				continue;
+			if (node.count == 0)
+			{
+				// nearer child on top
+				bool flip = ray.direction[node.axis] < 0.0f;
+				stack[top++] = node.first + (flip ? 0 : 1);
+				stack[top++] = node.first + (flip ? 1 : 0);
+				continue;
+			}
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				const Triangle& triangle = m_Triangles[i];
+				glm::vec3 p = glm::cross(ray.direction, triangle.e2);
+				float det = glm::dot(triangle.e1, p);
+				if (std::abs(det) < 1e-12f)
+					continue;
+				float invDet = 1.0f / det;
+				glm::vec3 s = ray.origin - triangle.v0;
+				float u = glm::dot(s, p) * invDet;
+				glm::vec3 q = glm::cross(s, triangle.e1);
+				float v = glm::dot(ray.direction, q) * invDet;
+				float t = glm::dot(triangle.e2, q) * invDet;
+				if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < hit.distance && t <= ray.maxDistance)
+				{
+					hit.mesh = meshIndex;
+					hit.triangle = (int)m_Order[i];
+					hit.u = u;
+					hit.v = v;
+					hit.distance = t;
+				}
+			}
+		}
+	}
+
+#ifdef SIMD_SSE2
+	// up to four rays at once, one per lane; lanes past count never hit anything
+	void IntersectPacket(const Ray* rays, RayHit* hits, size_t count, int meshIndex) const
+	{
+		alignas(16) float ox[4], oy[4], oz[4], dx[4], dy[4], dz[4], best[4];
+		for (size_t i = 0; i < 4; i++)
+		{
+			const Ray& ray = rays[std::min(i, count - 1)];
+			ox[i] = ray.origin.x; oy[i] = ray.origin.y; oz[i] = ray.origin.z;
+			dx[i] = ray.direction.x; dy[i] = ray.direction.y; dz[i] = ray.direction.z;
+			best[i] = i < count ? std::min(hits[i].distance, ray.maxDistance) : -1.0f;
+		}
+		const __m128 originX = _mm_load_ps(ox), originY = _mm_load_ps(oy), originZ = _mm_load_ps(oz);
+		const __m128 dirX = _mm_load_ps(dx), dirY = _mm_load_ps(dy), dirZ = _mm_load_ps(dz);
+		const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+		const __m128 invX = _mm_div_ps(one, dirX), invY = _mm_div_ps(one, dirY), invZ = _mm_div_ps(one, dirZ);
+		__m128 closest = _mm_load_ps(best);
+		__m128 hitU = zero, hitV = zero;
+		__m128i hitTriangle = _mm_set1_epi32(-1);
+		const __m128 epsilon = _mm_set1_ps(1e-12f);
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		bool negative[3] = { dx[0] < 0.0f, dy[0] < 0.0f, dz[0] < 0.0f };
+
+		uint32_t stack[StackSize];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const Node& node = m_Nodes[stack[--top]];
+			// slab test of the box against all four rays
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.x), originX), invX);
+			__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.x), originX), invX);
+			__m128 entry = _mm_min_ps(t1, t2), exit = _mm_max_ps(t1, t2);
+			t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.y), originY), invY);
+			t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.y), originY), invY);
+			entry = _mm_max_ps(entry, _mm_min_ps(t1, t2));
+			exit = _mm_min_ps(exit, _mm_max_ps(t1, t2));
+			t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min.z), originZ), invZ);
+			t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max.z), originZ), invZ);
+			entry = _mm_max_ps(_mm_max_ps(entry, _mm_min_ps(t1, t2)), zero);
+			exit = _mm_min_ps(exit, _mm_max_ps(t1, t2));
+			__m128 active = _mm_and_ps(_mm_cmple_ps(entry, exit), _mm_cmplt_ps(entry, closest));
+			if (_mm_movemask_ps(active) == 0)
+				continue;
+
+			if (node.count == 0)
+			{
+				bool flip = negative[node.axis];
+				stack[top++] = node.first + (flip ? 0 : 1);
+				stack[top++] = node.first + (flip ? 1 : 0);
+				continue;
+			}
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				const Triangle& triangle = m_Triangles[i];
+				const __m128 e1x = _mm_set1_ps(triangle.e1.x), e1y = _mm_set1_ps(triangle.e1.y), e1z = _mm_set1_ps(triangle.e1.z);
+				const __m128 e2x = _mm_set1_ps(triangle.e2.x), e2y = _mm_set1_ps(triangle.e2.y), e2z = _mm_set1_ps(triangle.e2.z);
+				// p = direction x e2
+				__m128 px = _mm_sub_ps(_mm_mul_ps(dirY, e2z), _mm_mul_ps(dirZ, e2y));
+				__m128 py = _mm_sub_ps(_mm_mul_ps(dirZ, e2x), _mm_mul_ps(dirX, e2z));
+				__m128 pz = _mm_sub_ps(_mm_mul_ps(dirX, e2y), _mm_mul_ps(dirY, e2x));
+				__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+				__m128 invDet = _mm_div_ps(one, det);
+				// s = origin - v0
+				__m128 sx = _mm_sub_ps(originX, _mm_set1_ps(triangle.v0.x));
+				__m128 sy = _mm_sub_ps(originY, _mm_set1_ps(triangle.v0.y));
+				__m128 sz = _mm_sub_ps(originZ, _mm_set1_ps(triangle.v0.z));
+				__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+				// q = s x e1
+				__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+				__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+				__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+				__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dirX, qx), _mm_mul_ps(dirY, qy)), _mm_mul_ps(dirZ, qz)), invDet);
+				__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+				__m128 hit = _mm_cmpge_ps(_mm_and_ps(det, absMask), epsilon);
+				hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+				hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+				hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+				hit = _mm_and_ps(hit, _mm_cmpge_ps(t, zero));
+				hit = _mm_and_ps(hit, _mm_cmplt_ps(t, closest));
+				if (_mm_movemask_ps(hit) == 0)
+					continue;
+				closest = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, closest));
+				hitU = _mm_or_ps(_mm_and_ps(hit, u), _mm_andnot_ps(hit, hitU));
+				hitV = _mm_or_ps(_mm_and_ps(hit, v), _mm_andnot_ps(hit, hitV));
+				__m128i mask = _mm_castps_si128(hit);
+				hitTriangle = _mm_or_si128(_mm_and_si128(mask, _mm_set1_epi32((int)m_Order[i])), _mm_andnot_si128(mask, hitTriangle));
+			}
+		}
+
+		alignas(16) float distances[4], us[4], vs[4];
+		alignas(16) int32_t triangles[4];
+		_mm_store_ps(distances, closest);
+		_mm_store_ps(us, hitU);
+		_mm_store_ps(vs, hitV);
+		_mm_store_si128(reinterpret_cast<__m128i*>(triangles), hitTriangle);
+		for (size_t i = 0; i < count; i++)
+		{
+			if (triangles[i] < 0)
+				continue;
+			hits[i].mesh = meshIndex;
+			hits[i].triangle = triangles[i];
+			hits[i].u = us[i];
+			hits[i].v = vs[i];
+			hits[i].distance = distances[i];
+		}
+	}
+#endif
+};
+
+// One MeshBvh per mesh of a model, built in parallel. Rays are in model space; use
+// TransformRay() with the inverse model matrix for rays in world space.
+class ModelBvh
+{
+public:
+	// builds on pool and this thread, or just this thread without a pool
+	void Build(const Model& model, ThreadPool* pool = nullptr)
+	{
+		m_Meshes.assign(model.meshes.size(), MeshBvh());
+		std::vector<std::future<void>> jobs;
+		for (size_t i = 0; i < model.meshes.size(); i++)
+		{
+			const Mesh& mesh = model.meshes[i];
+			MeshBvh& bvh = m_Meshes[i];
+			if (pool && i + 1 < model.meshes.size())
+				jobs.push_back(pool->Enqueue([&bvh, &mesh] { bvh.Build(mesh.vertices, mesh.indices); }));
+			else
+				bvh.Build(mesh.vertices, mesh.indices);
+		}
+		for (std::future<void>& job : jobs)
+			job.wait();
+	}
+
+	// closest hits of count rays across every mesh, hits start out as default RayHits
+	void Intersect(const Ray* rays, RayHit* hits, size_t count) const
+	{
+		for (size_t i = 0; i < count; i++)
+			hits[i] = RayHit();
+		for (size_t mesh = 0; mesh < m_Meshes.size(); mesh++)
+			m_Meshes[mesh].Intersect(rays, hits, count, (int)mesh);
+	}
+
+	RayHit Intersect(const Ray& ray) const
+	{
+		RayHit hit;
+		Intersect(&ray, &hit, 1);
+		return hit;
+	}
+
+	size_t GetMeshCount() const { return m_Meshes.size(); }
+	MeshBvh& GetMesh(size_t index) { return m_Meshes[index]; }
+	const MeshBvh& GetMesh(size_t index) const { return m_Meshes[index]; }
+
+private:
+	std::vector<MeshBvh> m_Meshes;
+};
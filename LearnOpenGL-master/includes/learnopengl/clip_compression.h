@@ -0,0 +1,457 @@
+#pragma once
+
+/* Compressed storage for animation clips */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/quaternion.hpp>
+#include <learnopengl/bone.h>
+
+// Max error of the decoded clip at the source key times. Quantization is part of it, so a
+// translation or scale axis spanning more than 65535 * tolerance, or a rotation tolerance
+// below ~0.00015 rad, may not be met; those tracks keep every key.
+struct ClipCompressionSettings
+{
+	float positionTolerance = 0.001f;	// max translation error, in model units
+	float rotationTolerance = 0.0005f;	// max rotation error, in radians
+	float scaleTolerance = 0.0005f;		// max scale error
+};
+
+// A clip after key reduction and quantization:
+// - keys that linear interpolation of the quantized neighbours rebuilds within tolerance are dropped
+// - tracks that never leave tolerance of their first key keep only that key
+// - rotations are stored smallest-three in 48 bits, the largest component is rebuilt
+// - translations and scales are quantized to 16 bits over each track's range
+// - key times are 16 bit fractions of the clip duration, and so is the sample time
+// Samples are decoded straight from the packed arrays.
+class CompressedClip
+{
+public:
+	CompressedClip() = default;
+
+	CompressedClip(const std::vector<Bone>& bones, float duration, const ClipCompressionSettings& settings = ClipCompressionSettings())
+		: m_Duration(duration), m_SourceHash(SourceHash(bones, duration, settings))
+	{
+		for (const Bone& bone : bones)
+		{
+			Channel channel;
+			channel.position = AddVectorTrack(bone.m_Positions, &KeyPosition::position, settings.positionTolerance, glm::vec3(0.0f));
+			channel.rotation = AddRotationTrack(bone.m_Rotations, settings.rotationTolerance);
+			channel.scale = AddVectorTrack(bone.m_Scales, &KeyScale::scale, settings.scaleTolerance, glm::vec3(1.0f));
+			m_Channels.push_back(channel);
+		}
+	}
+
+	int GetChannelCount() const { return (int)m_Channels.size(); }
+
+	// identifies the raw keys and the settings a clip is compressed from, so a cached clip is
+	// only reused for the same source compressed the same way
+	static uint64_t SourceHash(const std::vector<Bone>& bones, float duration, const ClipCompressionSettings& settings)
+	{
+		// FNV-1a
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&hash](const void* data, size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; i++)
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+		};
+		add(&FormatVersion, sizeof(FormatVersion));
+		add(&duration, sizeof(duration));
+		add(&settings, sizeof(settings));
+		for (const Bone& bone : bones)
+		{
+			std::string name = bone.GetBoneName();
+			size_t counts[4] = { name.size(), bone.m_Positions.size(), bone.m_Rotations.size(), bone.m_Scales.size() };
+			add(counts, sizeof(counts));
+			add(name.data(), name.size());
+			add(bone.m_Positions.data(), bone.m_Positions.size() * sizeof(KeyPosition));
+			add(bone.m_Rotations.data(), bone.m_Rotations.size() * sizeof(KeyRotation));
+			add(bone.m_Scales.data(), bone.m_Scales.size() * sizeof(KeyScale));
+		}
+		return hash;
+	}
+
+	void Sample(int channel, float animationTime, BoneCursor& cursor, glm::vec3& position, glm::quat& rotation, glm::vec3& scale) const
+	{
+		const Channel& c = m_Channels[channel];
+		// on the key time grid, so sampling at a source key lands exactly on its stored key
+		float time = (float)QuantizeTime(animationTime);
+		position = SampleVector(c.position, time, cursor.position);
+		rotation = SampleRotation(c.rotation, time, cursor.rotation);
+		scale = SampleVector(c.scale, time, cursor.scale);
+	}
+
+	size_t GetMemoryBytes() const
+	{
+		return m_Channels.size() * sizeof(Channel) + m_Times.size() * sizeof(uint16_t) +
+			m_Vectors.size() * sizeof(uint16_t) + m_Rotations.size() * sizeof(uint16_t);
+	}
+
+	bool Save(const std::string& path) const
+	{
+		std::ofstream file(path, std::ios::binary);
+		uint32_t header[4] = { FileMagic, (uint32_t)m_Channels.size(), (uint32_t)m_Times.size(), (uint32_t)m_Vectors.size() };
+		uint32_t rotationCount = (uint32_t)m_Rotations.size();
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(&m_SourceHash), sizeof(m_SourceHash));
+		file.write(reinterpret_cast<const char*>(&rotationCount), sizeof(rotationCount));
+		file.write(reinterpret_cast<const char*>(&m_Duration), sizeof(m_Duration));
+		file.write(reinterpret_cast<const char*>(m_Channels.data()), m_Channels.size() * sizeof(Channel));
+		file.write(reinterpret_cast<const char*>(m_Times.data()), m_Times.size() * sizeof(uint16_t));
+		file.write(reinterpret_cast<const char*>(m_Vectors.data()), m_Vectors.size() * sizeof(uint16_t));
+		file.write(reinterpret_cast<const char*>(m_Rotations.data()), m_Rotations.size() * sizeof(uint16_t));
+		return (bool)file;
+	}
+
+	// fails unless the file is a complete clip compressed from sourceHash (see SourceHash())
+	bool Load(const std::string& path, uint64_t sourceHash)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		uint64_t fileSize = file ? (uint64_t)file.tellg() : 0;
+		file.seekg(0);
+		uint32_t header[4], rotationCount;
+		uint64_t storedHash;
+		if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != FileMagic)
+			return false;
+		if (!file.read(reinterpret_cast<char*>(&storedHash), sizeof(storedHash)) || storedHash != sourceHash)
+			return false;
+		if (!file.read(reinterpret_cast<char*>(&rotationCount), sizeof(rotationCount)) ||
+			!file.read(reinterpret_cast<char*>(&m_Duration), sizeof(m_Duration)))
+			return false;
+
+		// the counts have to account for exactly the rest of the file
+		uint64_t expected = sizeof(header) + sizeof(storedHash) + sizeof(rotationCount) + sizeof(m_Duration) +
+			(uint64_t)header[1] * sizeof(Channel) + ((uint64_t)header[2] + header[3] + rotationCount) * sizeof(uint16_t);
+		if (expected != fileSize)
+			return false;
+
+		m_SourceHash = storedHash;
+		m_Channels.resize(header[1]);
+		m_Times.resize(header[2]);
+		m_Vectors.resize(header[3]);
+		m_Rotations.resize(rotationCount);
+		file.read(reinterpret_cast<char*>(m_Channels.data()), m_Channels.size() * sizeof(Channel));
+		file.read(reinterpret_cast<char*>(m_Times.data()), m_Times.size() * sizeof(uint16_t));
+		file.read(reinterpret_cast<char*>(m_Vectors.data()), m_Vectors.size() * sizeof(uint16_t));
+		file.read(reinterpret_cast<char*>(m_Rotations.data()), m_Rotations.size() * sizeof(uint16_t));
+		if (!file || !HasValidTracks())
+		{
+			m_Channels.clear();
+			return false;
+		}
+		return true;
+	}
+
+	// 48 bit smallest-three: 2 bits for the dropped component, 15 bits for each of the others
+	static void EncodeRotation(glm::quat q, uint16_t out[3])
+	{
+		q = glm::normalize(q);
+		float c[4] = { q.x, q.y, q.z, q.w };
+		int largest = 0;
+		for (int i = 1; i < 4; i++)
+		{
+			if (std::abs(c[i]) > std::abs(c[largest]))
+				largest = i;
+		}
+		// q and -q are the same rotation, make the dropped component positive
+		float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+		uint64_t bits = (uint64_t)largest << 45;
+		int shift = 30;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+			float v = glm::clamp(c[i] * sign * RotationRange, -1.0f, 1.0f);
+			bits |= (uint64_t)(uint32_t)std::lround((v * 0.5f + 0.5f) * 32767.0f) << shift;
+			shift -= 15;
+		}
+		out[0] = (uint16_t)(bits >> 32);
+		out[1] = (uint16_t)(bits >> 16);
+		out[2] = (uint16_t)bits;
+	}
+
+	static glm::quat DecodeRotation(const uint16_t in[3])
+	{
+		uint64_t bits = ((uint64_t)in[0] << 32) | ((uint64_t)in[1] << 16) | in[2];
+		int largest = (int)(bits >> 45) & 3;
+		float c[4];
+		float sum = 0.0f;
+		int shift = 30;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest)
+				continue;
+			float v = ((bits >> shift) & 0x7FFF) / 32767.0f * 2.0f - 1.0f;
+			c[i] = v / RotationRange;
+			sum += c[i] * c[i];
+			shift -= 15;
+		}
+		c[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+		return glm::quat(c[3], c[0], c[1], c[2]);
+	}
+
+private:
+	// the three smallest components of a unit quaternion lie within +-1/sqrt(2)
+	static constexpr float RotationRange = 1.41421356f;
+	static constexpr uint32_t FileMagic = 0x50494C43;	// "CLIP"
+	// part of SourceHash, bump when the compressor changes so cached clips are rebuilt
+	static constexpr uint32_t FormatVersion = 2;
+
+	struct Track
+	{
+		uint32_t firstKey = 0;		// into m_Times
+		uint32_t firstValue = 0;	// into m_Vectors (3 per key) or m_Rotations (3 per key)
+		uint32_t keyCount = 0;		// 1 for a constant track
+		glm::vec3 rangeMin = glm::vec3(0.0f);	// constant vector tracks store their value here
+		glm::vec3 rangeExtent = glm::vec3(0.0f);
+	};
+
+	struct Channel
+	{
+		Track position, rotation, scale;
+	};
+
+	float m_Duration = 0.0f;
+	uint64_t m_SourceHash = 0;
+	std::vector<Channel> m_Channels;
+	std::vector<uint16_t> m_Times;
+	std::vector<uint16_t> m_Vectors;
+	std::vector<uint16_t> m_Rotations;
+
+	// -- compression --------------------------------------------------------------------
+
+	uint16_t QuantizeTime(float time) const
+	{
+		return m_Duration > 0.0f ? (uint16_t)std::lround(glm::clamp(time / m_Duration, 0.0f, 1.0f) * 65535.0f) : 0;
+	}
+
+	// greedy reduction: extend each segment as long as every skipped key is rebuilt within
+	// tolerance by interpolating the decoded segment ends at the quantized times, the way
+	// Sample() does. Returns the kept key indices.
+	template <typename Value, typename Interpolate, typename Distance>
+	std::vector<int> ReduceKeys(const std::vector<float>& times, const std::vector<Value>& values, const std::vector<Value>& decoded,
+		const Value& constantValue, float tolerance, Interpolate interpolate, Distance distance) const
+	{
+		int count = (int)values.size();
+		bool constant = true;
+		for (int i = 0; i < count && constant; i++)
+			constant = distance(constantValue, values[i]) <= tolerance;
+		if (constant)
+			return std::vector<int>(1, 0);
+
+		std::vector<float> keyTimes;
+		for (float time : times)
+			keyTimes.push_back((float)QuantizeTime(time));
+		std::vector<int> kept(1, 0);
+		int start = 0;
+		for (int end = 2; end < count; end++)
+		{
+			for (int k = start + 1; k < end; k++)
+			{
+				float t = glm::clamp((keyTimes[k] - keyTimes[start]) / std::max(1.0f, keyTimes[end] - keyTimes[start]), 0.0f, 1.0f);
+				if (distance(interpolate(decoded[start], decoded[end], t), values[k]) > tolerance)
+				{
+					kept.push_back(end - 1);
+					start = end - 1;
+					break;
+				}
+			}
+		}
+		kept.push_back(count - 1);
+		return kept;
+	}
+
+	// a track without keys holds rest
+	template <typename Key>
+	Track AddVectorTrack(const std::vector<Key>& keys, glm::vec3 Key::* member, float tolerance, glm::vec3 rest)
+	{
+		std::vector<float> times;
+		std::vector<glm::vec3> values;
+		for (const Key& key : keys)
+		{
+			times.push_back(key.timeStamp);
+			values.push_back(key.*member);
+		}
+		if (values.empty())
+		{
+			times.push_back(0.0f);
+			values.push_back(rest);
+		}
+
+		// quantized over the range of the whole track, so the decoded keys are known before reduction
+		Track track;
+		glm::vec3 lo = values[0], hi = lo;
+		for (const glm::vec3& value : values)
+		{
+			lo = glm::min(lo, value);
+			hi = glm::max(hi, value);
+		}
+		track.rangeMin = lo;
+		track.rangeExtent = hi - lo;
+		std::vector<uint16_t> packed;
+		std::vector<glm::vec3> decoded;
+		for (const glm::vec3& value : values)
+		{
+			glm::vec3 quantized;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float normalized = track.rangeExtent[axis] > 0.0f ? (value[axis] - lo[axis]) / track.rangeExtent[axis] : 0.0f;
+				packed.push_back((uint16_t)std::lround(normalized * 65535.0f));
+				quantized[axis] = packed.back();
+			}
+			// same expression as DecodeVector
+			decoded.push_back(track.rangeMin + track.rangeExtent * quantized * (1.0f / 65535.0f));
+		}
+
+		// constant tracks keep the first value unquantized
+		std::vector<int> kept = ReduceKeys(times, values, decoded, values[0], tolerance,
+			[](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); },
+			[](const glm::vec3& a, const glm::vec3& b) { return glm::length(a - b); });
+		track.keyCount = (uint32_t)kept.size();
+		if (kept.size() == 1)
+		{
+			track.rangeMin = values[0];
+			track.rangeExtent = glm::vec3(0.0f);
+			return track;
+		}
+
+		track.firstKey = (uint32_t)m_Times.size();
+		track.firstValue = (uint32_t)m_Vectors.size();
+		for (int index : kept)
+		{
+			m_Times.push_back(QuantizeTime(times[index]));
+			m_Vectors.insert(m_Vectors.end(), packed.begin() + index * 3, packed.begin() + index * 3 + 3);
+		}
+		return track;
+	}
+
+	Track AddRotationTrack(const std::vector<KeyRotation>& keys, float tolerance)
+	{
+		std::vector<float> times;
+		std::vector<glm::quat> values;
+		for (const KeyRotation& key : keys)
+		{
+			glm::quat q = glm::normalize(key.orientation);
+			// keep neighbours in the same hemisphere so interpolation takes the short way
+			if (!values.empty() && glm::dot(values.back(), q) < 0.0f)
+				q = -q;
+			times.push_back(key.timeStamp);
+			values.push_back(q);
+		}
+		if (values.empty())
+		{
+			times.push_back(0.0f);
+			values.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		}
+
+		std::vector<uint16_t> packed(values.size() * 3);
+		std::vector<glm::quat> decoded;
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			EncodeRotation(values[i], &packed[i * 3]);
+			decoded.push_back(DecodeRotation(&packed[i * 3]));
+		}
+
+		Track track;
+		std::vector<int> kept = ReduceKeys(times, values, decoded, decoded[0], tolerance, &Nlerp, &RotationError);
+		track.keyCount = (uint32_t)kept.size();
+		track.firstKey = (uint32_t)m_Times.size();
+		track.firstValue = (uint32_t)m_Rotations.size();
+		for (int index : kept)
+		{
+			m_Times.push_back(QuantizeTime(times[index]));
+			m_Rotations.insert(m_Rotations.end(), packed.begin() + index * 3, packed.begin() + index * 3 + 3);
+		}
+		return track;
+	}
+
+	// -- decoding -----------------------------------------------------------------------
+
+	// every track of a loaded file points inside the packed arrays
+	bool HasValidTracks() const
+	{
+		auto fits = [](const Track& track, size_t times, size_t values, bool packed)
+		{
+			if (track.keyCount == 0)
+				return false;
+			// constant vector tracks keep their value in rangeMin and index nothing
+			if (!packed && track.keyCount == 1)
+				return true;
+			return (uint64_t)track.firstKey + track.keyCount <= times && (uint64_t)track.firstValue + track.keyCount * 3ull <= values;
+		};
+		for (const Channel& channel : m_Channels)
+		{
+			if (!fits(channel.position, m_Times.size(), m_Vectors.size(), false) ||
+				!fits(channel.rotation, m_Times.size(), m_Rotations.size(), true) ||
+				!fits(channel.scale, m_Times.size(), m_Vectors.size(), false))
+				return false;
+		}
+		return true;
+	}
+
+	// angle between two rotations. From the chord between the quaternions, as acos of their
+	// dot product can't resolve angles this small in float.
+	static float RotationError(const glm::quat& a, const glm::quat& b)
+	{
+		glm::quat near = glm::dot(a, b) < 0.0f ? -b : b;
+		float chord = glm::length(glm::vec4(a.x - near.x, a.y - near.y, a.z - near.z, a.w - near.w));
+		return 4.0f * std::asin(std::min(1.0f, chord * 0.5f));
+	}
+
+	static glm::quat Nlerp(const glm::quat& a, const glm::quat& b, float t)
+	{
+		glm::quat end = glm::dot(a, b) < 0.0f ? -b : b;
+		return glm::normalize(glm::quat(glm::mix(a.w, end.w, t), glm::mix(a.x, end.x, t), glm::mix(a.y, end.y, t), glm::mix(a.z, end.z, t)));
+	}
+
+	// segment of a track containing time, same cursor scheme as Bone::FindKeyIndex
+	int FindSegment(const Track& track, float time, int& cursor, float& factor) const
+	{
+		const uint16_t* times = &m_Times[track.firstKey];
+		int lastSegment = (int)track.keyCount - 2;
+		int c = std::min(cursor, lastSegment);
+		if (!(times[c] <= time && (c == lastSegment || time < times[c + 1])))
+		{
+			if (c < lastSegment && times[c + 1] <= time && (c + 1 == lastSegment || time < times[c + 2]))
+				c++;
+			else
+				c = std::max(0, (int)(std::upper_bound(times + 1, times + lastSegment + 1, time) - times) - 1);
+		}
+		cursor = c;
+		factor = glm::clamp((time - times[c]) / std::max(1.0f, (float)(times[c + 1] - times[c])), 0.0f, 1.0f);
+		return c;
+	}
+
+	glm::vec3 DecodeVector(const Track& track, int key) const
+	{
+		const uint16_t* v = &m_Vectors[track.firstValue + key * 3];
+		return track.rangeMin + track.rangeExtent * glm::vec3(v[0], v[1], v[2]) * (1.0f / 65535.0f);
+	}
+
+	glm::vec3 SampleVector(const Track& track, float time, int& cursor) const
+	{
+		if (track.keyCount == 1)
+			return track.rangeMin;
+		float factor;
+		int key = FindSegment(track, time, cursor, factor);
+		return glm::mix(DecodeVector(track, key), DecodeVector(track, key + 1), factor);
+	}
+
+	glm::quat SampleRotation(const Track& track, float time, int& cursor) const
+	{
+		const uint16_t* packed = &m_Rotations[track.firstValue];
+		if (track.keyCount == 1)
+			return DecodeRotation(packed);
+		float factor;
+		int key = FindSegment(track, time, cursor, factor);
+		return Nlerp(DecodeRotation(packed + key * 3), DecodeRotation(packed + key * 3 + 3), factor);
+	}
+};
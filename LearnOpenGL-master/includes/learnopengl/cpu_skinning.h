@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/animator.h>
+#include <learnopengl/animation_system.h>
+#include <learnopengl/bvh.h>
+#include <learnopengl/model_animation.h>
+#include <learnopengl/thread_pool.h>
+#include <learnopengl/simd.h>
+
+// Skinned positions and normals of a model on the CPU, for the queries the vertex shader
+// can't answer: ray hits, ragdoll proxies, decals. Blends like 1.skinning.cs (linear
+// blending with mat4 palettes, from an AnimationSystem instance with a CPU copy or from
+// Animator::GetFinalBoneMatrices() after UpdateAnimation()). The bind pose and
+// normalized bone weights are copied at construction, Skin() then writes the pose into
+// buffers that are reused every call and refits a BVH over them. On CPUs with AVX2 and FMA
+// (checked at runtime) a bone's matrix is blended in two 256-bit registers, otherwise with
+// SSE2 or plain glm.
+class CpuSkinnedModel
+{
+public:
+	// copies the bind pose of model and builds its BVH, on pool if given
+	explicit CpuSkinnedModel(const Model& model, ThreadPool* pool = nullptr)
+	{
+		m_Offsets.push_back(0);
+		for (const Mesh& mesh : model.meshes)
+		{
+			for (const Vertex& vertex : mesh.vertices)
+			{
+				m_BindPositions.push_back(vertex.Position);
+				float length = glm::length(vertex.Normal);
+				m_BindNormals.push_back(length > 0.0f ? vertex.Normal / length : vertex.Normal);
+
+				Influences influences = {};
+				int maxBone = -1;
+				float totalWeight = 0.0f;
+				for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+				{
+					int id = vertex.m_BoneIDs[i];
+					float weight = vertex.m_Weights[i];
+					if (id < 0 || weight <= 0.0f)
+						continue;
+					influences.ids[i] = id;
+					influences.weights[i] = weight;
+					maxBone = std::max(maxBone, id);
+					totalWeight += weight;
+				}
+				for (int i = 0; i < MAX_BONE_INFLUENCE && totalWeight > 0.0f; i++)
+					influences.weights[i] /= totalWeight;
+				m_Influences.push_back(influences);
+				m_MaxBones.push_back(maxBone);
+			}
+			m_Offsets.push_back(m_BindPositions.size());
+		}
+		m_Positions = m_BindPositions;
+		m_Normals = m_BindNormals;
+		m_Bvh.Build(model, pool);
+	}
+
+	// poses the model with palette, bones from paletteSize on keep the bind pose; then
+	// refits the BVH unless refit is false
+	void Skin(const glm::mat4* palette, int paletteSize, bool refit = true)
+	{
+#ifdef SIMD_AVX2
+		if (SimdHasAvx2())
+			SkinVerticesAvx2(palette, paletteSize);
+		else
+#endif
+		{
+			for (size_t vertex = 0; vertex < m_BindPositions.size(); vertex++)
+			{
+				if (!KeepBindPose(vertex, paletteSize))
+					SkinVertex(palette, vertex);
+			}
+		}
+		if (refit)
+			Refit();
+	}
+
+	// for an animator run with UpdateAnimation(); animators in an AnimationSystem write into
+	// its palettes instead and leave GetFinalBoneMatrices() in the bind pose
+	void Skin(Animator& animator, bool refit = true)
+	{
+		const std::vector<glm::mat4>& palette = animator.GetFinalBoneMatrices();
+		Skin(palette.data(), (int)palette.size(), refit);
+	}
+
+	// the last pose system wrote for id, which needs AnimationSystem::SetCpuCopy(); returns
+	// false (and skins nothing) without one
+	bool Skin(const AnimationSystem& system, AnimationSystem::InstanceId id, bool refit = true)
+	{
+		const glm::mat4* palette = system.GetCpuPalette(id);
+		if (!palette)
+			return false;
+		Skin(palette, system.GetMaxBones(), refit);
+		return true;
+	}
+
+	// moves the BVH to the last skinned pose
+	void Refit()
+	{
+		for (size_t mesh = 0; mesh + 1 < m_Offsets.size(); mesh++)
+			m_Bvh.GetMesh(mesh).Refit(&m_Positions[m_Offsets[mesh]]);
+	}
+
+	// the skinned pose in model space, indexed like Model::meshes[mesh].vertices
+	const glm::vec3* GetPositions(size_t mesh) const { return &m_Positions[m_Offsets[mesh]]; }
+	const glm::vec3* GetNormals(size_t mesh) const { return &m_Normals[m_Offsets[mesh]]; }
+	size_t GetVertexCount(size_t mesh) const { return m_Offsets[mesh + 1] - m_Offsets[mesh]; }
+	size_t GetMeshCount() const { return m_Offsets.size() - 1; }
+
+	// hits in the skinned pose, rays in model space (see TransformRay())
+	const ModelBvh& GetBvh() const { return m_Bvh; }
+
+private:
+	struct Influences
+	{
+		int ids[MAX_BONE_INFLUENCE];
+		float weights[MAX_BONE_INFLUENCE];	// normalized, 0 for unused slots
+	};
+
+	std::vector<glm::vec3> m_BindPositions;
+	std::vector<glm::vec3> m_BindNormals;
+	std::vector<Influences> m_Influences;
+	std::vector<int> m_MaxBones;	// highest bone of each vertex, -1 when it has none
+	std::vector<size_t> m_Offsets;	// first vertex of each mesh, then the total
+	std::vector<glm::vec3> m_Positions;
+	std::vector<glm::vec3> m_Normals;
+	ModelBvh m_Bvh;
+
+	// vertices without bones, or with bones past the palette, keep the bind pose
+	bool KeepBindPose(size_t vertex, int paletteSize)
+	{
+		if (m_MaxBones[vertex] >= 0 && m_MaxBones[vertex] < paletteSize)
+			return false;
+		m_Positions[vertex] = m_BindPositions[vertex];
+		m_Normals[vertex] = m_BindNormals[vertex];
+		return true;
+	}
+
+	void SkinVertex(const glm::mat4* palette, size_t vertex)
+	{
+		const Influences& influences = m_Influences[vertex];
+#ifdef SIMD_SSE2
+		__m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+		for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+		{
+			const float* bone = &palette[influences.ids[i]][0][0];
+			__m128 weight = _mm_set1_ps(influences.weights[i]);
+			c0 = _mm_add_ps(c0, _mm_mul_ps(weight, _mm_loadu_ps(bone)));
+			c1 = _mm_add_ps(c1, _mm_mul_ps(weight, _mm_loadu_ps(bone + 4)));
+			c2 = _mm_add_ps(c2, _mm_mul_ps(weight, _mm_loadu_ps(bone + 8)));
+			c3 = _mm_add_ps(c3, _mm_mul_ps(weight, _mm_loadu_ps(bone + 12)));
+		}
+		StoreVertex(vertex, c0, c1, c2, c3);
+#else
+		const glm::vec3& position = m_BindPositions[vertex];
+		const glm::vec3& normal = m_BindNormals[vertex];
+		glm::mat4 blended(0.0f);
+		for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+			blended += palette[influences.ids[i]] * influences.weights[i];
+		m_Positions[vertex] = glm::vec3(blended * glm::vec4(position, 1.0f));
+		glm::vec3 c0(blended[0]), c1(blended[1]), c2(blended[2]);
+		glm::vec3 n = glm::mat3(glm::cross(c1, c2), glm::cross(c2, c0), glm::cross(c0, c1)) * normal;
+		float length = glm::length(n);
+		m_Normals[vertex] = length > 0.0f ? n / length : n;
+#endif
+	}
+
+#ifdef SIMD_AVX2
+	// the whole loop is compiled for AVX2, a call per vertex couldn't be inlined into it
+	SIMD_AVX2_TARGET void SkinVerticesAvx2(const glm::mat4* palette, int paletteSize)
+	{
+		for (size_t vertex = 0; vertex < m_BindPositions.size(); vertex++)
+		{
+			if (KeepBindPose(vertex, paletteSize))
+				continue;
+			// columns 0-1 and 2-3 of the blended matrix
+			const Influences& influences = m_Influences[vertex];
+			__m256 c01 = _mm256_setzero_ps(), c23 = _mm256_setzero_ps();
+			for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+			{
+				const float* bone = &palette[influences.ids[i]][0][0];
+				__m256 weight = _mm256_set1_ps(influences.weights[i]);
+				c01 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(bone), c01);
+				c23 = _mm256_fmadd_ps(weight, _mm256_loadu_ps(bone + 8), c23);
+			}
+			StoreVertex(vertex, _mm256_castps256_ps128(c01), _mm256_extractf128_ps(c01, 1),
+				_mm256_castps256_ps128(c23), _mm256_extractf128_ps(c23, 1));
+		}
+	}
+#endif
+
+#ifdef SIMD_SSE2
+	// moves the bind pose of vertex by the blended matrix with columns c0-c3
+	void StoreVertex(size_t vertex, __m128 c0, __m128 c1, __m128 c2, __m128 c3)
+	{
+		const glm::vec3& position = m_BindPositions[vertex];
+		const glm::vec3& normal = m_BindNormals[vertex];
+		__m128 skinned = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(position.x)), _mm_mul_ps(c1, _mm_set1_ps(position.y))),
+			_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(position.z)), c3));
+
+		// cofactor matrix: the inverse transpose up to scale, right under non-uniform scale
+		__m128 n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Cross(c1, c2), _mm_set1_ps(normal.x)), _mm_mul_ps(Cross(c2, c0), _mm_set1_ps(normal.y))),
+			_mm_mul_ps(Cross(c0, c1), _mm_set1_ps(normal.z)));
+		__m128 lengthSq = _mm_mul_ps(n, n);
+		lengthSq = _mm_add_ps(lengthSq, _mm_shuffle_ps(lengthSq, lengthSq, _MM_SHUFFLE(2, 3, 0, 1)));
+		lengthSq = _mm_add_ps(lengthSq, _mm_shuffle_ps(lengthSq, lengthSq, _MM_SHUFFLE(1, 0, 3, 2)));
+		if (_mm_cvtss_f32(lengthSq) > 0.0f)
+			n = _mm_div_ps(n, _mm_sqrt_ps(lengthSq));
+
+		alignas(16) float out[8];
+		_mm_store_ps(out, skinned);
+		_mm_store_ps(out + 4, n);
+		std::memcpy(&m_Positions[vertex], out, sizeof(glm::vec3));
+		std::memcpy(&m_Normals[vertex], out + 4, sizeof(glm::vec3));
+	}
+
+	// xyz of a x b, w is a.w * b.w - a.w * b.w
+	static __m128 Cross(__m128 a, __m128 b)
+	{
+		__m128 aYzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 bYzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 c = _mm_sub_ps(_mm_mul_ps(a, bYzx), _mm_mul_ps(aYzx, b));
+		return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+	}
+#endif
+};
+
+// skins and refits models[i] with animators[i] (run with UpdateAnimation()), one job per
+// character on pool (or all on this thread without one)
+inline void SkinCharacters(CpuSkinnedModel* const* models, Animator* const* animators, size_t count, ThreadPool* pool = nullptr)
+{
+	std::vector<std::future<void>> jobs;
+	for (size_t i = 0; i < count; i++)
+	{
+		CpuSkinnedModel* model = models[i];
+		Animator* animator = animators[i];
+		if (pool && i + 1 < count)
+			jobs.push_back(pool->Enqueue([model, animator] { model->Skin(*animator); }));
+		else
+			model->Skin(*animator);
+	}
+	for (std::future<void>& job : jobs)
+		job.wait();
+}
+
+// the same for characters in system, models[i] is skinned with instance ids[i]. Call after
+// system.Update(), not during it.
+inline void SkinCharacters(CpuSkinnedModel* const* models, const AnimationSystem& system, const AnimationSystem::InstanceId* ids,
+	size_t count, ThreadPool* pool = nullptr)
+{
+	std::vector<std::future<void>> jobs;
+	for (size_t i = 0; i < count; i++)
+	{
+		CpuSkinnedModel* model = models[i];
+		AnimationSystem::InstanceId id = ids[i];
+		if (pool && i + 1 < count)
+			jobs.push_back(pool->Enqueue([model, &system, id] { model->Skin(system, id); }));
+		else
+			model->Skin(system, id);
+	}
+	for (std::future<void>& job : jobs)
+		job.wait();
+}
@@ -0,0 +1,564 @@
+#ifndef ECS_H
+#define ECS_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <learnopengl/thread_pool.h>
+
+// Archetype based entity component system. Entities with the same set of component types
+// share an archetype, which stores them in fixed size chunks with one array per component
+// type (structure of arrays). Queries walk the chunks of every archetype that has the
+// requested components, so systems stream through contiguous arrays and can split the
+// chunks across threads.
+// Adding or removing components moves an entity to another archetype; that and creating or
+// destroying entities must not happen while a query runs. Systems record such changes in
+// EcsCommands instead and EcsWorld::Flush() applies them afterwards.
+
+struct EntityId
+{
+	uint32_t index = ~0u;
+	uint32_t generation = 0;
+
+	bool IsValid() const { return index != ~0u; }
+	bool operator==(const EntityId& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const EntityId& other) const { return !(*this == other); }
+};
+
+typedef uint64_t ComponentMask;
+const int MaxComponentTypes = 64;
+
+// how to handle a component type without knowing it
+struct ComponentInfo
+{
+	size_t size;
+	size_t align;
+	void (*destroy)(void* dst);
+	void (*relocate)(void* dst, void* src);	// move constructs dst and destroys src
+};
+
+inline std::vector<ComponentInfo>& GetComponentInfos()
+{
+	static std::vector<ComponentInfo> infos;
+	return infos;
+}
+
+// one id per component type, handed out on first use
+template<typename T>
+struct ComponentType
+{
+	static int Id()
+	{
+		static const int id = Register();
+		return id;
+	}
+
+	static ComponentMask Mask() { return ComponentMask(1) << Id(); }
+
+private:
+	static int Register()
+	{
+		static_assert(alignof(T) <= alignof(std::max_align_t), "over aligned components are not supported");
+		static std::mutex mutex;
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<ComponentInfo>& infos = GetComponentInfos();
+		assert(infos.size() < MaxComponentTypes);
+		infos.push_back(ComponentInfo{ sizeof(T), alignof(T),
+			[](void* dst) { static_cast<T*>(dst)->~T(); },
+			[](void* dst, void* src) { new (dst) T(std::move(*static_cast<T*>(src))); static_cast<T*>(src)->~T(); } });
+		return (int)infos.size() - 1;
+	}
+};
+
+template<typename... Ts>
+ComponentMask MakeComponentMask()
+{
+	ComponentMask mask = 0;
+	int expand[] = { 0, ((void)(mask |= ComponentType<Ts>::Mask()), 0)... };
+	(void)expand;
+	return mask;
+}
+
+class EcsWorld;
+
+// the entities of one chunk and their component arrays
+class EcsChunkView
+{
+public:
+	uint32_t GetCount() const { return m_Count; }
+	const EntityId* GetEntities() const { return m_Entities; }
+
+	// the array of component T, null when this archetype doesn't have it
+	template<typename T>
+	T* Column() const
+	{
+		int column = m_Columns[ComponentType<T>::Id()];
+		return column >= 0 ? reinterpret_cast<T*>(m_Data + m_Offsets[column]) : nullptr;
+	}
+
+private:
+	friend class EcsWorld;
+	unsigned char* m_Data = nullptr;
+	const int* m_Columns = nullptr;
+	const size_t* m_Offsets = nullptr;
+	const EntityId* m_Entities = nullptr;
+	uint32_t m_Count = 0;
+};
+
+// structural changes recorded during a query, applied by EcsWorld::Flush(). Safe to record
+// into from several threads.
+class EcsCommands
+{
+public:
+	template<typename... Ts>
+	void Create(Ts... components);
+
+	void Destroy(EntityId entity);
+
+	template<typename T>
+	void Add(EntityId entity, T component);
+
+	template<typename T>
+	void Remove(EntityId entity);
+
+private:
+	friend class EcsWorld;
+	std::mutex m_Mutex;
+	std::vector<std::function<void(EcsWorld&)>> m_Commands;
+
+	void Record(std::function<void(EcsWorld&)> command)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Commands.push_back(std::move(command));
+	}
+};
+
+class EcsWorld
+{
+public:
+	// bytes per chunk, the entity count per chunk follows from the component sizes
+	static const size_t ChunkBytes = 16 * 1024;
+
+	EcsWorld()
+	{
+		// the archetype without components, where Create() puts entities
+		GetArchetype(0);
+	}
+
+	EcsWorld(const EcsWorld&) = delete;
+	EcsWorld& operator=(const EcsWorld&) = delete;
+
+	~EcsWorld()
+	{
+		for (std::unique_ptr<Archetype>& archetype : m_Archetypes)
+		{
+			for (size_t chunk = 0; chunk < archetype->chunks.size(); chunk++)
+			{
+				for (uint32_t row = 0; row < archetype->chunks[chunk].count; row++)
+					DestroyRow(*archetype, (uint32_t)chunk, row);
+			}
+		}
+	}
+
+	// a new entity with the given components
+	template<typename... Ts>
+	EntityId Create(Ts... components)
+	{
+		assert(!m_Iterating);
+		EntityId entity = AllocateEntity();
+		Archetype& archetype = GetArchetype(MakeComponentMask<Ts...>());
+		Place(entity, archetype);
+		int expand[] = { 0, ((void)(new (ComponentPointer<Ts>(entity)) Ts(std::move(components))), 0)... };
+		(void)expand;
+		return entity;
+	}
+
+	void Destroy(EntityId entity)
+	{
+		assert(!m_Iterating);
+		if (!IsAlive(entity))
+			return;
+		Record& record = m_Records[entity.index];
+		DestroyRow(*record.archetype, record.chunk, record.row);
+		RemoveRow(*record.archetype, record.chunk, record.row);
+		record.archetype = nullptr;
+		record.generation++;
+		m_FreeIndices.push_back(entity.index);
+		m_AliveCount--;
+	}
+
+	bool IsAlive(EntityId entity) const
+	{
+		return entity.index < m_Records.size() && m_Records[entity.index].archetype && m_Records[entity.index].generation == entity.generation;
+	}
+
+	// adds component, or replaces it when entity already has one
+	template<typename T>
+	void Add(EntityId entity, T component)
+	{
+		assert(!m_Iterating);
+		if (!IsAlive(entity))
+			return;
+		if (T* existing = Get<T>(entity))
+		{
+			*existing = std::move(component);
+			return;
+		}
+		Move(entity, m_Records[entity.index].archetype->mask | ComponentType<T>::Mask());
+		new (ComponentPointer<T>(entity)) T(std::move(component));
+	}
+
+	template<typename T>
+	void Remove(EntityId entity)
+	{
+		assert(!m_Iterating);
+		if (!Has<T>(entity))
+			return;
+		Move(entity, m_Records[entity.index].archetype->mask & ~ComponentType<T>::Mask());
+	}
+
+	template<typename T>
+	bool Has(EntityId entity) const
+	{
+		return IsAlive(entity) && (m_Records[entity.index].archetype->mask & ComponentType<T>::Mask()) != 0;
+	}
+
+	// null when entity doesn't have T. Pointers stay valid until the next structural change.
+	template<typename T>
+	T* Get(EntityId entity)
+	{
+		return Has<T>(entity) ? ComponentPointer<T>(entity) : nullptr;
+	}
+
+	// calls fn(EcsChunkView&) for every chunk of every archetype with all of Ts
+	template<typename... Ts, typename F>
+	void EachChunk(F&& fn)
+	{
+		ComponentMask mask = MakeComponentMask<Ts...>();
+		m_Iterating++;
+		for (std::unique_ptr<Archetype>& archetype : m_Archetypes)
+		{
+			if ((archetype->mask & mask) != mask)
+				continue;
+			for (size_t chunk = 0; chunk < archetype->chunks.size(); chunk++)
+			{
+				EcsChunkView view = MakeView(*archetype, chunk);
+				fn(view);
+			}
+		}
+		m_Iterating--;
+	}
+
+	// calls fn(EntityId, Ts&...) for every entity with all of Ts
+	template<typename... Ts, typename F>
+	void Each(F&& fn)
+	{
+		EachChunk<Ts...>([&fn](EcsChunkView& view)
+		{
+			EachInChunk<Ts...>(view, fn);
+		});
+	}
+
+	// same as Each(), with the chunks split across pool and this thread. fn runs concurrently
+	// and must only write to the components it is given.
+	template<typename... Ts, typename F>
+	void ParallelEach(ThreadPool& pool, F&& fn)
+	{
+		std::vector<EcsChunkView> views;
+		ComponentMask mask = MakeComponentMask<Ts...>();
+		for (std::unique_ptr<Archetype>& archetype : m_Archetypes)
+		{
+			if ((archetype->mask & mask) != mask)
+				continue;
+			for (size_t chunk = 0; chunk < archetype->chunks.size(); chunk++)
+				views.push_back(MakeView(*archetype, chunk));
+		}
+
+		m_Iterating++;
+		size_t batchCount = std::min<size_t>(pool.GetThreadCount() + 1, views.size());
+		size_t batchSize = batchCount ? (views.size() + batchCount - 1) / batchCount : 0;
+		std::vector<std::future<void>> jobs;
+		auto run = [&views, &fn](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				EachInChunk<Ts...>(views[i], fn);
+		};
+		for (size_t begin = batchSize; begin < views.size(); begin += batchSize)
+		{
+			size_t end = std::min(begin + batchSize, views.size());
+			jobs.push_back(pool.Enqueue([&run, begin, end] { run(begin, end); }));
+		}
+		run(0, std::min(batchSize, views.size()));
+		for (std::future<void>& job : jobs)
+			job.wait();
+		m_Iterating--;
+	}
+
+	// applies the changes recorded in commands, in the order they were recorded
+	void Flush(EcsCommands& commands)
+	{
+		std::vector<std::function<void(EcsWorld&)>> recorded;
+		{
+			std::lock_guard<std::mutex> lock(commands.m_Mutex);
+			recorded.swap(commands.m_Commands);
+		}
+		for (std::function<void(EcsWorld&)>& command : recorded)
+			command(*this);
+	}
+
+	uint32_t GetEntityCount() const { return m_AliveCount; }
+	size_t GetArchetypeCount() const { return m_Archetypes.size(); }
+	size_t GetChunkCount() const
+	{
+		size_t chunks = 0;
+		for (const std::unique_ptr<Archetype>& archetype : m_Archetypes)
+			chunks += archetype->chunks.size();
+		return chunks;
+	}
+
+private:
+	struct Chunk
+	{
+		std::unique_ptr<std::max_align_t[]> data;
+		uint32_t count = 0;
+	};
+
+	struct Archetype
+	{
+		ComponentMask mask = 0;
+		std::vector<int> types;	// component ids, ascending
+		int columns[MaxComponentTypes];	// component id -> index into types, -1 when absent
+		std::vector<size_t> offsets;	// of every column in a chunk
+		size_t entityOffset = 0;	// the EntityId column
+		uint32_t capacity = 0;	// entities per chunk
+		std::vector<Chunk> chunks;	// all full except the last
+	};
+
+	struct Record
+	{
+		Archetype* archetype = nullptr;	// null while the index is free
+		uint32_t chunk = 0;
+		uint32_t row = 0;
+		uint32_t generation = 0;
+	};
+
+	std::vector<std::unique_ptr<Archetype>> m_Archetypes;
+	std::unordered_map<ComponentMask, Archetype*> m_ArchetypesByMask;
+	std::vector<Record> m_Records;	// by entity index
+	std::vector<uint32_t> m_FreeIndices;
+	uint32_t m_AliveCount = 0;
+	int m_Iterating = 0;
+
+	template<typename... Ts, typename F>
+	static void EachInChunk(EcsChunkView& view, F& fn)
+	{
+		const EntityId* entities = view.GetEntities();
+		auto columns = std::make_tuple(view.Column<Ts>()...);
+		for (uint32_t i = 0; i < view.GetCount(); i++)
+			std::apply([&](Ts*... column) { fn(entities[i], column[i]...); }, columns);
+	}
+
+	Archetype& GetArchetype(ComponentMask mask)
+	{
+		auto found = m_ArchetypesByMask.find(mask);
+		if (found != m_ArchetypesByMask.end())
+			return *found->second;
+
+		std::unique_ptr<Archetype> archetype(new Archetype());
+		archetype->mask = mask;
+		std::fill(std::begin(archetype->columns), std::end(archetype->columns), -1);
+		const std::vector<ComponentInfo>& infos = GetComponentInfos();
+		size_t rowBytes = sizeof(EntityId);
+		for (int type = 0; type < MaxComponentTypes; type++)
+		{
+			if (mask & (ComponentMask(1) << type))
+			{
+				archetype->columns[type] = (int)archetype->types.size();
+				archetype->types.push_back(type);
+				rowBytes += infos[type].size;
+			}
+		}
+		// leave room to align every column
+		size_t padding = (archetype->types.size() + 1) * alignof(std::max_align_t);
+		archetype->capacity = (uint32_t)std::max<size_t>(1, (ChunkBytes - padding) / rowBytes);
+
+		size_t offset = 0;
+		for (int type : archetype->types)
+		{
+			archetype->offsets.push_back(offset);
+			offset = AlignUp(offset + infos[type].size * archetype->capacity);
+		}
+		archetype->entityOffset = offset;
+
+		Archetype* result = archetype.get();
+		m_Archetypes.push_back(std::move(archetype));
+		m_ArchetypesByMask[mask] = result;
+		return *result;
+	}
+
+	static size_t AlignUp(size_t offset)
+	{
+		const size_t align = alignof(std::max_align_t);
+		return (offset + align - 1) / align * align;
+	}
+
+	size_t GetChunkSize(const Archetype& archetype) const
+	{
+		return archetype.entityOffset + sizeof(EntityId) * archetype.capacity;
+	}
+
+	unsigned char* GetData(const Archetype& archetype, uint32_t chunk) const
+	{
+		return reinterpret_cast<unsigned char*>(archetype.chunks[chunk].data.get());
+	}
+
+	EntityId* GetEntities(const Archetype& archetype, uint32_t chunk) const
+	{
+		return reinterpret_cast<EntityId*>(GetData(archetype, chunk) + archetype.entityOffset);
+	}
+
+	void* GetComponent(const Archetype& archetype, int column, uint32_t chunk, uint32_t row) const
+	{
+		return GetData(archetype, chunk) + archetype.offsets[column] + GetComponentInfos()[archetype.types[column]].size * row;
+	}
+
+	template<typename T>
+	T* ComponentPointer(EntityId entity)
+	{
+		const Record& record = m_Records[entity.index];
+		return static_cast<T*>(GetComponent(*record.archetype, record.archetype->columns[ComponentType<T>::Id()], record.chunk, record.row));
+	}
+
+	EcsChunkView MakeView(Archetype& archetype, size_t chunk)
+	{
+		EcsChunkView view;
+		view.m_Data = GetData(archetype, (uint32_t)chunk);
+		view.m_Columns = archetype.columns;
+		view.m_Offsets = archetype.offsets.data();
+		view.m_Entities = GetEntities(archetype, (uint32_t)chunk);
+		view.m_Count = archetype.chunks[chunk].count;
+		return view;
+	}
+
+	EntityId AllocateEntity()
+	{
+		EntityId entity;
+		if (!m_FreeIndices.empty())
+		{
+			entity.index = m_FreeIndices.back();
+			m_FreeIndices.pop_back();
+		}
+		else
+		{
+			entity.index = (uint32_t)m_Records.size();
+			m_Records.emplace_back();
+		}
+		entity.generation = m_Records[entity.index].generation;
+		m_AliveCount++;
+		return entity;
+	}
+
+	// appends a row for entity to archetype, its components are left unconstructed
+	void Place(EntityId entity, Archetype& archetype)
+	{
+		if (archetype.chunks.empty() || archetype.chunks.back().count == archetype.capacity)
+		{
+			Chunk chunk;
+			size_t elements = (GetChunkSize(archetype) + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+			chunk.data.reset(new std::max_align_t[elements]);
+			archetype.chunks.push_back(std::move(chunk));
+		}
+		uint32_t chunk = (uint32_t)archetype.chunks.size() - 1;
+		uint32_t row = archetype.chunks[chunk].count++;
+		GetEntities(archetype, chunk)[row] = entity;
+
+		Record& record = m_Records[entity.index];
+		record.archetype = &archetype;
+		record.chunk = chunk;
+		record.row = row;
+	}
+
+	void DestroyRow(Archetype& archetype, uint32_t chunk, uint32_t row)
+	{
+		for (size_t column = 0; column < archetype.types.size(); column++)
+			GetComponentInfos()[archetype.types[column]].destroy(GetComponent(archetype, (int)column, chunk, row));
+	}
+
+	// fills the hole at (chunk, row), whose components are already destroyed or moved out,
+	// with the last row of the archetype so the chunks stay dense
+	void RemoveRow(Archetype& archetype, uint32_t chunk, uint32_t row)
+	{
+		uint32_t lastChunk = (uint32_t)archetype.chunks.size() - 1;
+		uint32_t lastRow = archetype.chunks[lastChunk].count - 1;
+		if (chunk != lastChunk || row != lastRow)
+		{
+			for (size_t column = 0; column < archetype.types.size(); column++)
+			{
+				GetComponentInfos()[archetype.types[column]].relocate(GetComponent(archetype, (int)column, chunk, row),
+					GetComponent(archetype, (int)column, lastChunk, lastRow));
+			}
+			EntityId moved = GetEntities(archetype, lastChunk)[lastRow];
+			GetEntities(archetype, chunk)[row] = moved;
+			m_Records[moved.index].chunk = chunk;
+			m_Records[moved.index].row = row;
+		}
+		if (--archetype.chunks[lastChunk].count == 0)
+			archetype.chunks.pop_back();
+	}
+
+	// moves entity to the archetype of mask; components both have are moved, the ones only
+	// the old one has destroyed and the ones only the new one has left unconstructed
+	void Move(EntityId entity, ComponentMask mask)
+	{
+		Record& record = m_Records[entity.index];
+		Archetype& from = *record.archetype;
+		uint32_t chunk = record.chunk, row = record.row;
+		Archetype& to = GetArchetype(mask);
+		Place(entity, to);
+		const Record& placed = m_Records[entity.index];
+		for (size_t column = 0; column < from.types.size(); column++)
+		{
+			int type = from.types[column];
+			void* src = GetComponent(from, (int)column, chunk, row);
+			if (to.columns[type] >= 0)
+				GetComponentInfos()[type].relocate(GetComponent(to, to.columns[type], placed.chunk, placed.row), src);
+			else
+				GetComponentInfos()[type].destroy(src);
+		}
+		RemoveRow(from, chunk, row);
+	}
+};
+
+template<typename... Ts>
+void EcsCommands::Create(Ts... components)
+{
+	Record([components...](EcsWorld& world) mutable { world.Create<Ts...>(std::move(components)...); });
+}
+
+inline void EcsCommands::Destroy(EntityId entity)
+{
+	Record([entity](EcsWorld& world) { world.Destroy(entity); });
+}
+
+template<typename T>
+void EcsCommands::Add(EntityId entity, T component)
+{
+	Record([entity, component](EcsWorld& world) mutable { world.Add<T>(entity, std::move(component)); });
+}
+
+template<typename T>
+void EcsCommands::Remove(EntityId entity)
+{
+	Record([entity](EcsWorld& world) { world.Remove<T>(entity); });
+}
+#endif
@@ -0,0 +1,196 @@
+#ifndef ECS_SCENE_H
+#define ECS_SCENE_H
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <vector>
+#include <learnopengl/camera.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/animation_system.h>
+#include <learnopengl/entity.h>
+#include <learnopengl/ecs.h>
+#include <learnopengl/transform_system.h>
+
+// Scene components and the systems that run over them, the EcsWorld counterpart of Entity.
+// A frame runs updateTransforms(), updateAnimations(), cullEntities() and
+// extractRenderItems() in that order, then draws the extracted items. Animation picks its
+// level of detail from the previous frame's culling, so culling can use this frame's poses.
+
+// the entity's node in the TransformSystem, which keeps the hierarchy
+struct TransformComponent
+{
+	TransformSystem::Handle handle = TransformSystem::Invalid;
+};
+
+// copy of the node's world matrix, refreshed when it changes
+struct WorldMatrix
+{
+	glm::mat4 value = glm::mat4(1.0f);
+};
+
+// model space box; animated entities get the box of their current pose
+struct LocalBounds
+{
+	glm::vec3 center = glm::vec3(0.0f);
+	glm::vec3 extents = glm::vec3(0.0f);
+};
+
+struct Visibility
+{
+	bool visible = true;
+	float projectedSize = 1.0f;	// see computeProjectedSize()
+};
+
+struct RenderModel
+{
+	Model* model = nullptr;
+};
+
+struct AnimatedModel
+{
+	AnimationSystem::InstanceId instance = 0;
+};
+
+// what the draw passes need of one visible entity
+struct RenderItem
+{
+	Model* model;
+	glm::mat4 world;
+	bool animated;
+	AnimationSystem::InstanceId instance;
+};
+
+// an entity drawing model under parent (TransformSystem::Invalid for a root), with the
+// model's bind pose box for culling
+inline EntityId createModelEntity(EcsWorld& world, TransformSystem& transforms, Model& model, TransformSystem::Handle parent = TransformSystem::Invalid)
+{
+	AABB box = generateAABB(model);
+	return world.Create(TransformComponent{ transforms.Create(parent) }, WorldMatrix(), LocalBounds{ box.center, box.extents },
+		Visibility(), RenderModel{ &model });
+}
+
+// destroys entity with its transform node and every entity below it in the hierarchy, whose
+// nodes go with the subtree and would otherwise be handed out again while still in use
+inline void destroyModelEntity(EcsWorld& world, TransformSystem& transforms, EntityId entity)
+{
+	if (TransformComponent* transform = world.Get<TransformComponent>(entity))
+	{
+		TransformSystem::Handle root = transform->handle;
+		std::vector<EntityId> descendants;
+		world.Each<TransformComponent>([&](EntityId id, TransformComponent& node)
+		{
+			for (TransformSystem::Handle h = transforms.GetParent(node.handle); h != TransformSystem::Invalid; h = transforms.GetParent(h))
+			{
+				if (h == root)
+				{
+					descendants.push_back(id);
+					break;
+				}
+			}
+		});
+		transforms.Destroy(root);
+		for (EntityId descendant : descendants)
+			world.Destroy(descendant);
+	}
+	world.Destroy(entity);
+}
+
+// plays animator on entity; bounds (Model::GetSkinnedBounds() of the animated model) let the
+// culling box follow the pose. Returns false when the animation system is full.
+inline bool attachAnimator(EcsWorld& world, EntityId entity, AnimationSystem& animations, Animator& animator, const SkinnedBounds* bounds)
+{
+	AnimationSystem::InstanceId instance = animations.Add(&animator);
+	if (instance == animations.GetMaxInstances())
+		return false;
+	animations.SetBounds(instance, bounds);
+	world.Add(entity, AnimatedModel{ instance });
+	return true;
+}
+
+// recomputes the world matrices that changed and copies them into WorldMatrix
+inline void updateTransforms(EcsWorld& world, TransformSystem& transforms, ThreadPool* pool = nullptr)
+{
+	transforms.Update();
+	auto copy = [&transforms](EntityId, TransformComponent& transform, WorldMatrix& matrix)
+	{
+		if (transforms.WasUpdated(transform.handle))
+			matrix.value = transforms.GetWorldMatrix(transform.handle);
+	};
+	if (pool)
+		world.ParallelEach<TransformComponent, WorldMatrix>(*pool, copy);
+	else
+		world.Each<TransformComponent, WorldMatrix>(copy);
+}
+
+// sets the level of detail of every animated entity from its visibility, evaluates the
+// poses and fits LocalBounds around them
+inline void updateAnimations(EcsWorld& world, AnimationSystem& animations, float dt)
+{
+	world.Each<AnimatedModel, Visibility>([&animations](EntityId, AnimatedModel& animated, Visibility& visibility)
+	{
+		animations.SetLod(animated.instance, visibility.projectedSize, visibility.visible);
+	});
+	animations.Update(dt);
+	world.Each<AnimatedModel, LocalBounds>([&animations](EntityId, AnimatedModel& animated, LocalBounds& bounds)
+	{
+		glm::vec3 min, max;
+		if (animations.GetBounds(animated.instance, min, max))
+		{
+			bounds.center = (min + max) * 0.5f;
+			bounds.extents = (max - min) * 0.5f;
+		}
+	});
+}
+
+// tests every box against the frustum and measures its size on screen
+inline void cullEntities(EcsWorld& world, const Frustum& frustum, const Camera& camera, float fovY, ThreadPool* pool = nullptr)
+{
+	auto cull = [&frustum, &camera, fovY](EntityId, WorldMatrix& matrix, LocalBounds& bounds, Visibility& visibility)
+	{
+		const glm::mat4& m = matrix.value;
+		const glm::vec3 center{ m * glm::vec4(bounds.center, 1.f) };
+		const glm::vec3 extents = glm::abs(glm::vec3(m[0])) * bounds.extents.x + glm::abs(glm::vec3(m[1])) * bounds.extents.y +
+			glm::abs(glm::vec3(m[2])) * bounds.extents.z;
+		const AABB box(center, extents.x, extents.y, extents.z);
+		visibility.visible = static_cast<const BoundingVolume&>(box).isOnFrustum(frustum);
+		visibility.projectedSize = computeProjectedSize(camera, fovY, center, glm::length(extents));
+	};
+	if (pool)
+		world.ParallelEach<WorldMatrix, LocalBounds, Visibility>(*pool, cull);
+	else
+		world.Each<WorldMatrix, LocalBounds, Visibility>(cull);
+}
+
+// the visible entities with a model, grouped by model so they can be drawn back to back
+inline void extractRenderItems(EcsWorld& world, std::vector<RenderItem>& items)
+{
+	items.clear();
+	world.EachChunk<WorldMatrix, RenderModel>([&items](EcsChunkView& view)
+	{
+		const WorldMatrix* matrices = view.Column<WorldMatrix>();
+		const RenderModel* models = view.Column<RenderModel>();
+		const Visibility* visibility = view.Column<Visibility>();
+		const AnimatedModel* animated = view.Column<AnimatedModel>();
+		for (uint32_t i = 0; i < view.GetCount(); i++)
+		{
+			if ((visibility && !visibility[i].visible) || !models[i].model)
+				continue;
+			items.push_back(RenderItem{ models[i].model, matrices[i].value, animated != nullptr, animated ? animated[i].instance : 0 });
+		}
+	});
+	std::stable_sort(items.begin(), items.end(), [](const RenderItem& a, const RenderItem& b) { return a.model < b.model; });
+}
+
+// draws items with shader; animated items select their palette, which needs
+// AnimationSystem::BindPalettes() on shader first
+inline void drawRenderItems(const std::vector<RenderItem>& items, Shader& shader, const AnimationSystem* animations = nullptr)
+{
+	for (const RenderItem& item : items)
+	{
+		shader.setMat4("model", item.world);
+		if (item.animated && animations)
+			animations->SetPalette(shader, item.instance);
+		item.model->Draw(shader);
+	}
+}
+#endif
@@ -5,6 +5,45 @@
 #include <list> //std::list
 #include <array> //std::array
 #include <memory> //std::unique_ptr
+#include <vector> //std::vector
+#include <functional> //std::function
+#include <algorithm> //std::sort
+#include <learnopengl/transform_system.h> //composeWorldMatrix
+
+class Entity;
+
+//Entities whose transform changed since the last update, filled by the Transform setters so
+//a frame only touches what moved. update() recomputes the dirty subtrees, shallowest first,
+//then hands every entity whose model matrix changed to the listeners (bounds, BVH refits,
+//instance buffers). A scene where nothing moved costs nothing.
+class SceneChanges
+{
+public:
+	void markDirty(Entity* entity)
+	{
+		m_dirty.push_back(entity);
+	}
+
+	//Called with the changed entities after every update that changed any
+	void addListener(std::function<void(const std::vector<Entity*>&)> listener)
+	{
+		m_listeners.push_back(std::move(listener));
+	}
+
+	void update();
+
+	//Entities whose model matrix the last update() recomputed
+	const std::vector<Entity*>& changed() const
+	{
+		return m_changed;
+	}
+
+private:
+	std::vector<Entity*> m_dirty;
+	std::vector<Entity*> m_changed;
+	std::vector<std::pair<int, Entity*>> m_sorted; //depth, entity
+	std::vector<std::function<void(const std::vector<Entity*>&)>> m_listeners;
+};
 
 class Transform
 {
@@ -20,18 +59,24 @@ protected:
 	//Dirty flag
 	bool m_isDirty = true;
 
+	//Where to report becoming dirty, null to only set the flag
+	SceneChanges* m_changes = nullptr;
+	Entity* m_owner = nullptr;
+
+	void markDirty()
+	{
+		if (!m_isDirty && m_changes)
+			m_changes->markDirty(m_owner);
+		m_isDirty = true;
+	}
+
 protected:
 	glm::mat4 getLocalModelMatrix()
 	{
-		const glm::mat4 transformX = glm::rotate(glm::mat4(1.0f), glm::radians(m_eulerRot.x), glm::vec3(1.0f, 0.0f, 0.0f));
-		const glm::mat4 transformY = glm::rotate(glm::mat4(1.0f), glm::radians(m_eulerRot.y), glm::vec3(0.0f, 1.0f, 0.0f));
-		const glm::mat4 transformZ = glm::rotate(glm::mat4(1.0f), glm::radians(m_eulerRot.z), glm::vec3(0.0f, 0.0f, 1.0f));
-
-		// Y * X * Z
-		const glm::mat4 rotationMatrix = transformY * transformX * transformZ;
-
-		// translation * rotation * scale (also know as TRS matrix)
-		return glm::translate(glm::mat4(1.0f), m_pos) * rotationMatrix * glm::scale(glm::mat4(1.0f), m_scale);
+		// translation * rotation (Y * X * Z) * scale (also know as TRS matrix), built from a quaternion
+		glm::mat4 local;
+		composeWorldMatrix(nullptr, m_pos, eulerToQuat(m_eulerRot), m_scale, local);
+		return local;
 	}
 public:
 
@@ -50,19 +95,19 @@ public:
 	void setLocalPosition(const glm::vec3& newPosition)
 	{
 		m_pos = newPosition;
-		m_isDirty = true;
+		markDirty();
 	}
 
 	void setLocalRotation(const glm::vec3& newRotation)
 	{
 		m_eulerRot = newRotation;
-		m_isDirty = true;
+		markDirty();
 	}
 
 	void setLocalScale(const glm::vec3& newScale)
 	{
 		m_scale = newScale;
-		m_isDirty = true;
+		markDirty();
 	}
 
 	const glm::vec3& getGlobalPosition() const
@@ -120,6 +165,15 @@ public:
 	{
 		return m_isDirty;
 	}
+
+	//Reports owner to changes whenever this transform becomes dirty
+	void setSceneChanges(SceneChanges* changes, Entity* owner)
+	{
+		m_changes = changes;
+		m_owner = owner;
+		if (m_isDirty && m_changes)
+			m_changes->markDirty(m_owner);
+	}
 };
 
 struct Plane
@@ -342,10 +396,20 @@ Frustum createFrustumFromCamera(const Camera& cam, float aspect, float fovY, flo
 	return frustum;
 }
 
+// Fraction of the viewport height covered by a sphere, 1 when the camera is inside it. The
+// size metric level of detail decisions are based on (see SelectAnimLod()).
+inline float computeProjectedSize(const Camera& cam, float fovY, const glm::vec3& center, float radius)
+{
+	const float distance = glm::length(center - cam.Position);
+	if (distance <= radius)
+		return 1.f;
+	return std::min(radius / (distance * tanf(fovY * .5f)), 1.f);
+}
+
 AABB generateAABB(const Model& model)
 {
 	glm::vec3 minAABB = glm::vec3(std::numeric_limits<float>::max());
-	glm::vec3 maxAABB = glm::vec3(std::numeric_limits<float>::min());
+	glm::vec3 maxAABB = glm::vec3(std::numeric_limits<float>::lowest());
 	for (auto&& mesh : model.meshes)
 	{
 		for (auto&& vertex : mesh.vertices)
@@ -365,7 +429,7 @@ AABB generateAABB(const Model& model)
 Sphere generateSphereBV(const Model& model)
 {
 	glm::vec3 minAABB = glm::vec3(std::numeric_limits<float>::max());
-	glm::vec3 maxAABB = glm::vec3(std::numeric_limits<float>::min());
+	glm::vec3 maxAABB = glm::vec3(std::numeric_limits<float>::lowest());
 	for (auto&& mesh : model.meshes)
 	{
 		for (auto&& vertex : mesh.vertices)
@@ -396,6 +460,9 @@ public:
 	Model* pModel = nullptr;
 	std::unique_ptr<AABB> boundingVolume;
 
+	//Change list transform changes are reported to, see setSceneChanges()
+	SceneChanges* changes = nullptr;
+
 
 	// constructor, expects a filepath to a 3D model.
 	Entity(Model& model) : pModel{ &model }
@@ -404,6 +471,12 @@ public:
 		//boundingVolume = std::make_unique<Sphere>(generateSphereBV(model));
 	}
 
+	//Replace the bind pose box by one around the current pose, e.g. from AnimationSystem::GetBounds()
+	void setAnimatedBounds(const glm::vec3& min, const glm::vec3& max)
+	{
+		*boundingVolume = AABB(min, max);
+	}
+
 	AABB getGlobalAABB()
 	{
 		//Get global scale thanks to our transform
@@ -435,6 +508,27 @@ public:
 	{
 		children.emplace_back(std::make_unique<Entity>(args...));
 		children.back()->parent = this;
+		if (changes)
+			children.back()->setSceneChanges(*changes);
+	}
+
+	//Report transform changes of this entity and its children to sceneChanges. The entity must not move in memory afterwards.
+	void setSceneChanges(SceneChanges& sceneChanges)
+	{
+		changes = &sceneChanges;
+		transform.setSceneChanges(changes, this);
+		for (auto&& child : children)
+		{
+			child->setSceneChanges(sceneChanges);
+		}
+	}
+
+	int getDepth() const
+	{
+		int depth = 0;
+		for (const Entity* ancestor = parent; ancestor; ancestor = ancestor->parent)
+			depth++;
+		return depth;
 	}
 
 	//Update transform if it was changed
@@ -451,17 +545,19 @@ public:
 		}
 	}
 
-	//Force update of transform even if local space don't change
-	void forceUpdateSelfAndChild()
+	//Force update of transform even if local space don't change, appending every updated entity to updated
+	void forceUpdateSelfAndChild(std::vector<Entity*>* updated = nullptr)
 	{
 		if (parent)
 			transform.computeModelMatrix(parent->transform.getModelMatrix());
 		else
 			transform.computeModelMatrix();
+		if (updated)
+			updated->push_back(this);
 
 		for (auto&& child : children)
 		{
-			child->forceUpdateSelfAndChild();
+			child->forceUpdateSelfAndChild(updated);
 		}
 	}
 
@@ -482,4 +578,28 @@ public:
 		}
 	}
 };
+
+inline void SceneChanges::update()
+{
+	m_changed.clear();
+	if (m_dirty.empty())
+		return;
+
+	//Parents first, so a dirty entity under a dirty ancestor is already done when its turn comes
+	m_sorted.clear();
+	for (Entity* entity : m_dirty)
+		m_sorted.emplace_back(entity->getDepth(), entity);
+	m_dirty.clear();
+	std::sort(m_sorted.begin(), m_sorted.end(), [](const std::pair<int, Entity*>& a, const std::pair<int, Entity*>& b) { return a.first < b.first; });
+	for (const auto& entry : m_sorted)
+	{
+		if (entry.second->transform.isDirty())
+			entry.second->forceUpdateSelfAndChild(&m_changed);
+	}
+
+	if (m_changed.empty())
+		return;
+	for (auto& listener : m_listeners)
+		listener(m_changed);
+}
 #endif
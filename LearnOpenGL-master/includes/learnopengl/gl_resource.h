@@ -0,0 +1,291 @@
+#ifndef GL_RESOURCE_H
+#define GL_RESOURCE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+// S3TC is an extension, the glad loader only carries the core enums
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+enum class GpuCategory { Geometry, Texture, Staging, Uniform, Other, Count };
+
+// Counts the bytes of every live buffer and texture by category. Objects are keyed by their
+// GL object type (GL_BUFFER, GL_TEXTURE) and name, so tracking the same object again just
+// replaces its size, which is what happens when a placeholder texture gets its real image.
+// The handles below untrack on destruction; raw objects have to be tracked by hand.
+class GpuMemoryTracker
+{
+public:
+    static GpuMemoryTracker& Instance()
+    {
+        static GpuMemoryTracker tracker;
+        return tracker;
+    }
+
+    void Track(GLenum objectType, unsigned int id, GpuCategory category, size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        Allocation& allocation = m_Allocations[Key(objectType, id)];
+        m_Bytes[(int)allocation.category] -= allocation.bytes;
+        allocation.category = category;
+        allocation.bytes = bytes;
+        m_Bytes[(int)category] += bytes;
+    }
+
+    void Untrack(GLenum objectType, unsigned int id)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto found = m_Allocations.find(Key(objectType, id));
+        if (found == m_Allocations.end())
+            return;
+        m_Bytes[(int)found->second.category] -= found->second.bytes;
+        m_Allocations.erase(found);
+    }
+
+    size_t GetBytes(GpuCategory category) const { return m_Bytes[(int)category]; }
+
+    // tracked size of one object, 0 if it isn't tracked
+    size_t GetObjectBytes(GLenum objectType, unsigned int id)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto found = m_Allocations.find(Key(objectType, id));
+        return found == m_Allocations.end() ? 0 : found->second.bytes;
+    }
+
+    size_t GetTotalBytes() const
+    {
+        size_t total = 0;
+        for (int i = 0; i < (int)GpuCategory::Count; i++)
+            total += m_Bytes[i];
+        return total;
+    }
+
+    static const char* GetCategoryName(GpuCategory category)
+    {
+        static const char* names[] = { "geometry", "texture", "staging", "uniform", "other" };
+        return names[(int)category];
+    }
+
+    // one line per category in MB
+    void Print(std::ostream& out) const
+    {
+        for (int i = 0; i < (int)GpuCategory::Count; i++)
+            out << GetCategoryName((GpuCategory)i) << ": " << m_Bytes[i] / (1024.0 * 1024.0) << " MB\n";
+        out << "total: " << GetTotalBytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+
+private:
+    struct Allocation
+    {
+        GpuCategory category = GpuCategory::Other;
+        size_t bytes = 0;
+    };
+
+    std::mutex m_Mutex;
+    std::unordered_map<uint64_t, Allocation> m_Allocations;
+    std::atomic<size_t> m_Bytes[(int)GpuCategory::Count] = {};
+
+    GpuMemoryTracker() = default;
+
+    static uint64_t Key(GLenum objectType, unsigned int id) { return ((uint64_t)objectType << 32) | id; }
+};
+
+// Move-only owner of one GL object name. Traits::Destroy releases the object, so a handle
+// going out of scope (or being assigned over) frees the GPU memory deterministically.
+template <typename Traits>
+class GLHandle
+{
+public:
+    GLHandle() = default;
+    // takes ownership of an existing object.
+    explicit GLHandle(unsigned int id) : m_ID(id) {}
+
+    GLHandle(const GLHandle&) = delete;
+    GLHandle& operator=(const GLHandle&) = delete;
+
+    GLHandle(GLHandle&& other) noexcept : m_ID(other.m_ID) { other.m_ID = 0; }
+
+    GLHandle& operator=(GLHandle&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            m_ID = other.m_ID;
+            other.m_ID = 0;
+        }
+        return *this;
+    }
+
+    ~GLHandle() { Reset(); }
+
+    unsigned int Get() const { return m_ID; }
+    explicit operator bool() const { return m_ID != 0; }
+
+    // gives up ownership without deleting the object; its tracking entry stays.
+    unsigned int Release()
+    {
+        unsigned int id = m_ID;
+        m_ID = 0;
+        return id;
+    }
+
+    void Reset()
+    {
+        if (m_ID != 0)
+            Traits::Destroy(m_ID);
+        m_ID = 0;
+    }
+
+private:
+    unsigned int m_ID = 0;
+};
+
+struct GLBufferTraits
+{
+    static void Destroy(unsigned int id)
+    {
+        GpuMemoryTracker::Instance().Untrack(GL_BUFFER, id);
+        glDeleteBuffers(1, &id);
+    }
+};
+
+struct GLTextureTraits
+{
+    static void Destroy(unsigned int id)
+    {
+        GpuMemoryTracker::Instance().Untrack(GL_TEXTURE, id);
+        glDeleteTextures(1, &id);
+    }
+};
+
+struct GLVertexArrayTraits
+{
+    static void Destroy(unsigned int id) { glDeleteVertexArrays(1, &id); }
+};
+
+struct GLProgramTraits
+{
+    static void Destroy(unsigned int id) { glDeleteProgram(id); }
+};
+
+using GLBuffer = GLHandle<GLBufferTraits>;
+using GLTexture = GLHandle<GLTextureTraits>;
+using GLVertexArray = GLHandle<GLVertexArrayTraits>;
+using GLProgram = GLHandle<GLProgramTraits>;
+
+// Creates a buffer with immutable storage (GL 4.4) and fills it with data, which may be null.
+// storageFlags are glBufferStorage flags; on older contexts the buffer falls back to
+// glBufferData with a usage hint derived from them. Leaves target unbound.
+inline GLBuffer CreateBuffer(GLenum target, size_t size, const void* data, GpuCategory category, GLbitfield storageFlags = 0)
+{
+    unsigned int id;
+    glGenBuffers(1, &id);
+    glBindBuffer(target, id);
+    if (GLAD_GL_VERSION_4_4)
+        glBufferStorage(target, size, data, storageFlags);
+    else
+        glBufferData(target, size, data, (storageFlags & (GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT)) ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+    glBindBuffer(target, 0);
+    GpuMemoryTracker::Instance().Track(GL_BUFFER, id, category, size);
+    return GLBuffer(id);
+}
+
+inline bool IsCompressedFormat(GLenum internalFormat)
+{
+    return internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ||
+           internalFormat == GL_COMPRESSED_RED_RGTC1 || internalFormat == GL_COMPRESSED_RG_RGTC2;
+}
+
+// approximate video memory of one level; 3 channel formats are padded to 4 by drivers.
+inline size_t TextureLevelBytes(GLenum internalFormat, int width, int height)
+{
+    if (IsCompressedFormat(internalFormat))
+    {
+        size_t blockBytes = (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RED_RGTC1) ? 8 : 16;
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+    }
+    size_t texelBytes = 4;
+    switch (internalFormat)
+    {
+    case GL_R8: case GL_RED: texelBytes = 1; break;
+    case GL_RG8: case GL_RG: case GL_R16F: texelBytes = 2; break;
+    case GL_RGBA16F: case GL_RGB16F: case GL_RG32F: texelBytes = 8; break;
+    case GL_RGBA32F: case GL_RGB32F: texelBytes = 16; break;
+    default: break;
+    }
+    return (size_t)width * height * texelBytes;
+}
+
+inline size_t TextureBytes(GLenum internalFormat, int width, int height, int levels)
+{
+    size_t bytes = 0;
+    for (int i = 0; i < levels; i++)
+    {
+        bytes += TextureLevelBytes(internalFormat, width, height);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return bytes;
+}
+
+// Creates a 2D texture with immutable storage (GL 4.2) for levels mip levels; fill it with
+// glTexSubImage2D / glCompressedTexSubImage2D. internalFormat must be a sized format.
+// Leaves the texture bound to GL_TEXTURE_2D.
+inline GLTexture CreateTexture2D(int levels, GLenum internalFormat, int width, int height, GpuCategory category = GpuCategory::Texture)
+{
+    unsigned int id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+    if (GLAD_GL_VERSION_4_2)
+        glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, width, height);
+    else
+    {
+        // mutable storage with every level allocated behaves the same for sub image uploads
+        int levelWidth = width, levelHeight = height;
+        for (int i = 0; i < levels; i++)
+        {
+            if (IsCompressedFormat(internalFormat))
+                glCompressedTexImage2D(GL_TEXTURE_2D, i, internalFormat, levelWidth, levelHeight, 0,
+                    (GLsizei)TextureLevelBytes(internalFormat, levelWidth, levelHeight), NULL);
+            else
+                glTexImage2D(GL_TEXTURE_2D, i, internalFormat, levelWidth, levelHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            levelWidth = std::max(1, levelWidth / 2);
+            levelHeight = std::max(1, levelHeight / 2);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    }
+    GpuMemoryTracker::Instance().Track(GL_TEXTURE, id, category, TextureBytes(internalFormat, width, height, levels));
+    return GLTexture(id);
+}
+
+inline GLVertexArray CreateVertexArray()
+{
+    unsigned int id;
+    glGenVertexArrays(1, &id);
+    return GLVertexArray(id);
+}
+
+// number of levels of a full mip chain
+inline int MipLevelCount(int width, int height)
+{
+    int levels = 1;
+    while (width > 1 || height > 1)
+    {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        levels++;
+    }
+    return levels;
+}
+#endif
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+#include <learnopengl/animation_system.h>
+#include <learnopengl/gl_resource.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader.h>
+#include <learnopengl/shader_c.h>
+
+// Skins characters once per frame with a compute shader (1.skinning.cs) into vertex buffers
+// of their own, which the main, depth prepass, shadow and picking passes then draw as static
+// geometry (1.pre_skinned.vs). The vertex shaders stop blending bones, so the skinning cost
+// no longer grows with the number of passes a character is drawn in.
+// Every skinned mesh gets an output buffer with position and normal per vertex and a vertex
+// array that reads those next to the texture coordinates and tangents (bind pose) of the
+// mesh's own buffer, over the mesh's index buffer. Palettes come from an AnimationSystem in
+// any PaletteFormat.
+// Needs GL 4.3 (compute shaders and storage buffers); without it IsSupported() is false,
+// nothing is dispatched and characters keep being skinned in 1.model_loading.vs.
+class GpuSkinning
+{
+public:
+	typedef unsigned int SkinId;
+
+	// storage buffer bindings of 1.skinning.cs
+	static const GLuint PaletteBinding = 0;
+	static const GLuint VertexBinding = 1;
+	static const GLuint SkinnedBinding = 2;
+	static const unsigned int GroupSize = 64;	// local_size_x
+
+	GpuSkinning(ComputeShader& shader, AnimationSystem& animations)
+		: m_Shader(shader), m_Animations(animations)
+	{
+		if (!IsSupported())
+			return;
+		// the shader reads the Vertex structs of the mesh buffers as plain floats
+		m_Shader.use();
+		m_Shader.setInt("vertexStride", (int)(sizeof(Vertex) / sizeof(float)));
+		m_Shader.setInt("normalOffset", (int)(offsetof(Vertex, Normal) / sizeof(float)));
+		m_Shader.setInt("boneIdOffset", (int)(offsetof(Vertex, m_BoneIDs) / sizeof(float)));
+		m_Shader.setInt("weightOffset", (int)(offsetof(Vertex, m_Weights) / sizeof(float)));
+	}
+
+	GpuSkinning(const GpuSkinning&) = delete;
+	GpuSkinning& operator=(const GpuSkinning&) = delete;
+
+	static bool IsSupported() { return GLAD_GL_VERSION_4_3 != 0; }
+
+	// skins model with the palette of instance from now on; both stay owned by the caller.
+	// Output buffers are created on the first Dispatch() that finds the meshes uploaded.
+	SkinId Add(Model& model, AnimationSystem::InstanceId instance)
+	{
+		SkinId id;
+		if (!m_FreeSlots.empty())
+		{
+			id = m_FreeSlots.back();
+			m_FreeSlots.pop_back();
+		}
+		else
+		{
+			id = (SkinId)m_Skins.size();
+			m_Skins.emplace_back();
+		}
+		Skin& skin = m_Skins[id];
+		skin.model = &model;
+		skin.instance = instance;
+		skin.visible = true;
+		skin.meshes.clear();
+		skin.meshes.resize(model.meshes.size());
+		return id;
+	}
+
+	void Remove(SkinId id)
+	{
+		m_Skins[id].model = nullptr;
+		m_Skins[id].meshes.clear();
+		m_FreeSlots.push_back(id);
+	}
+
+	// only visible characters are skinned, hidden ones keep their last skinned vertices
+	void SetVisible(SkinId id, bool visible) { m_Skins[id].visible = visible; }
+
+	// skins every visible character. Call once per frame, after AnimationSystem::Update()
+	// and before the first pass that draws them.
+	void Dispatch()
+	{
+		m_SkinnedVertices = 0;
+		if (!IsSupported())
+			return;
+
+		m_Shader.use();
+		m_Shader.setInt("paletteFormat", (int)m_Animations.GetPaletteFormat());
+		m_Shader.setInt("paletteBones", m_Animations.GetMaxBones());
+		m_Animations.BindPaletteStorage(PaletteBinding);
+		for (Skin& skin : m_Skins)
+		{
+			if (!skin.model)
+				continue;
+			m_Shader.setInt("paletteOffset", (int)m_Animations.GetPaletteOffset(skin.instance));
+			for (size_t i = 0; i < skin.meshes.size(); i++)
+			{
+				Mesh& mesh = skin.model->meshes[i];
+				SkinnedMesh& skinned = skin.meshes[i];
+				// a vertex array built for an earlier upload keeps its released buffers alive
+				bool uploaded = mesh.GetVertexBuffer() != 0;
+				if (skinned.generation && (!uploaded || skinned.generation != mesh.GetUploadGeneration()))
+					ReleaseOutput(skinned);
+				if (!uploaded || !skin.visible)
+					continue;
+				if (!skinned.generation)
+					CreateOutput(mesh, skinned);
+
+				unsigned int vertexCount = (unsigned int)mesh.vertices.size();
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VertexBinding, mesh.GetVertexBuffer());
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SkinnedBinding, skinned.buffer.Get());
+				m_Shader.setInt("vertexCount", (int)vertexCount);
+				glDispatchCompute((vertexCount + GroupSize - 1) / GroupSize, 1, 1);
+				m_SkinnedVertices += vertexCount;
+			}
+		}
+		// the passes read the results as vertex attributes
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+	}
+
+	// draws id's skinned meshes with shader, which reads them as static geometry; the caller
+	// sets the model matrix and whatever else the pass needs
+	void Draw(SkinId id, Shader& shader)
+	{
+		Skin& skin = m_Skins[id];
+		for (size_t i = 0; i < skin.meshes.size(); i++)
+		{
+			const Mesh& mesh = skin.model->meshes[i];
+			if (skin.meshes[i].generation && skin.meshes[i].generation == mesh.GetUploadGeneration() && mesh.GetVertexBuffer())
+				skin.model->meshes[i].DrawVertexArray(shader, skin.meshes[i].vertexArray.Get());
+		}
+	}
+
+	// vertices skinned by the last Dispatch()
+	unsigned int GetSkinnedVertexCount() const { return m_SkinnedVertices; }
+
+	size_t GetGpuBytes() const
+	{
+		size_t bytes = 0;
+		for (const Skin& skin : m_Skins)
+		{
+			for (const SkinnedMesh& skinned : skin.meshes)
+				bytes += skinned.bytes;
+		}
+		return bytes;
+	}
+
+private:
+	static const int FloatsPerVertex = 6;	// position, normal
+
+	struct SkinnedMesh
+	{
+		GLBuffer buffer;
+		GLVertexArray vertexArray;
+		unsigned int generation = 0;	// the mesh upload vertexArray was built for, 0 for none
+		size_t bytes = 0;
+	};
+
+	struct Skin
+	{
+		Model* model = nullptr;
+		AnimationSystem::InstanceId instance = 0;
+		bool visible = true;
+		std::vector<SkinnedMesh> meshes;	// parallel to model->meshes
+	};
+
+	ComputeShader& m_Shader;
+	AnimationSystem& m_Animations;
+	std::vector<Skin> m_Skins;
+	std::vector<SkinId> m_FreeSlots;
+	unsigned int m_SkinnedVertices = 0;
+
+	// (re)builds the output of mesh, also after a residency manager uploaded it again
+	void CreateOutput(Mesh& mesh, SkinnedMesh& skinned)
+	{
+		GLsizei stride = FloatsPerVertex * sizeof(float);
+		skinned.bytes = mesh.vertices.size() * stride;
+		if (!skinned.buffer)
+			skinned.buffer = CreateBuffer(GL_ARRAY_BUFFER, skinned.bytes, NULL, GpuCategory::Geometry);
+		skinned.generation = mesh.GetUploadGeneration();
+
+		skinned.vertexArray = ::CreateVertexArray();
+		glBindVertexArray(skinned.vertexArray.Get());
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.GetIndexBuffer());
+
+		// skinned positions and normals
+		glBindBuffer(GL_ARRAY_BUFFER, skinned.buffer.Get());
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+
+		// the rest comes from the mesh, bone ids and weights aren't needed any more
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.GetVertexBuffer());
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	static void ReleaseOutput(SkinnedMesh& skinned)
+	{
+		skinned.vertexArray.Reset();
+		skinned.buffer.Reset();
+		skinned.bytes = 0;
+		skinned.generation = 0;
+	}
+};
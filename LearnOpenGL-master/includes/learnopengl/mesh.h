@@ -7,6 +7,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <learnopengl/gl_resource.h>
 
 #include <string>
 #include <vector>
@@ -43,21 +44,31 @@ public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    GLVertexArray VAO;
 
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    // with upload = false no GL calls are made; UploadBuffers() and CreateVertexArray() must be called later.
+    // meshes own their GL objects, so they can be moved but not copied.
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, bool upload = true)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        if (upload)
+            setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader &shader) 
+    // render the mesh, instanceCount times with instanced rendering
+    void Draw(Shader &shader, unsigned int instanceCount = 1)
+    {
+        DrawVertexArray(shader, VAO.Get(), instanceCount);
+    }
+
+    // same with another vertex array over this mesh's index buffer, e.g. one that reads
+    // positions skinned by GpuSkinning
+    void DrawVertexArray(Shader &shader, unsigned int vertexArray, unsigned int instanceCount = 1)
     {
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
@@ -86,36 +97,60 @@ public:
         }
         
         // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        if (!vertexArray)
+            return;
+        glBindVertexArray(vertexArray);
+        if (instanceCount == 1)
+            glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        else
+            glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0, instanceCount);
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh()
+    // creates and fills the vertex and index buffers. Buffers are shared between contexts,
+    // so this may run on a background upload context.
+    void UploadBuffers()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
         // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+        VBO = ::CreateBuffer(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GpuCategory::Geometry);
+
+        // the element array binding belongs to the bound VAO, so fill the index buffer through a neutral target
+        EBO = ::CreateBuffer(GL_COPY_WRITE_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GpuCategory::Geometry);
+        uploadGeneration++;
+    }
+
+    // frees the GL objects, the vertex data stays so the mesh can be uploaded again.
+    void ReleaseBuffers()
+    {
+        VAO.Reset();
+        VBO.Reset();
+        EBO.Reset();
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    // 0 while the buffers aren't uploaded
+    unsigned int GetVertexBuffer() const { return VBO.Get(); }
+    unsigned int GetIndexBuffer() const { return EBO.Get(); }
+    // changes with every UploadBuffers(), GL names are reused and can't tell uploads apart
+    unsigned int GetUploadGeneration() const { return uploadGeneration; }
+
+    size_t GetGpuBytes() const
+    {
+        return VBO ? vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int) : 0;
+    }
+
+    // vertex array objects are not shared between contexts, this has to run on the context that draws the mesh.
+    void CreateVertexArray()
+    {
+        VAO = ::CreateVertexArray();
+        glBindVertexArray(VAO.Get());
+        glBindBuffer(GL_ARRAY_BUFFER, VBO.Get());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO.Get());
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -142,5 +177,17 @@ private:
 		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
         glBindVertexArray(0);
     }
+
+private:
+    // render data 
+    GLBuffer VBO, EBO;
+    unsigned int uploadGeneration = 0;
+
+    // initializes all the buffer objects/arrays
+    void setupMesh()
+    {
+        UploadBuffers();
+        CreateVertexArray();
+    }
 };
 #endif
@@ -0,0 +1,382 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <learnopengl/simd.h>
+
+enum class MipFilter { Box, Kaiser, Lanczos };
+
+// what the texels of an image hold, decides how its mips are filtered and how it is compressed
+enum class TextureUsage
+{
+    Linear,      // data such as specular, height or single channel maps
+    Color,       // sRGB encoded colors
+    NormalMap,   // unit vectors in rgb
+    AlphaTested  // sRGB colors whose alpha is tested against MipSettings::alphaTestCutoff
+};
+
+// usage of a material texture from its type name in Model ("texture_diffuse", ...). Diffuse
+// maps are alpha tested, 1.model_loading.fs discards below its alphaCutoff.
+inline TextureUsage TextureUsageFromType(const std::string& typeName)
+{
+    if (typeName == "texture_diffuse")
+        return TextureUsage::AlphaTested;
+    if (typeName == "texture_normal")
+        return TextureUsage::NormalMap;
+    return TextureUsage::Linear;
+}
+
+struct MipSettings
+{
+    MipFilter filter = MipFilter::Kaiser;
+    bool srgb = false;           // average colors in linear space, the alpha channel is always linear
+    bool normalMap = false;      // treat rgb as a unit vector: no srgb, renormalized after filtering
+    bool wrap = true;            // the filter wraps around the edges like GL_REPEAT, otherwise it clamps
+    float alphaCutoff = -1.0f;   // >= 0 keeps the fraction of texels passing this alpha test constant over the chain
+    float alphaTestCutoff = 0.5f; // the alpha test of AlphaTested textures, keep it equal to the shader's
+
+    // these settings with srgb, normalMap and alphaCutoff set for usage
+    MipSettings ForUsage(TextureUsage usage) const
+    {
+        MipSettings settings = *this;
+        settings.srgb = usage == TextureUsage::Color || usage == TextureUsage::AlphaTested;
+        settings.normalMap = usage == TextureUsage::NormalMap;
+        settings.alphaCutoff = usage == TextureUsage::AlphaTested ? alphaTestCutoff : -1.0f;
+        return settings;
+    }
+};
+
+// all levels of an image, back to back in one buffer with the source's channel count
+struct MipChain
+{
+    struct Level
+    {
+        int width, height;
+        size_t offset, size;
+    };
+
+    int channels = 0;
+    std::vector<Level> levels;
+    std::vector<unsigned char> data;
+};
+
+// Builds mip chains on the CPU so the GL thread never has to call glGenerateMipmap. Each
+// level is resampled from the one above with a separable filter whose weights are
+// computed for the exact size ratio, so odd (non power of two) sizes are handled without
+// dropping rows or columns. Pixels are filtered as four floats at a time with SSE2.
+// Generate() is thread-safe and meant to run on loader threads.
+class MipGenerator
+{
+public:
+    static MipChain Generate(const unsigned char* pixels, int width, int height, int channels, const MipSettings& settings)
+    {
+        MipChain chain;
+        chain.channels = channels;
+
+        // level 0 is the source itself
+        AppendLevel(chain, width, height);
+        std::memcpy(chain.data.data(), pixels, chain.levels[0].size);
+
+        bool srgb = settings.srgb && !settings.normalMap;
+        bool hasAlpha = channels == 2 || channels == 4;
+        bool preserveCoverage = hasAlpha && settings.alphaCutoff >= 0.0f;
+
+        std::vector<float> current = ToFloat(pixels, (size_t)width * height, channels, srgb);
+        float coverage = preserveCoverage ? AlphaCoverage(current, settings.alphaCutoff, 1.0f) : 0.0f;
+
+        while (width > 1 || height > 1)
+        {
+            int nextWidth = std::max(1, width / 2), nextHeight = std::max(1, height / 2);
+            current = Resample(current, width, height, nextWidth, nextHeight, settings.filter, settings.wrap);
+            width = nextWidth;
+            height = nextHeight;
+
+            if (settings.normalMap)
+                Renormalize(current);
+            float alphaScale = preserveCoverage ? FindAlphaScale(current, settings.alphaCutoff, coverage) : 1.0f;
+
+            AppendLevel(chain, width, height);
+            const MipChain::Level& level = chain.levels.back();
+            ToBytes(current, channels, srgb, alphaScale, chain.data.data() + level.offset);
+        }
+        return chain;
+    }
+
+private:
+    static void AppendLevel(MipChain& chain, int width, int height)
+    {
+        MipChain::Level level;
+        level.width = width;
+        level.height = height;
+        level.offset = chain.data.size();
+        level.size = (size_t)width * height * chain.channels;
+        chain.levels.push_back(level);
+        chain.data.resize(level.offset + level.size);
+    }
+
+    // -- conversions --------------------------------------------------------------------
+
+    static const float* SrgbToLinearTable()
+    {
+        static const std::vector<float> table = []
+        {
+            std::vector<float> values(256);
+            for (int i = 0; i < 256; i++)
+            {
+                float c = i / 255.0f;
+                values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    // 16 bit index keeps the darkest values exact after rounding to 8 bits
+    static const unsigned char* LinearToSrgbTable()
+    {
+        static const std::vector<unsigned char> table = []
+        {
+            std::vector<unsigned char> values(65536);
+            for (int i = 0; i < 65536; i++)
+            {
+                float c = i / 65535.0f;
+                float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+                values[i] = (unsigned char)std::min(255.0f, s * 255.0f + 0.5f);
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    // expands to rgba floats; gray images repeat the gray value into rgb
+    static std::vector<float> ToFloat(const unsigned char* pixels, size_t count, int channels, bool srgb)
+    {
+        const float* toLinear = SrgbToLinearTable();
+        std::vector<float> out(count * 4);
+        for (size_t i = 0; i < count; i++)
+        {
+            const unsigned char* p = pixels + i * channels;
+            unsigned char r = p[0];
+            unsigned char g = channels >= 3 ? p[1] : p[0];
+            unsigned char b = channels >= 3 ? p[2] : p[0];
+            unsigned char a = channels == 4 ? p[3] : (channels == 2 ? p[1] : 255);
+            out[i * 4 + 0] = srgb ? toLinear[r] : r / 255.0f;
+            out[i * 4 + 1] = srgb ? toLinear[g] : g / 255.0f;
+            out[i * 4 + 2] = srgb ? toLinear[b] : b / 255.0f;
+            out[i * 4 + 3] = a / 255.0f;
+        }
+        return out;
+    }
+
+    static unsigned char ToUnorm(float value)
+    {
+        return (unsigned char)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    static void ToBytes(const std::vector<float>& pixels, int channels, bool srgb, float alphaScale, unsigned char* out)
+    {
+        const unsigned char* toSrgb = LinearToSrgbTable();
+        size_t count = pixels.size() / 4;
+        for (size_t i = 0; i < count; i++)
+        {
+            const float* p = &pixels[i * 4];
+            unsigned char rgb[3];
+            for (int c = 0; c < 3; c++)
+                rgb[c] = srgb ? toSrgb[(int)(std::min(std::max(p[c], 0.0f), 1.0f) * 65535.0f + 0.5f)] : ToUnorm(p[c]);
+            unsigned char a = ToUnorm(p[3] * alphaScale);
+
+            unsigned char* o = out + i * channels;
+            switch (channels)
+            {
+            case 1: o[0] = rgb[0]; break;
+            case 2: o[0] = rgb[0]; o[1] = a; break;
+            case 3: o[0] = rgb[0]; o[1] = rgb[1]; o[2] = rgb[2]; break;
+            default: o[0] = rgb[0]; o[1] = rgb[1]; o[2] = rgb[2]; o[3] = a; break;
+            }
+        }
+    }
+
+    static void Renormalize(std::vector<float>& pixels)
+    {
+        for (size_t i = 0; i < pixels.size(); i += 4)
+        {
+            float x = pixels[i] * 2.0f - 1.0f, y = pixels[i + 1] * 2.0f - 1.0f, z = pixels[i + 2] * 2.0f - 1.0f;
+            float length = std::sqrt(x * x + y * y + z * z);
+            if (length > 0.0f)
+            {
+                pixels[i] = (x / length) * 0.5f + 0.5f;
+                pixels[i + 1] = (y / length) * 0.5f + 0.5f;
+                pixels[i + 2] = (z / length) * 0.5f + 0.5f;
+            }
+        }
+    }
+
+    // -- alpha coverage -----------------------------------------------------------------
+
+    static float AlphaCoverage(const std::vector<float>& pixels, float cutoff, float scale)
+    {
+        size_t passed = 0, count = pixels.size() / 4;
+        for (size_t i = 0; i < count; i++)
+            passed += pixels[i * 4 + 3] * scale >= cutoff;
+        return count ? (float)passed / count : 0.0f;
+    }
+
+    // coverage grows with the scale, so a bisection finds the scale matching the top level
+    static float FindAlphaScale(const std::vector<float>& pixels, float cutoff, float targetCoverage)
+    {
+        // e.g. fully opaque levels, any scale above the cutoff would do
+        if (AlphaCoverage(pixels, cutoff, 1.0f) == targetCoverage)
+            return 1.0f;
+        float low = 0.0f, high = 4.0f;
+        for (int i = 0; i < 12; i++)
+        {
+            float mid = (low + high) * 0.5f;
+            if (AlphaCoverage(pixels, cutoff, mid) < targetCoverage)
+                low = mid;
+            else
+                high = mid;
+        }
+        return high;
+    }
+
+    // -- resampling ---------------------------------------------------------------------
+
+    static float Sinc(float x)
+    {
+        if (std::abs(x) < 1e-5f)
+            return 1.0f;
+        x *= 3.14159265f;
+        return std::sin(x) / x;
+    }
+
+    static float BesselI0(float x)
+    {
+        float sum = 1.0f, term = 1.0f;
+        for (int k = 1; k < 20; k++)
+        {
+            term *= (x * 0.5f / k) * (x * 0.5f / k);
+            sum += term;
+        }
+        return sum;
+    }
+
+    static float FilterRadius(MipFilter filter)
+    {
+        return filter == MipFilter::Box ? 0.5f : 3.0f;
+    }
+
+    static float FilterWeight(MipFilter filter, float t)
+    {
+        const float radius = FilterRadius(filter);
+        t = std::abs(t);
+        if (t >= radius)
+            return 0.0f;
+        switch (filter)
+        {
+        case MipFilter::Box:
+            return 1.0f;
+        case MipFilter::Lanczos:
+            return Sinc(t) * Sinc(t / radius);
+        default:
+        {
+            // kaiser windowed sinc, alpha 4
+            const float alpha = 4.0f;
+            float ratio = t / radius;
+            return Sinc(t) * BesselI0(alpha * std::sqrt(1.0f - ratio * ratio)) / BesselI0(alpha);
+        }
+        }
+    }
+
+    // taps of every destination texel along one axis, weights normalized to one
+    struct Taps
+    {
+        std::vector<int> first;       // dstSize + 1 offsets into index/weight
+        std::vector<int> index;
+        std::vector<float> weight;
+    };
+
+    static Taps ComputeTaps(int srcSize, int dstSize, MipFilter filter, bool wrap)
+    {
+        Taps taps;
+        float scale = (float)srcSize / dstSize;
+        float support = FilterRadius(filter) * scale;
+        taps.first.push_back(0);
+        for (int x = 0; x < dstSize; x++)
+        {
+            float center = (x + 0.5f) * scale;
+            int begin = (int)std::floor(center - support);
+            int end = (int)std::ceil(center + support);
+            float total = 0.0f;
+            size_t firstTap = taps.weight.size();
+            for (int s = begin; s <= end; s++)
+            {
+                float w = FilterWeight(filter, (s + 0.5f - center) / scale);
+                if (w == 0.0f)
+                    continue;
+                taps.index.push_back(wrap ? ((s % srcSize) + srcSize) % srcSize : std::min(std::max(s, 0), srcSize - 1));
+                taps.weight.push_back(w);
+                total += w;
+            }
+            for (size_t i = firstTap; i < taps.weight.size(); i++)
+                taps.weight[i] /= total;
+            taps.first.push_back((int)taps.weight.size());
+        }
+        return taps;
+    }
+
+    // dst += src * weight over count floats
+    static void MulAdd(float* dst, const float* src, float weight, size_t count)
+    {
+        size_t i = 0;
+#ifdef SIMD_SSE2
+        __m128 w = _mm_set1_ps(weight);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), w)));
+#endif
+        for (; i < count; i++)
+            dst[i] += src[i] * weight;
+    }
+
+    static std::vector<float> Resample(const std::vector<float>& src, int srcWidth, int srcHeight, int dstWidth, int dstHeight, MipFilter filter, bool wrap)
+    {
+        Taps horizontal = ComputeTaps(srcWidth, dstWidth, filter, wrap);
+        Taps vertical = ComputeTaps(srcHeight, dstHeight, filter, wrap);
+
+        // horizontal pass, one rgba pixel per register
+        std::vector<float> rows((size_t)dstWidth * srcHeight * 4, 0.0f);
+        for (int y = 0; y < srcHeight; y++)
+        {
+            const float* srcRow = &src[(size_t)y * srcWidth * 4];
+            float* dstRow = &rows[(size_t)y * dstWidth * 4];
+            for (int x = 0; x < dstWidth; x++)
+            {
+#ifdef SIMD_SSE2
+                __m128 sum = _mm_setzero_ps();
+                for (int t = horizontal.first[x]; t < horizontal.first[x + 1]; t++)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(srcRow + horizontal.index[t] * 4), _mm_set1_ps(horizontal.weight[t])));
+                _mm_storeu_ps(dstRow + x * 4, sum);
+#else
+                for (int t = horizontal.first[x]; t < horizontal.first[x + 1]; t++)
+                    for (int c = 0; c < 4; c++)
+                        dstRow[x * 4 + c] += srcRow[horizontal.index[t] * 4 + c] * horizontal.weight[t];
+#endif
+            }
+        }
+
+        // vertical pass, whole rows at a time
+        std::vector<float> dst((size_t)dstWidth * dstHeight * 4, 0.0f);
+        size_t rowFloats = (size_t)dstWidth * 4;
+        for (int y = 0; y < dstHeight; y++)
+        {
+            for (int t = vertical.first[y]; t < vertical.first[y + 1]; t++)
+                MulAdd(&dst[y * rowFloats], &rows[vertical.index[t] * rowFloats], vertical.weight[t], rowFloats);
+        }
+        return dst;
+    }
+};
+#endif
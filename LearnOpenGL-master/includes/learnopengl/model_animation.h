@@ -12,15 +12,20 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
+#include <learnopengl/texture_streamer.h>
+#include <learnopengl/texture_cache.h>
+#include <learnopengl/residency.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <learnopengl/assimp_glm_helpers.h>
 #include <learnopengl/animdata.h>
+#include <learnopengl/skinned_bounds.h>
 
 using namespace std;
 
@@ -29,33 +34,150 @@ class Model
 public:
     // model data 
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<TextureHandle> textureHandles;	// references into the process wide TextureCache, released with the model
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    TextureStreamer* textureStreamer;	// optional, decodes and uploads textures in the background when set
+    bool deferUpload;	// import only, GL objects are created by UploadTextures/UploadBuffers/CreateVertexArrays
 	
 	
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // with a streamer the textures start out as placeholders and are filled in by streamer->Update().
+    // with defer = true no GL calls are made, so the model can be imported on a worker thread.
+    Model(string const &path, bool gamma = false, TextureStreamer* streamer = nullptr, bool defer = false)
+        : gammaCorrection(gamma), textureStreamer(streamer), deferUpload(defer)
     {
         loadModel(path);
     }
 
+    ~Model()
+    {
+        if(!residency)
+            return;
+        for(ResidencyManager::ResourceId id : meshResidency)
+            residency->Unregister(id);
+        for(const auto& texture : textureResidency)
+            residency->Unregister(texture.second);
+    }
+
     // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // (instanceCount times with instanced rendering)
+    void Draw(Shader &shader, unsigned int instanceCount = 1)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        {
+            if(residency)
+                TouchMesh(i);
+            meshes[i].Draw(shader, instanceCount);
+        }
+    }
+
+    // hands the model's meshes and textures to a residency manager, which may evict them
+    // when they haven't been drawn for a while; Draw() brings them back. Textures can only
+    // be evicted or trimmed when they were loaded through a streamer. Call after the model
+    // is fully uploaded, on the GL thread.
+    void EnableResidency(ResidencyManager& manager)
+    {
+        residency = &manager;
+        for(Mesh& mesh : meshes)
+        {
+            Mesh* target = &mesh;
+            ResidencyCallbacks callbacks;
+            callbacks.bytes = [target]() { return target->GetGpuBytes(); };
+            callbacks.load = [target]() { target->UploadBuffers(); target->CreateVertexArray(); };
+            callbacks.evict = [target]() { target->ReleaseBuffers(); };
+            meshResidency.push_back(manager.Register(reinterpret_cast<uintptr_t>(target), callbacks));
+        }
+
+        if(!textureStreamer)
+            return;
+        for(const Texture& texture : textures_loaded)
+        {
+            TextureStreamer* streamer = textureStreamer;
+            unsigned int id = texture.id;
+            string filename = this->directory + '/' + texture.path;
+            TextureUsage usage = TextureUsageFromType(texture.type);
+
+            ResidencyCallbacks callbacks;
+            callbacks.bytes = [id]() { return GpuMemoryTracker::Instance().GetObjectBytes(GL_TEXTURE, id); };
+            // a reload that is still in flight already brings back the full chain
+            callbacks.load = [=]() { if(!streamer->IsReloading(id)) streamer->Reload(id, filename, usage); };
+            callbacks.evict = [=]() { streamer->Evict(id); };
+            // drops the largest remaining level, about three quarters of the texture
+            callbacks.trim = [=]() { return streamer->Trim(id); };
+            // textures shared through the TextureCache are registered once
+            textureResidency[id] = manager.Register(((uint64_t)GL_TEXTURE << 32) | id, callbacks);
+        }
+    }
+
+    // deferred loading, step 1: creates the textures that were skipped during import.
+    // textures are shared objects, this may run on a background upload context.
+    void UploadTextures()
+    {
+        for(Texture& texture : textures_loaded)
+        {
+            if(texture.id == 0)
+                texture.id = LoadTexture(texture.path, texture.type);
+        }
+        // the meshes hold copies of the texture structs, patch in the new ids
+        for(Mesh& mesh : meshes)
+        {
+            for(Texture& texture : mesh.textures)
+            {
+                for(const Texture& loaded : textures_loaded)
+                {
+                    if(loaded.path == texture.path)
+                    {
+                        texture.id = loaded.id;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // deferred loading, step 2: vertex and index buffers, may also run on a background upload context.
+    void UploadBuffers()
+    {
+        for(Mesh& mesh : meshes)
+            mesh.UploadBuffers();
+    }
+
+    // deferred loading, step 3: vertex array objects, must run on the context that draws the model.
+    void CreateVertexArrays()
+    {
+        for(Mesh& mesh : meshes)
+            mesh.CreateVertexArray();
     }
     
 	auto& GetBoneInfoMap() { return m_BoneInfoMap; }
 	int& GetBoneCount() { return m_BoneCounter; }
+	// per bone boxes of the bind pose, for bounds that follow the animation
+	const SkinnedBounds& GetSkinnedBounds() const { return m_SkinnedBounds; }
 	
 
 private:
 
 	std::map<string, BoneInfo> m_BoneInfoMap;
 	int m_BoneCounter = 0;
+	SkinnedBounds m_SkinnedBounds;
+	unordered_map<string, size_t> texturesLoadedIndex;	// path -> position in textures_loaded
+	ResidencyManager* residency = nullptr;
+	vector<ResidencyManager::ResourceId> meshResidency;	// one per mesh
+	unordered_map<unsigned int, ResidencyManager::ResourceId> textureResidency;	// texture id -> resource
+
+	void TouchMesh(unsigned int index)
+	{
+		residency->Touch(meshResidency[index]);
+		for (const Texture& texture : meshes[index].textures)
+		{
+			auto found = textureResidency.find(texture.id);
+			if (found != textureResidency.end())
+				residency->Touch(found->second);
+		}
+	}
 
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
@@ -148,8 +270,9 @@ private:
 		textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
 		ExtractBoneWeightForVertices(vertices,mesh,scene);
+		m_SkinnedBounds.AddVertices(vertices);
 
-		return Mesh(vertices, indices, textures);
+		return Mesh(vertices, indices, textures, !deferUpload);
 	}
 
 	void SetVertexBoneData(Vertex& vertex, int boneID, float weight)
@@ -208,23 +331,34 @@ private:
 		string filename = string(path);
 		filename = directory + '/' + filename;
 
-		unsigned int textureID;
-		glGenTextures(1, &textureID);
-
+		// the caller owns the texture, GpuMemoryTracker keeps counting it until it is deleted through a GLTexture
+		GLTexture texture;
 		int width, height, nrComponents;
 		unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
 		if (data)
 		{
-			GLenum format;
+			GLenum format = GL_RGBA, internalFormat = GL_RGBA8;
 			if (nrComponents == 1)
+			{
 				format = GL_RED;
+				internalFormat = GL_R8;
+			}
+			else if (nrComponents == 2)
+			{
+				format = GL_RG;
+				internalFormat = GL_RG8;
+			}
 			else if (nrComponents == 3)
+			{
 				format = GL_RGB;
-			else if (nrComponents == 4)
-				format = GL_RGBA;
+				internalFormat = GL_RGB8;
+			}
 
-			glBindTexture(GL_TEXTURE_2D, textureID);
-			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+			// immutable storage for the whole chain, then fill level 0
+			texture = CreateTexture2D(MipLevelCount(width, height), internalFormat, width, height);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 			glGenerateMipmap(GL_TEXTURE_2D);
 
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -240,9 +374,27 @@ private:
 			stbi_image_free(data);
 		}
 
-		return textureID;
+		return texture.Release();
 	}
     
+    // loads a texture through the process wide TextureCache, so models using the same image share one GL texture.
+    unsigned int LoadTexture(const string &path, const string &typeName)
+    {
+        TextureHandle handle = TextureCache::Instance().Acquire(this->directory + '/' + path, typeName, [&](const string &filename)
+        {
+            if(textureStreamer)
+                return textureStreamer->Request(filename, TextureUsageFromType(typeName));
+            return TextureFromFile(path.c_str(), this->directory);
+        }, [streamer = textureStreamer](unsigned int id)
+        {
+            if(streamer)
+                streamer->Forget(id);
+        });
+        unsigned int id = handle.GetID();
+        textureHandles.push_back(std::move(handle));
+        return id;
+    }
+
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
     // the required info is returned as a Texture struct.
     vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
@@ -253,25 +405,20 @@ private:
             aiString str;
             mat->GetTexture(type, i, &str);
             // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            auto loaded = texturesLoadedIndex.find(str.C_Str());
+            if(loaded != texturesLoadedIndex.end())
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+                textures.push_back(textures_loaded[loaded->second]); // a texture with the same filepath has already been loaded, continue to next one. (optimization)
+                continue;
             }
+            // if texture hasn't been loaded already, load it. Textures other models already use come from the TextureCache.
+            Texture texture;
+            texture.path = str.C_Str();
+            texture.id = deferUpload ? 0 : LoadTexture(texture.path, typeName);
+            texture.type = typeName;
+            textures.push_back(texture);
+            texturesLoadedIndex[texture.path] = textures_loaded.size();
+            textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
         }
         return textures;
     }
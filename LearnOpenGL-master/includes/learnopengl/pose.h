@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/quaternion.hpp>
+#include <learnopengl/animation.h>
+#include <learnopengl/skeleton.h>
+#include <learnopengl/simd.h>
+
+// local joint transforms of one skeleton as separate arrays (structure of arrays), so
+// sampling, blending and composing each stream through memory in joint order.
+struct Pose
+{
+	std::vector<glm::vec3> translations;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+
+	int GetJointCount() const { return (int)translations.size(); }
+
+	// only allocates when the skeleton grows
+	void Resize(int jointCount)
+	{
+		translations.resize(jointCount);
+		rotations.resize(jointCount);
+		scales.resize(jointCount);
+	}
+
+	void SetBindPose(const Skeleton& skeleton)
+	{
+		Resize(skeleton.GetJointCount());
+		for (int joint = 0; joint < skeleton.GetJointCount(); joint++)
+		{
+			translations[joint] = skeleton.m_BindTranslations[joint];
+			rotations[joint] = skeleton.m_BindRotations[joint];
+			scales[joint] = skeleton.m_BindScales[joint];
+		}
+	}
+};
+
+// Samples animation at time into pose, which is laid out for skeleton. jointChannels maps the
+// joints to channels of the animation (Animation::GetJointChannels() for its own skeleton,
+// Animation::BuildChannelMap() for another). Joints without a channel copy fallback if it is
+// given and take the bind pose otherwise. cursors is the caller's per channel key cache.
+inline void SamplePose(const Animation& animation, const std::vector<int>& jointChannels, float time, std::vector<BoneCursor>& cursors,
+	const Skeleton& skeleton, Pose& pose, const Pose* fallback = nullptr)
+{
+	cursors.resize(animation.GetChannelCount());
+	int jointCount = skeleton.GetJointCount();
+	pose.Resize(jointCount);
+	for (int joint = 0; joint < jointCount; joint++)
+	{
+		int channel = jointChannels[joint];
+		if (channel >= 0)
+			animation.SampleChannel(channel, time, cursors[channel], pose.translations[joint], pose.rotations[joint], pose.scales[joint]);
+		else if (fallback)
+		{
+			pose.translations[joint] = fallback->translations[joint];
+			pose.rotations[joint] = fallback->rotations[joint];
+			pose.scales[joint] = fallback->scales[joint];
+		}
+		else
+		{
+			pose.translations[joint] = skeleton.m_BindTranslations[joint];
+			pose.rotations[joint] = skeleton.m_BindRotations[joint];
+			pose.scales[joint] = skeleton.m_BindScales[joint];
+		}
+	}
+}
+
+// pose = pose * (1 - weight) + other * weight
+inline void BlendPoses(Pose& pose, const Pose& other, float weight)
+{
+	for (int joint = 0; joint < pose.GetJointCount(); joint++)
+	{
+		pose.translations[joint] = glm::mix(pose.translations[joint], other.translations[joint], weight);
+		pose.rotations[joint] = glm::normalize(glm::slerp(pose.rotations[joint], other.rotations[joint], weight));
+		pose.scales[joint] = glm::mix(pose.scales[joint], other.scales[joint], weight);
+	}
+}
+
+// translation * rotation * scale without the three matrix products
+inline glm::mat4 ComposeTransform(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+	glm::mat4 transform = glm::toMat4(rotation);
+	transform[0] *= scale.x;
+	transform[1] *= scale.y;
+	transform[2] *= scale.z;
+	transform[3] = glm::vec4(position, 1.0f);
+	return transform;
+}
+
+// Composes the model space transforms of pose (parents come first, so this is one forward
+// pass) and writes the skinning matrices of the joints that are bones into palette.
+// globals is scratch space, reused between calls. palette may point into mapped GPU memory.
+inline void ComposePalette(const Skeleton& skeleton, const Pose& pose, std::vector<glm::mat4>& globals, glm::mat4* palette, int paletteSize)
+{
+	int jointCount = skeleton.GetJointCount();
+	globals.resize(jointCount);
+	for (int joint = 0; joint < jointCount; joint++)
+	{
+		glm::mat4 local = ComposeTransform(pose.translations[joint], pose.rotations[joint], pose.scales[joint]);
+		int parent = skeleton.m_Parents[joint];
+		globals[joint] = parent >= 0 ? globals[parent] * local : local;
+
+		int index = skeleton.m_PaletteIndex[joint];
+		if (index >= 0 && index < paletteSize)
+			palette[index] = globals[joint] * skeleton.m_Offsets[joint];
+	}
+}
+
+// -- blend kernels ------------------------------------------------------------------------
+// Poses are blended in local space and only turned into matrices once at the end. Vector
+// streams are processed as flat float arrays, quaternions one per SSE register.
+
+// dst += src * weight over count floats
+inline void MulAddFloats(float* dst, const float* src, float weight, size_t count)
+{
+	size_t i = 0;
+#ifdef SIMD_SSE2
+	__m128 w = _mm_set1_ps(weight);
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), w)));
+#endif
+	for (; i < count; i++)
+		dst[i] += src[i] * weight;
+}
+
+#ifdef SIMD_SSE2
+inline __m128 Dot4(__m128 a, __m128 b)
+{
+	__m128 m = _mm_mul_ps(a, b);
+	m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+#endif
+
+// acc += q * weight, with q flipped into the hemisphere of acc so opposite signs don't cancel
+inline void AccumulateRotation(glm::quat& acc, const glm::quat& q, float weight)
+{
+#ifdef SIMD_SSE2
+	__m128 a = _mm_loadu_ps(&acc.x);
+	__m128 b = _mm_loadu_ps(&q.x);
+	__m128 sign = _mm_and_ps(Dot4(a, b), _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000)));
+	__m128 w = _mm_xor_ps(_mm_set1_ps(weight), sign);
+	_mm_storeu_ps(&acc.x, _mm_add_ps(a, _mm_mul_ps(b, w)));
+#else
+	float w = glm::dot(acc, q) < 0.0f ? -weight : weight;
+	acc.x += q.x * w;
+	acc.y += q.y * w;
+	acc.z += q.z * w;
+	acc.w += q.w * w;
+#endif
+}
+
+inline void NormalizeRotation(glm::quat& q)
+{
+#ifdef SIMD_SSE2
+	__m128 v = _mm_loadu_ps(&q.x);
+	__m128 lengthSquared = Dot4(v, v);
+	if (_mm_cvtss_f32(lengthSquared) > 1e-12f)
+	{
+		_mm_storeu_ps(&q.x, _mm_div_ps(v, _mm_sqrt_ps(lengthSquared)));
+		return;
+	}
+#else
+	float length = std::sqrt(glm::dot(q, q));
+	if (length > 1e-6f)
+	{
+		q = q / length;
+		return;
+	}
+#endif
+	q = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+}
+
+// zero pose to accumulate weighted poses into
+inline void ClearPose(Pose& pose, int jointCount)
+{
+	pose.Resize(jointCount);
+	std::fill(pose.translations.begin(), pose.translations.end(), glm::vec3(0.0f));
+	std::fill(pose.rotations.begin(), pose.rotations.end(), glm::quat(0.0f, 0.0f, 0.0f, 0.0f));
+	std::fill(pose.scales.begin(), pose.scales.end(), glm::vec3(0.0f));
+}
+
+// acc += pose * weight; finish with NormalizePose once all weights (summing to one) are in
+inline void AccumulatePose(Pose& acc, const Pose& pose, float weight)
+{
+	size_t floats = acc.translations.size() * 3;
+	MulAddFloats(&acc.translations[0].x, &pose.translations[0].x, weight, floats);
+	MulAddFloats(&acc.scales[0].x, &pose.scales[0].x, weight, floats);
+	for (size_t joint = 0; joint < acc.rotations.size(); joint++)
+		AccumulateRotation(acc.rotations[joint], pose.rotations[joint], weight);
+}
+
+inline void NormalizePose(Pose& pose)
+{
+	for (glm::quat& rotation : pose.rotations)
+		NormalizeRotation(rotation);
+}
+
+// pose = lerp(pose, overlay, weight * jointWeights[joint]) per joint, rotations by nlerp.
+// jointWeights may be null for a uniform blend.
+inline void LerpPose(Pose& pose, const Pose& overlay, float weight, const float* jointWeights = nullptr)
+{
+	for (int joint = 0; joint < pose.GetJointCount(); joint++)
+	{
+		float t = jointWeights ? weight * jointWeights[joint] : weight;
+		if (t <= 0.0f)
+			continue;
+		pose.translations[joint] += (overlay.translations[joint] - pose.translations[joint]) * t;
+		pose.scales[joint] += (overlay.scales[joint] - pose.scales[joint]) * t;
+		glm::quat& rotation = pose.rotations[joint];
+		rotation = rotation * (1.0f - t);
+		AccumulateRotation(rotation, overlay.rotations[joint], t);
+		NormalizeRotation(rotation);
+	}
+}
+
+// applies the difference between additive and reference on top of pose:
+// translations add, rotations multiply, scales scale. jointWeights may be null.
+inline void AddPose(Pose& pose, const Pose& additive, const Pose& reference, float weight, const float* jointWeights = nullptr)
+{
+	const glm::quat identity(1.0f, 0.0f, 0.0f, 0.0f);
+	for (int joint = 0; joint < pose.GetJointCount(); joint++)
+	{
+		float t = jointWeights ? weight * jointWeights[joint] : weight;
+		if (t <= 0.0f)
+			continue;
+		pose.translations[joint] += (additive.translations[joint] - reference.translations[joint]) * t;
+		glm::vec3 scaleDelta = additive.scales[joint] / glm::max(reference.scales[joint], glm::vec3(1e-6f));
+		pose.scales[joint] *= glm::mix(glm::vec3(1.0f), scaleDelta, t);
+
+		glm::quat delta = glm::inverse(reference.rotations[joint]) * additive.rotations[joint];
+		glm::quat scaledDelta = identity * (1.0f - t);
+		AccumulateRotation(scaledDelta, delta, t);
+		NormalizeRotation(scaledDelta);
+		pose.rotations[joint] = glm::normalize(pose.rotations[joint] * scaledDelta);
+	}
+}
+
+// -- palette formats ----------------------------------------------------------------------
+// How skinning matrices are stored for the GPU, in RGBA32F texels per bone. Mat3x4 drops the
+// constant last row; DualQuat keeps only rotation and translation (scale is lost), which
+// halves the bandwidth and blends without the volume loss of linear skinning at joints.
+enum class PaletteFormat { Mat4, Mat3x4, DualQuat };
+
+inline int GetPaletteTexels(PaletteFormat format)
+{
+	return format == PaletteFormat::Mat4 ? 4 : format == PaletteFormat::Mat3x4 ? 3 : 2;
+}
+
+// writes one skinning matrix as GetPaletteTexels(format) texels
+inline void EncodeSkinMatrix(const glm::mat4& matrix, PaletteFormat format, glm::vec4* texels)
+{
+	switch (format)
+	{
+	case PaletteFormat::Mat4:
+		for (int column = 0; column < 4; column++)
+			texels[column] = matrix[column];
+		break;
+	case PaletteFormat::Mat3x4:
+		// rows, so the shader transforms with three dot products
+		for (int row = 0; row < 3; row++)
+			texels[row] = glm::vec4(matrix[0][row], matrix[1][row], matrix[2][row], matrix[3][row]);
+		break;
+	case PaletteFormat::DualQuat:
+	{
+		glm::mat3 rotation(glm::normalize(glm::vec3(matrix[0])), glm::normalize(glm::vec3(matrix[1])), glm::normalize(glm::vec3(matrix[2])));
+		glm::quat real = glm::normalize(glm::quat_cast(rotation));
+		glm::vec3 t(matrix[3]);
+		glm::vec3 v(real.x, real.y, real.z);
+		// dual = 0.5 * (0, t) * real
+		glm::vec3 dual = 0.5f * (real.w * t + glm::cross(t, v));
+		texels[0] = glm::vec4(real.x, real.y, real.z, real.w);
+		texels[1] = glm::vec4(dual, -0.5f * glm::dot(t, v));
+		break;
+	}
+	}
+}
+
+inline void EncodePalette(const glm::mat4* palette, int count, PaletteFormat format, glm::vec4* texels)
+{
+	int stride = GetPaletteTexels(format);
+	for (int i = 0; i < count; i++)
+		EncodeSkinMatrix(palette[i], format, texels + i * stride);
+}
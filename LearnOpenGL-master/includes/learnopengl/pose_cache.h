@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/animation.h>
+#include <learnopengl/pose.h>
+
+// Shares sampled poses between instances that play the same clip. Clip time is quantized
+// to sampleRate steps and each (clip, step) is sampled and composed once per frame, by
+// whichever instance gets there first; the others copy the finished palette. A crowd of
+// idling characters then costs as many samples as there are distinct steps, not instances.
+// Give instances different phase offsets (GetPhaseOffset()) so they don't move in lockstep;
+// offsets are whole steps, so the number of distinct samples per clip stays bounded.
+//
+// Lookups are thread safe. Call BeginFrame() once per frame before any instance is evaluated
+// (AnimationSystem does when it has a cache).
+class PoseCache
+{
+public:
+	PoseCache(float sampleRate = 30.0f, unsigned int capacity = 256, int maxBones = 100)
+		: m_SampleRate(sampleRate), m_Capacity(capacity), m_MaxBones(maxBones), m_Entries(new Entry[capacity])
+	{
+		for (unsigned int i = 0; i < capacity; i++)
+			m_Entries[i].palette.assign(maxBones, glm::mat4(1.0f));
+	}
+
+	PoseCache(const PoseCache&) = delete;
+	PoseCache& operator=(const PoseCache&) = delete;
+
+	void BeginFrame()
+	{
+		for (unsigned int i = 0; i < m_Used; i++)
+			m_Entries[i].state.store(Empty, std::memory_order_relaxed);
+		m_Used = 0;
+		m_Keys.clear();
+		m_Hits = 0;
+		m_Misses = 0;
+	}
+
+	// Palette of animation at time (ticks) with every joint channel, sampled and composed on
+	// first use this frame. Returns null when the cache is full, the caller then evaluates the
+	// pose itself.
+	const glm::mat4* GetPalette(Animation& animation, float time)
+	{
+		Entry* entry = Find(animation, time);
+		return entry ? entry->palette.data() : nullptr;
+	}
+
+	// a phase offset in seconds for instance, a whole number of steps in [0, maxSeconds]
+	float GetPhaseOffset(unsigned int instance, float maxSeconds) const
+	{
+		unsigned int steps = (unsigned int)(maxSeconds * m_SampleRate) + 1;
+		uint32_t hash = instance * 2654435761u;
+		hash ^= hash >> 16;
+		return (float)(hash % steps) / m_SampleRate;
+	}
+
+	float GetSampleRate() const { return m_SampleRate; }
+	int GetMaxBones() const { return m_MaxBones; }
+	unsigned int GetEntryCount() const { return m_Used; }
+	unsigned int GetHitCount() const { return m_Hits; }
+	unsigned int GetMissCount() const { return m_Misses; }
+
+private:
+	enum { Empty, Sampling, Ready };
+
+	struct Entry
+	{
+		std::atomic<int> state{ Empty };
+		Pose pose;
+		std::vector<glm::mat4> palette;
+		std::vector<glm::mat4> globalTransforms;
+		std::vector<BoneCursor> cursors;
+	};
+
+	struct Key
+	{
+		const Animation* animation;
+		int64_t step;
+		bool operator==(const Key& other) const { return animation == other.animation && step == other.step; }
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const
+		{
+			return std::hash<const void*>()(key.animation) ^ (std::hash<int64_t>()(key.step) * 31);
+		}
+	};
+
+	float m_SampleRate;
+	unsigned int m_Capacity;
+	int m_MaxBones;
+	std::unique_ptr<Entry[]> m_Entries;
+	unsigned int m_Used = 0;
+	std::unordered_map<Key, unsigned int, KeyHash> m_Keys;
+	std::mutex m_Mutex;	// guards m_Keys and m_Used
+	std::atomic<unsigned int> m_Hits{ 0 }, m_Misses{ 0 };
+
+	Entry* Find(Animation& animation, float time)
+	{
+		float step = animation.GetTicksPerSecond() / m_SampleRate;
+		int64_t index = (int64_t)std::floor(time / step);
+
+		Entry* entry;
+		bool sample = false;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			auto known = m_Keys.find(Key{ &animation, index });
+			if (known != m_Keys.end())
+				entry = &m_Entries[known->second];
+			else
+			{
+				if (m_Used == m_Capacity)
+					return nullptr;
+				entry = &m_Entries[m_Used];
+				m_Keys[Key{ &animation, index }] = m_Used++;
+				entry->state.store(Sampling, std::memory_order_relaxed);
+				sample = true;
+			}
+		}
+
+		if (sample)
+		{
+			const Skeleton& skeleton = animation.GetSkeleton();
+			SamplePose(animation, animation.GetJointChannels(), (float)index * step, entry->cursors, skeleton, entry->pose);
+			ComposePalette(skeleton, entry->pose, entry->globalTransforms, entry->palette.data(), m_MaxBones);
+			entry->state.store(Ready, std::memory_order_release);
+			m_Misses++;
+			return entry;
+		}
+
+		// another instance is sampling this step, it only takes a moment
+		while (entry->state.load(std::memory_order_acquire) != Ready)
+			std::this_thread::yield();
+		m_Hits++;
+		return entry;
+	}
+};
@@ -0,0 +1,187 @@
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// what the ResidencyManager needs to know about one resource
+struct ResidencyCallbacks
+{
+    std::function<size_t()> bytes;   // video memory the resource occupies right now
+    std::function<void()> load;      // makes it fully resident again, may finish asynchronously
+    std::function<void()> evict;     // frees its video memory
+    std::function<size_t()> trim;    // optional: shrinks it (drops a mip level), returns the bytes it expects to free, 0 if it can't
+};
+
+// Keeps the video memory of registered textures and meshes under a budget. Resources are
+// touched when they are drawn; Update() (once per frame, GL thread) walks them from least
+// to most recently used and trims or evicts until the resident total fits the budget.
+// Resources used in the current frame are never evicted. An evicted resource is loaded
+// again by the next Touch(), trimmed ones are restored one per frame while there is room.
+class ResidencyManager
+{
+public:
+    typedef unsigned int ResourceId;
+
+    explicit ResidencyManager(size_t budgetBytes) : m_Budget(budgetBytes) {}
+
+    ResidencyManager(const ResidencyManager&) = delete;
+    ResidencyManager& operator=(const ResidencyManager&) = delete;
+
+    // key identifies the underlying GL object so resources shared between models are only
+    // tracked once; registering an existing key adds a reference and keeps the first callbacks.
+    ResourceId Register(uint64_t key, ResidencyCallbacks callbacks)
+    {
+        auto known = m_Keys.find(key);
+        if (known != m_Keys.end())
+        {
+            m_Resources[known->second].refCount++;
+            return known->second;
+        }
+
+        ResourceId id;
+        if (!m_FreeIds.empty())
+        {
+            id = m_FreeIds.back();
+            m_FreeIds.pop_back();
+        }
+        else
+        {
+            id = (ResourceId)m_Resources.size();
+            m_Resources.emplace_back();
+        }
+
+        Resource& resource = m_Resources[id];
+        resource.key = key;
+        resource.callbacks = std::move(callbacks);
+        resource.refCount = 1;
+        resource.lastUsedFrame = m_Frame;
+        resource.resident = true;
+        resource.trimmed = false;
+        m_Lru.push_front(id);
+        resource.lruPosition = m_Lru.begin();
+        m_Keys[key] = id;
+        return id;
+    }
+
+    void Unregister(ResourceId id)
+    {
+        Resource& resource = m_Resources[id];
+        if (--resource.refCount > 0)
+            return;
+        m_Lru.erase(resource.lruPosition);
+        m_Keys.erase(resource.key);
+        resource.callbacks = ResidencyCallbacks();
+        m_FreeIds.push_back(id);
+    }
+
+    // marks the resource as used this frame, reloading it if it was evicted.
+    void Touch(ResourceId id)
+    {
+        Resource& resource = m_Resources[id];
+        resource.lastUsedFrame = m_Frame;
+        m_Lru.splice(m_Lru.begin(), m_Lru, resource.lruPosition);
+        if (!resource.resident)
+        {
+            resource.callbacks.load();
+            resource.resident = true;
+            resource.trimmed = false;
+            m_Reloads++;
+        }
+    }
+
+    // enforces the budget and advances the frame counter. call once per frame after drawing.
+    void Update()
+    {
+        size_t resident = GetResidentBytes();
+        bool reduced = false;
+
+        // least recently used first, stop at the first resource drawn this frame
+        for (auto it = m_Lru.rbegin(); it != m_Lru.rend() && resident > m_Budget; ++it)
+        {
+            Resource& resource = m_Resources[*it];
+            if (resource.lastUsedFrame == m_Frame)
+                break;
+            if (!resource.resident)
+                continue;
+
+            size_t freed = resource.callbacks.trim ? resource.callbacks.trim() : 0;
+            if (freed > 0)
+            {
+                resource.trimmed = true;
+                m_Trims++;
+            }
+            else
+            {
+                freed = resource.callbacks.bytes();
+                resource.callbacks.evict();
+                resource.resident = false;
+                resource.trimmed = false;
+                m_Evictions++;
+            }
+            resident -= std::min(resident, freed);
+            reduced = true;
+        }
+
+        // with room to spare bring back the most recently used trimmed resource. Going up a
+        // mip level roughly quadruples its size, leave some headroom so it isn't trimmed again.
+        for (auto it = m_Lru.begin(); it != m_Lru.end() && !reduced; ++it)
+        {
+            Resource& resource = m_Resources[*it];
+            if (resource.resident && resource.trimmed)
+            {
+                if (resident + resource.callbacks.bytes() * 3 < m_Budget - m_Budget / 8)
+                {
+                    resource.callbacks.load();
+                    resource.trimmed = false;
+                }
+                break;
+            }
+        }
+        m_Frame++;
+    }
+
+    size_t GetResidentBytes() const
+    {
+        size_t total = 0;
+        for (ResourceId id : m_Lru)
+        {
+            if (m_Resources[id].resident)
+                total += m_Resources[id].callbacks.bytes();
+        }
+        return total;
+    }
+
+    bool IsResident(ResourceId id) const { return m_Resources[id].resident; }
+    size_t GetBudget() const { return m_Budget; }
+    void SetBudget(size_t budgetBytes) { m_Budget = budgetBytes; }
+    uint64_t GetFrame() const { return m_Frame; }
+    unsigned int GetEvictionCount() const { return m_Evictions; }
+    unsigned int GetTrimCount() const { return m_Trims; }
+    unsigned int GetReloadCount() const { return m_Reloads; }
+
+private:
+    struct Resource
+    {
+        uint64_t key = 0;
+        ResidencyCallbacks callbacks;
+        unsigned int refCount = 0;
+        uint64_t lastUsedFrame = 0;
+        bool resident = false;
+        bool trimmed = false;
+        std::list<ResourceId>::iterator lruPosition;
+    };
+
+    size_t m_Budget;
+    uint64_t m_Frame = 0;
+    std::vector<Resource> m_Resources;
+    std::vector<ResourceId> m_FreeIds;
+    std::list<ResourceId> m_Lru;    // most recently used at the front
+    std::unordered_map<uint64_t, ResourceId> m_Keys;
+    unsigned int m_Evictions = 0, m_Trims = 0, m_Reloads = 0;
+};
+#endif
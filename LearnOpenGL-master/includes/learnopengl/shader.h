@@ -4,6 +4,8 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <learnopengl/gl_resource.h>
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -83,6 +85,7 @@ public:
         }
         // shader Program
         ID = glCreateProgram();
+        program = GLProgram(ID);
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
@@ -96,6 +99,19 @@ public:
             glDeleteShader(geometry);
 
     }
+    // moving hands the program over, the moved-from shader is left with ID 0
+    // ------------------------------------------------------------------------
+    Shader(Shader&& other) noexcept : ID(other.ID), program(std::move(other.program))
+    {
+        other.ID = 0;
+    }
+    Shader& operator=(Shader&& other) noexcept
+    {
+        ID = other.ID;
+        program = std::move(other.program);
+        other.ID = 0;
+        return *this;
+    }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
@@ -162,6 +178,9 @@ public:
     }
 
 private:
+    // owns ID, deletes the program with the shader object
+    GLProgram program;
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
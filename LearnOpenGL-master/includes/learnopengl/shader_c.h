@@ -4,6 +4,8 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <learnopengl/gl_resource.h>
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -50,12 +52,26 @@ public:
         
         // shader Program
         ID = glCreateProgram();
+        program = GLProgram(ID);
         glAttachShader(ID, compute);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(compute);
     }
+    // moving hands the program over, the moved-from shader is left with ID 0
+    // ------------------------------------------------------------------------
+    ComputeShader(ComputeShader&& other) noexcept : ID(other.ID), program(std::move(other.program))
+    {
+        other.ID = 0;
+    }
+    ComputeShader& operator=(ComputeShader&& other) noexcept
+    {
+        ID = other.ID;
+        program = std::move(other.program);
+        other.ID = 0;
+        return *this;
+    }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
@@ -122,6 +138,9 @@ public:
     }
 
 private:
+    // owns ID, deletes the program with the shader object
+    GLProgram program;
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,47 @@
+#pragma once
+
+// SIMD_SSE2 is defined where SSE2 can be used without runtime checks: every x86-64 build and
+// 32-bit builds targeting it. The code paths that use it keep a plain glm fallback.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+// SIMD_AVX2 code is compiled for AVX2 and FMA whatever flags the rest of the build uses:
+// functions marked SIMD_AVX2_TARGET may use their intrinsics and must only be called when
+// SimdHasAvx2() is true. MSVC accepts the intrinsics in any function.
+#if defined(SIMD_SSE2) && (defined(__GNUC__) || defined(_MSC_VER))
+#define SIMD_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SIMD_AVX2_TARGET
+#else
+#define SIMD_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+
+// whether the CPU and the OS (saving the ymm registers) support AVX2 and FMA
+inline bool SimdHasAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    static const bool supported = []
+    {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        bool fma = (info[2] & (1 << 12)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!fma || !osxsave || !avx || (_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }();
+#else
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    return supported;
+}
+#endif
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/matrix_decompose.hpp>
+#include <learnopengl/animdata.h>
+
+// node hierarchy of an animation flattened into arrays. Joints are stored in depth first
+// order, so every parent comes before its children and a pose can be evaluated with one
+// forward loop instead of a recursion over the node tree.
+class Skeleton
+{
+public:
+	Skeleton() = default;
+
+	// root is any node type with name, transformation and children members (AssimpNodeData).
+	// boneInfoMap resolves each joint to its slot in the final bone matrices.
+	template <typename Node>
+	Skeleton(const Node& root, const std::map<std::string, BoneInfo>& boneInfoMap)
+	{
+		AddJoint(root, -1, boneInfoMap);
+	}
+
+	int GetJointCount() const { return (int)m_Parents.size(); }
+
+	// load time lookup, -1 if the skeleton has no joint with this name
+	int FindJoint(const std::string& name) const
+	{
+		for (int i = 0; i < GetJointCount(); i++)
+		{
+			if (m_Names[i] == name)
+				return i;
+		}
+		return -1;
+	}
+
+	std::vector<int> m_Parents;            // parent joint, -1 for the root
+	std::vector<glm::mat4> m_BindLocal;    // node transformation, used when no channel animates the joint
+	std::vector<glm::vec3> m_BindTranslations;	// m_BindLocal split up for poses
+	std::vector<glm::quat> m_BindRotations;
+	std::vector<glm::vec3> m_BindScales;
+	std::vector<int> m_PaletteIndex;       // index into the final bone matrices, -1 for helper nodes
+	std::vector<glm::mat4> m_Offsets;      // model space -> bone space, valid where m_PaletteIndex >= 0
+	std::vector<std::string> m_Names;
+
+private:
+	template <typename Node>
+	void AddJoint(const Node& node, int parent, const std::map<std::string, BoneInfo>& boneInfoMap)
+	{
+		int index = GetJointCount();
+		m_Parents.push_back(parent);
+		m_BindLocal.push_back(node.transformation);
+		glm::vec3 translation, scale, skew;
+		glm::quat rotation;
+		glm::vec4 perspective;
+		if (!glm::decompose(node.transformation, scale, rotation, translation, skew, perspective))
+		{
+			// degenerate (zero scale) node, keep its translation only
+			translation = glm::vec3(node.transformation[3]);
+			scale = glm::vec3(1.0f);
+			rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		}
+		m_BindTranslations.push_back(translation);
+		m_BindRotations.push_back(glm::normalize(rotation));
+		m_BindScales.push_back(scale);
+		m_Names.push_back(node.name);
+
+		auto bone = boneInfoMap.find(node.name);
+		m_PaletteIndex.push_back(bone != boneInfoMap.end() ? bone->second.id : -1);
+		m_Offsets.push_back(bone != boneInfoMap.end() ? bone->second.offset : glm::mat4(1.0f));
+
+		for (const Node& child : node.children)
+			AddJoint(child, index, boneInfoMap);
+	}
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <glm/glm.hpp>
+#include <learnopengl/mesh.h>
+#include <learnopengl/simd.h>
+
+// Bounds of a skinned model that follow its animation. At import every bone gets the box of
+// the bind pose vertices it influences; each frame these boxes are moved by the palette
+// matrices and merged. A skinned vertex is a weighted average of the vertex moved by each of
+// its bones, so the merged box holds the animated mesh (for linear blending; dual quaternion
+// blending can bulge slightly past it).
+class SkinnedBounds
+{
+public:
+	// grows the boxes of the bones the vertices are weighted to; vertices without weights
+	// go into a box that never moves
+	void AddVertices(const std::vector<Vertex>& vertices)
+	{
+		for (const Vertex& vertex : vertices)
+		{
+			bool skinned = false;
+			for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+			{
+				int id = vertex.m_BoneIDs[i];
+				if (id < 0 || vertex.m_Weights[i] <= 0.0f)
+					continue;
+				if (id >= (int)m_Bones.size())
+					m_Bones.resize(id + 1);
+				m_Bones[id].Grow(vertex.Position);
+				skinned = true;
+			}
+			if (!skinned)
+				m_Static.Grow(vertex.Position);
+		}
+	}
+
+	// box around the mesh skinned with palette, bones from paletteSize on keep the bind pose.
+	// Returns false when there are no vertices.
+	bool Compute(const glm::mat4* palette, int paletteSize, glm::vec3& min, glm::vec3& max) const
+	{
+		Box box = m_Static;
+		int count = (int)m_Bones.size();
+		for (int bone = paletteSize; bone < count; bone++)
+			box.Merge(m_Bones[bone]);
+		count = std::min(count, paletteSize);
+
+#ifdef SIMD_SSE2
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		__m128 lo = _mm_load_ps(&box.min.x), hi = _mm_load_ps(&box.max.x);
+		for (int bone = 0; bone < count; bone++)
+		{
+			const Box& local = m_Bones[bone];
+			if (local.IsEmpty())
+				continue;
+			__m128 localMin = _mm_load_ps(&local.min.x), localMax = _mm_load_ps(&local.max.x);
+			__m128 center = _mm_mul_ps(_mm_add_ps(localMin, localMax), half);
+			__m128 extents = _mm_mul_ps(_mm_sub_ps(localMax, localMin), half);
+
+			// center through the whole matrix, extents through the absolute rotation and scale
+			const float* m = &palette[bone][0][0];
+			__m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+			__m128 movedCenter = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(c0, _mm_shuffle_ps(center, center, _MM_SHUFFLE(0, 0, 0, 0))),
+				_mm_mul_ps(c1, _mm_shuffle_ps(center, center, _MM_SHUFFLE(1, 1, 1, 1)))), _mm_add_ps(
+				_mm_mul_ps(c2, _mm_shuffle_ps(center, center, _MM_SHUFFLE(2, 2, 2, 2))), c3));
+			__m128 movedExtents = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_and_ps(c0, absMask), _mm_shuffle_ps(extents, extents, _MM_SHUFFLE(0, 0, 0, 0))),
+				_mm_mul_ps(_mm_and_ps(c1, absMask), _mm_shuffle_ps(extents, extents, _MM_SHUFFLE(1, 1, 1, 1)))),
+				_mm_mul_ps(_mm_and_ps(c2, absMask), _mm_shuffle_ps(extents, extents, _MM_SHUFFLE(2, 2, 2, 2))));
+			lo = _mm_min_ps(lo, _mm_sub_ps(movedCenter, movedExtents));
+			hi = _mm_max_ps(hi, _mm_add_ps(movedCenter, movedExtents));
+		}
+		_mm_store_ps(&box.min.x, lo);
+		_mm_store_ps(&box.max.x, hi);
+#else
+		for (int bone = 0; bone < count; bone++)
+		{
+			const Box& local = m_Bones[bone];
+			if (local.IsEmpty())
+				continue;
+			glm::vec3 center = glm::vec3(local.min + local.max) * 0.5f;
+			glm::vec3 extents = glm::vec3(local.max - local.min) * 0.5f;
+			const glm::mat4& matrix = palette[bone];
+			glm::vec3 movedCenter = glm::vec3(matrix * glm::vec4(center, 1.0f));
+			glm::vec3 movedExtents = glm::abs(glm::vec3(matrix[0])) * extents.x + glm::abs(glm::vec3(matrix[1])) * extents.y +
+				glm::abs(glm::vec3(matrix[2])) * extents.z;
+			box.min = glm::min(box.min, glm::vec4(movedCenter - movedExtents, 0.0f));
+			box.max = glm::max(box.max, glm::vec4(movedCenter + movedExtents, 0.0f));
+		}
+#endif
+		if (box.IsEmpty())
+			return false;
+		min = glm::vec3(box.min);
+		max = glm::vec3(box.max);
+		return true;
+	}
+
+	int GetBoneCount() const { return (int)m_Bones.size(); }
+
+private:
+	// w is unused, vec4 so the boxes load straight into SSE registers
+	struct alignas(16) Box
+	{
+		glm::vec4 min = glm::vec4(std::numeric_limits<float>::max());
+		glm::vec4 max = glm::vec4(std::numeric_limits<float>::lowest());
+
+		bool IsEmpty() const { return min.x > max.x; }
+
+		void Grow(const glm::vec3& point)
+		{
+			min = glm::min(min, glm::vec4(point, 0.0f));
+			max = glm::max(max, glm::vec4(point, 0.0f));
+		}
+
+		void Merge(const Box& other)
+		{
+			min = glm::min(min, other.min);
+			max = glm::max(max, other.max);
+		}
+	};
+
+	std::vector<Box> m_Bones;	// by bone id, in bind pose (model space)
+	Box m_Static;	// vertices without bone weights
+};
@@ -0,0 +1,207 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_resource.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class TextureHandle;
+
+// Process-wide texture registry. Textures are keyed by the hash of their file contents and
+// their usage, so the same image reached through different paths or different models is only
+// decoded and uploaded once per usage (a normal map and a diffuse map get different formats).
+// Hashing and loading run outside the lock; a second request for a texture that is still
+// loading waits for it. Handles are reference counted and the texture is deleted when the last
+// one goes away. All calls must come from a thread with a current GL context of the share group.
+class TextureCache
+{
+public:
+    static TextureCache& Instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // returns the cached texture for the file used as usage (e.g. "texture_normal") or creates it
+    // with load(path). release(id) runs right before a texture created by this call is deleted,
+    // e.g. to let the TextureStreamer that loads it forget the id.
+    TextureHandle Acquire(const std::string& path, const std::string& usage, const std::function<unsigned int(const std::string&)>& load,
+        const std::function<void(unsigned int)>& release = nullptr);
+
+    unsigned int GetTextureCount()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return static_cast<unsigned int>(m_Entries.size());
+    }
+
+private:
+    friend class TextureHandle;
+
+    struct Entry
+    {
+        GLTexture texture;
+        std::function<void(unsigned int)> release;
+        unsigned int refCount = 0;
+        bool loading = false;             // the first Acquire is still running load()
+        std::vector<std::string> paths;   // path keys that resolved to this entry
+    };
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Loaded;
+    std::unordered_map<uint64_t, Entry> m_Entries;           // content and usage key -> texture
+    std::unordered_map<std::string, uint64_t> m_PathKeys;    // canonical path and usage -> key
+
+    TextureCache() = default;
+
+    static std::string CanonicalPath(const std::string& path)
+    {
+        std::error_code error;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+        return error ? path : canonical.generic_string();
+    }
+
+    // 64-bit FNV-1a over the usage and the file contents, falls back to the path for unreadable
+    // files so that they still fail to load only once.
+    static uint64_t ContentKey(const std::string& canonicalPath, const std::string& usage)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (char byte : usage)
+        {
+            hash ^= static_cast<unsigned char>(byte);
+            hash *= 1099511628211ull;
+        }
+        hash ^= 0xff;   // separator, usage never holds this byte
+        hash *= 1099511628211ull;
+        std::ifstream file(canonicalPath, std::ios::binary);
+        std::vector<char> bytes;
+        if (file)
+            bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        else
+            bytes.assign(canonicalPath.begin(), canonicalPath.end());
+        for (char byte : bytes)
+        {
+            hash ^= static_cast<unsigned char>(byte);
+            hash *= 1099511628211ull;
+        }
+        // mix in the length to make collisions between different sized files even less likely
+        return hash ^ (static_cast<uint64_t>(bytes.size()) * 0x9E3779B97F4A7C15ull);
+    }
+
+    void AddRef(uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Entries[key].refCount++;
+    }
+
+    void Release(uint64_t key)
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        auto found = m_Entries.find(key);
+        if (found == m_Entries.end() || --found->second.refCount > 0)
+            return;
+        for (const std::string& path : found->second.paths)
+            m_PathKeys.erase(path);
+        // the texture is deleted with entry, after release() and outside the lock
+        Entry entry = std::move(found->second);
+        m_Entries.erase(found);
+        lock.unlock();
+        if (entry.release)
+            entry.release(entry.texture.Get());
+    }
+};
+
+// counted reference to a texture owned by the TextureCache.
+class TextureHandle
+{
+public:
+    TextureHandle() = default;
+
+    TextureHandle(const TextureHandle& other) : m_Key(other.m_Key), m_ID(other.m_ID), m_Valid(other.m_Valid)
+    {
+        if (m_Valid)
+            TextureCache::Instance().AddRef(m_Key);
+    }
+
+    TextureHandle(TextureHandle&& other) noexcept : m_Key(other.m_Key), m_ID(other.m_ID), m_Valid(other.m_Valid)
+    {
+        other.m_Valid = false;
+    }
+
+    TextureHandle& operator=(TextureHandle other) noexcept
+    {
+        std::swap(m_Key, other.m_Key);
+        std::swap(m_ID, other.m_ID);
+        std::swap(m_Valid, other.m_Valid);
+        return *this;
+    }
+
+    ~TextureHandle()
+    {
+        if (m_Valid)
+            TextureCache::Instance().Release(m_Key);
+    }
+
+    unsigned int GetID() const { return m_ID; }
+    bool IsValid() const { return m_Valid; }
+
+private:
+    friend class TextureCache;
+    TextureHandle(uint64_t key, unsigned int id) : m_Key(key), m_ID(id), m_Valid(true) {}
+
+    uint64_t m_Key = 0;
+    unsigned int m_ID = 0;
+    bool m_Valid = false;
+};
+
+inline TextureHandle TextureCache::Acquire(const std::string& path, const std::string& usage, const std::function<unsigned int(const std::string&)>& load,
+    const std::function<void(unsigned int)>& release)
+{
+    std::string pathKey = CanonicalPath(path) + '\n' + usage;
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    uint64_t key;
+    auto knownPath = m_PathKeys.find(pathKey);
+    bool newPath = knownPath == m_PathKeys.end();
+    if (newPath)
+    {
+        // reading and hashing the file doesn't need the lock
+        lock.unlock();
+        key = ContentKey(CanonicalPath(path), usage);
+        lock.lock();
+        newPath = m_PathKeys.emplace(pathKey, key).second;
+    }
+    else
+        key = knownPath->second;
+
+    // the reference keeps the entry alive while it loads or while this call waits for it
+    Entry& entry = m_Entries[key];
+    if (newPath)
+        entry.paths.push_back(pathKey);
+    entry.refCount++;
+    if (entry.refCount == 1)
+    {
+        entry.loading = true;
+        lock.unlock();
+        GLTexture texture(load(path));
+        lock.lock();
+        entry.texture = std::move(texture);
+        entry.release = release;
+        entry.loading = false;
+        m_Loaded.notify_all();
+    }
+    else
+        m_Loaded.wait(lock, [&entry] { return !entry.loading; });
+    return TextureHandle(key, entry.texture.Get());
+}
+#endif
@@ -0,0 +1,338 @@
+#ifndef TEXTURE_COOKER_H
+#define TEXTURE_COOKER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+extern "C" {
+#include <image_DXT.h>
+}
+
+#include <learnopengl/mipmap.h>
+#include <learnopengl/gl_resource.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// block compressed image with its full mip chain stored back to back in one buffer
+struct CompressedTexture
+{
+    struct Level
+    {
+        int width, height;
+        size_t offset, size;
+    };
+
+    GLenum format = 0;
+    std::vector<Level> levels;
+    std::vector<unsigned char> data;
+};
+
+// Converts images to BC1 (opaque), BC3 (with alpha) or BC5 (normal maps, red/green only,
+// the shader has to rebuild z) including every mip level, and caches the result as a .dds
+// file. A cache entry is reused as long as it is newer than its source image. Mip levels
+// come from the MipGenerator. Cooking runs without a GL context, so it can be done offline
+// or on loader threads.
+class TextureCooker
+{
+public:
+    // with an empty cache directory the .dds files are written next to their source images.
+    // mipSettings.srgb and normalMap are set per image from its usage.
+    explicit TextureCooker(std::string cacheDirectory = "", MipSettings mipSettings = MipSettings())
+        : m_CacheDirectory(std::move(cacheDirectory)), m_MipSettings(mipSettings)
+    {
+        if (!m_CacheDirectory.empty())
+        {
+            std::error_code error;
+            std::filesystem::create_directories(m_CacheDirectory, error);
+        }
+    }
+
+    // every usage of the same image is cached apart, they differ in format (BC5 against
+    // BC1/BC3) and in how their mips are filtered
+    std::string GetCachePath(const std::string& filename, TextureUsage usage) const
+    {
+        std::string suffix = ".linear.dds";
+        if (usage == TextureUsage::NormalMap)
+            suffix = ".bc5.dds";
+        else if (usage == TextureUsage::Color)
+            suffix = ".srgb.dds";
+        else if (usage == TextureUsage::AlphaTested)
+            suffix = ".srgb_alpha_test.dds";
+        if (m_CacheDirectory.empty())
+            return filename + suffix;
+        // flatten the source path into the file name so equally named images don't collide
+        size_t pathHash = std::hash<std::string>()(std::filesystem::absolute(filename).generic_string());
+        std::string name = std::filesystem::path(filename).filename().string();
+        return m_CacheDirectory + '/' + std::to_string(pathHash) + '_' + name + suffix;
+    }
+
+    // BC1/BC3 need EXT_texture_compression_s3tc (not core GL), BC5 is core since GL 3.0.
+    // Needs a current context; the answer is kept after the first call.
+    static bool IsS3tcSupported()
+    {
+        static const bool supported = []
+        {
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; i++)
+            {
+                const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+                if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+                    return true;
+            }
+            return false;
+        }();
+        return supported;
+    }
+
+    static bool IsS3tcFormat(GLenum format)
+    {
+        return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    }
+
+    // loads the cached version of the image, cooking it first if needed.
+    bool Load(const std::string& filename, TextureUsage usage, CompressedTexture& out) const
+    {
+        bool normalMap = usage == TextureUsage::NormalMap;
+        std::string cachePath = GetCachePath(filename, usage);
+        std::error_code error;
+        auto sourceTime = std::filesystem::last_write_time(filename, error);
+        bool sourceExists = !error;
+        auto cacheTime = std::filesystem::last_write_time(cachePath, error);
+        if (!error && (!sourceExists || cacheTime >= sourceTime) && ReadDDS(cachePath, out) &&
+            (out.format == GL_COMPRESSED_RG_RGTC2) == normalMap)
+            return true;
+        if (!Cook(filename, usage, out))
+            return false;
+        WriteDDS(cachePath, out);
+        return true;
+    }
+
+    // compresses the image and its mip chain without touching the cache.
+    bool Cook(const std::string& filename, TextureUsage usage, CompressedTexture& out) const
+    {
+        bool normalMap = usage == TextureUsage::NormalMap;
+        int width, height, nrComponents;
+        unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &nrComponents, 4);
+        if (!pixels)
+            return false;
+
+        bool hasAlpha = false;
+        for (size_t i = 3; i < (size_t)width * height * 4 && !hasAlpha; i += 4)
+            hasAlpha = pixels[i] != 255;
+
+        if (normalMap)
+            out.format = GL_COMPRESSED_RG_RGTC2;
+        else if (hasAlpha)
+            out.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        else
+            out.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        out.levels.clear();
+        out.data.clear();
+
+        MipChain chain = MipGenerator::Generate(pixels, width, height, 4, m_MipSettings.ForUsage(usage));
+        stbi_image_free(pixels);
+        for (const MipChain::Level& level : chain.levels)
+            AppendLevel(chain.data.data() + level.offset, level.width, level.height, out);
+        return true;
+    }
+
+    // synchronous upload of a cooked image, returns the texture id (0 for BC1/BC3 without
+    // S3TC support).
+    static unsigned int Upload(const CompressedTexture& texture)
+    {
+        if (IsS3tcFormat(texture.format) && !IsS3tcSupported())
+        {
+            std::cout << "ERROR::TEXTURE_COOKER::S3TC_UNSUPPORTED" << std::endl;
+            return 0;
+        }
+        GLTexture handle = CreateTexture2D((int)texture.levels.size(), texture.format, texture.levels[0].width, texture.levels[0].height);
+        for (size_t i = 0; i < texture.levels.size(); i++)
+        {
+            const CompressedTexture::Level& level = texture.levels[i];
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, level.width, level.height, texture.format,
+                (GLsizei)level.size, texture.data.data() + level.offset);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return handle.Release();
+    }
+
+private:
+    std::string m_CacheDirectory;
+    MipSettings m_MipSettings;
+
+    static unsigned int FourCC(char a, char b, char c, char d)
+    {
+        return (unsigned int)a | ((unsigned int)b << 8) | ((unsigned int)c << 16) | ((unsigned int)d << 24);
+    }
+
+    static size_t BlockBytes(GLenum format)
+    {
+        return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+    }
+
+    static void AppendLevel(const unsigned char* rgba, int width, int height, CompressedTexture& out)
+    {
+        CompressedTexture::Level level;
+        level.width = width;
+        level.height = height;
+        level.offset = out.data.size();
+
+        if (out.format == GL_COMPRESSED_RG_RGTC2)
+        {
+            size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+            out.data.resize(out.data.size() + blocks * 16);
+            unsigned char* dst = out.data.data() + level.offset;
+            for (int by = 0; by < height; by += 4)
+            {
+                for (int bx = 0; bx < width; bx += 4)
+                {
+                    CompressBC4Block(rgba, width, height, bx, by, 0, dst);
+                    CompressBC4Block(rgba, width, height, bx, by, 1, dst + 8);
+                    dst += 16;
+                }
+            }
+        }
+        else
+        {
+            int size = 0;
+            unsigned char* blocks = out.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+                ? convert_image_to_DXT1(rgba, width, height, 4, &size)
+                : convert_image_to_DXT5(rgba, width, height, 4, &size);
+            out.data.insert(out.data.end(), blocks, blocks + size);
+            free(blocks);
+        }
+        level.size = out.data.size() - level.offset;
+        out.levels.push_back(level);
+    }
+
+    // one channel of a 4x4 block in BC4 form: two endpoints, six interpolated values, 3-bit indices
+    static void CompressBC4Block(const unsigned char* rgba, int width, int height, int bx, int by, int channel, unsigned char* dst)
+    {
+        unsigned char values[16];
+        unsigned char lo = 255, hi = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int x = std::min(bx + i % 4, width - 1), y = std::min(by + i / 4, height - 1);
+            values[i] = rgba[((size_t)y * width + x) * 4 + channel];
+            lo = std::min(lo, values[i]);
+            hi = std::max(hi, values[i]);
+        }
+
+        // hi > lo selects the eight value palette
+        unsigned char palette[8];
+        palette[0] = hi;
+        palette[1] = lo;
+        for (int i = 1; i < 7; i++)
+            palette[i + 1] = (unsigned char)(((7 - i) * hi + i * lo + 3) / 7);
+
+        uint64_t bits = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = 256;
+            for (int p = 0; p < 8; p++)
+            {
+                int error = std::abs((int)values[i] - (int)palette[p]);
+                if (error < bestError)
+                {
+                    best = p;
+                    bestError = error;
+                }
+            }
+            bits |= (uint64_t)best << (3 * i);
+        }
+
+        dst[0] = hi;
+        dst[1] = lo;
+        for (int i = 0; i < 6; i++)
+            dst[2 + i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    static bool WriteDDS(const std::string& path, const CompressedTexture& texture)
+    {
+        DDS_header header;
+        std::memset(&header, 0, sizeof(header));
+        header.dwMagic = FourCC('D', 'D', 'S', ' ');
+        header.dwSize = 124;
+        header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+        header.dwWidth = texture.levels[0].width;
+        header.dwHeight = texture.levels[0].height;
+        header.dwPitchOrLinearSize = (unsigned int)texture.levels[0].size;
+        header.dwMipMapCount = (unsigned int)texture.levels.size();
+        header.sPixelFormat.dwSize = 32;
+        header.sPixelFormat.dwFlags = DDPF_FOURCC;
+        if (texture.format == GL_COMPRESSED_RG_RGTC2)
+            header.sPixelFormat.dwFourCC = FourCC('A', 'T', 'I', '2');
+        else if (texture.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            header.sPixelFormat.dwFourCC = FourCC('D', 'X', 'T', '5');
+        else
+            header.sPixelFormat.dwFourCC = FourCC('D', 'X', 'T', '1');
+        header.sCaps.dwCaps1 = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+        // write to a temporary first so a concurrent reader never sees half a file
+        std::string tempPath = path + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary);
+            if (!file)
+                return false;
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(texture.data.data()), texture.data.size());
+            if (!file)
+                return false;
+        }
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        return !error;
+    }
+
+    static bool ReadDDS(const std::string& path, CompressedTexture& out)
+    {
+        std::ifstream file(path, std::ios::binary);
+        DDS_header header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.dwMagic != FourCC('D', 'D', 'S', ' '))
+            return false;
+
+        unsigned int fourCC = header.sPixelFormat.dwFourCC;
+        if (fourCC == FourCC('D', 'X', 'T', '1'))
+            out.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        else if (fourCC == FourCC('D', 'X', 'T', '5'))
+            out.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        else if (fourCC == FourCC('A', 'T', 'I', '2'))
+            out.format = GL_COMPRESSED_RG_RGTC2;
+        else
+            return false;
+
+        out.levels.clear();
+        int width = header.dwWidth, height = header.dwHeight;
+        size_t offset = 0;
+        unsigned int levelCount = std::max(1u, header.dwMipMapCount);
+        for (unsigned int i = 0; i < levelCount; i++)
+        {
+            CompressedTexture::Level level;
+            level.width = width;
+            level.height = height;
+            level.offset = offset;
+            level.size = (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(out.format);
+            out.levels.push_back(level);
+            offset += level.size;
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+
+        out.data.resize(offset);
+        return (bool)file.read(reinterpret_cast<char*>(out.data.data()), offset);
+    }
+};
+#endif
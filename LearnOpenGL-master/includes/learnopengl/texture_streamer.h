@@ -0,0 +1,633 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/thread_pool.h>
+#include <learnopengl/mipmap.h>
+#include <learnopengl/gl_resource.h>
+#include <learnopengl/texture_cooker.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Streams textures in the background: image files are decoded on a ThreadPool and the
+// decoded pixels are copied to the GPU through a ring of pixel-unpack buffer memory that
+// is guarded by fences. Request() hands out a texture id immediately; it holds a 1x1
+// placeholder until Update() (called once per frame on the GL thread) replaces it with
+// the real image, so a model can be drawn while its textures are still loading.
+// The workers also build the mip chain (MipGenerator), the GL thread only copies levels.
+// With a TextureCooker the workers load (or cook) block compressed mip chains instead and
+// they are uploaded with glCompressedTexImage2D, skipping glGenerateMipmap.
+// For the ResidencyManager, Trim() and Evict() read the chain back before dropping it and
+// park it in a small LRU in system memory, so bringing the texture back is an upload
+// instead of another decode of the file.
+class TextureStreamer
+{
+public:
+    // stagingSize is the size of the pixel-unpack ring in bytes. Images larger than the
+    // ring are uploaded straight from client memory. mipSettings.srgb and normalMap are set
+    // per request from its usage. parkingSize bounds the system memory kept for trimmed and
+    // evicted textures, 0 disables parking.
+    TextureStreamer(ThreadPool& pool, size_t stagingSize = 64 * 1024 * 1024, const TextureCooker* cooker = nullptr,
+        MipSettings mipSettings = MipSettings(), size_t parkingSize = 64 * 1024 * 1024)
+        : m_Pool(pool), m_Cooker(cooker), m_MipSettings(mipSettings), m_StagingSize(stagingSize), m_ParkingSize(parkingSize)
+    {
+        // persistent mapping needs GL 4.4 / ARB_buffer_storage, otherwise each copy maps
+        // its own (unsynchronized) range of the ring.
+        m_Persistent = GLAD_GL_VERSION_4_4 != 0;
+        // without S3TC only normal maps (BC5) come from the cooker
+        m_S3tc = m_Cooker && TextureCooker::IsS3tcSupported();
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        m_PBO = CreateBuffer(GL_PIXEL_UNPACK_BUFFER, m_StagingSize, NULL, GpuCategory::Staging, m_Persistent ? flags : GL_MAP_WRITE_BIT);
+        if (m_Persistent)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PBO.Get());
+            m_Mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, m_StagingSize, flags));
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // needs the GL context that created the streamer to be current.
+    ~TextureStreamer()
+    {
+        // decode jobs reference this object, wait for them before tearing down
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_DecodeDone.wait(lock, [this] { return m_Decoding == 0; });
+        }
+        for (InFlightRange& range : m_InFlight)
+            glDeleteSync(range.fence);
+
+        if (m_Mapped)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PBO.Get());
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    // creates the texture object with a placeholder image and queues the file for decoding.
+    // usage picks the mip filtering (sRGB only for colors, renormalized normal maps) and, with
+    // a cooker, two channel compression for normal maps.
+    // must be called on the GL thread.
+    unsigned int Request(const std::string& filename, TextureUsage usage = TextureUsage::Linear)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        const unsigned char placeholder[4] = { 255, 255, 255, 255 };
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        GpuMemoryTracker::Instance().Track(GL_TEXTURE, textureID, GpuCategory::Texture, sizeof(placeholder));
+
+        // the id may belong to a texture that was deleted without Forget()
+        Forget(textureID);
+        Reload(textureID, filename, usage);
+        return textureID;
+    }
+
+    // queues the file for decoding into an existing texture; the id stays valid throughout.
+    // firstLevel skips the largest mip levels, e.g. 1 loads the image at half resolution.
+    // A parked copy of the texture is uploaded instead of decoding the file again. Supersedes
+    // any reload of the texture that is still in flight. must be called on the GL thread.
+    void Reload(unsigned int textureID, const std::string& filename, TextureUsage usage = TextureUsage::Linear, int firstLevel = 0)
+    {
+        TextureState& state = m_States[textureID];
+        state.serial = ++m_Serial;
+        state.reloading = true;
+        state.path = filename;
+        state.usage = usage;
+        m_Pending++;
+
+        auto parked = m_Parked.find(textureID);
+        if (parked != m_Parked.end() && parked->second.image.path == filename && parked->second.usage == usage)
+        {
+            DecodedImage image = std::move(parked->second.image);
+            Unpark(textureID);
+            image.serial = state.serial;
+            if (image.isCompressed)
+                DropLevels(image.compressed, firstLevel);
+            else
+                DropLevels(image.mips, firstLevel);
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Decoded.push_back(std::move(image));
+            m_DecodeReady.notify_all();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Decoding++;
+        }
+        unsigned int serial = state.serial;
+        m_Pool.Enqueue([this, filename, textureID, usage, firstLevel, serial] { Decode(filename, textureID, usage, firstLevel, serial); });
+    }
+
+    // drops everything known about the texture before its id is deleted: its state, the parked
+    // copy, and decodes still in flight for it are discarded when they arrive. GL names are
+    // reused, so call it before glDeleteTextures. must be called on the GL thread.
+    void Forget(unsigned int textureID)
+    {
+        m_States.erase(textureID);
+        Unpark(textureID);
+    }
+
+    // true while a Reload() of the texture has not been uploaded yet
+    bool IsReloading(unsigned int textureID) const
+    {
+        auto state = m_States.find(textureID);
+        return state != m_States.end() && state->second.reloading;
+    }
+
+    // frees the texture's storage by shrinking it back to a 1x1 placeholder; the id stays valid.
+    // Every mip level is released, the image is parked first and a pending reload is dropped.
+    // must be called on the GL thread.
+    void Evict(unsigned int textureID)
+    {
+        TextureState& state = m_States[textureID];
+        if (state.uploaded)
+            Park(ReadBack(textureID, state), state.usage);
+        state.serial = ++m_Serial;
+        state.reloading = false;
+        state.uploaded = false;
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        const unsigned char placeholder[4] = { 255, 255, 255, 255 };
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        ClearLevels(state, 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        GpuMemoryTracker::Instance().Track(GL_TEXTURE, textureID, GpuCategory::Texture, sizeof(placeholder));
+    }
+
+    // drops the largest mip level right away, without touching the file: the smaller levels
+    // are read back and respecified. The full chain is parked for the next Reload(). Returns
+    // the bytes freed, 0 if the texture is down to one level or a reload is still in flight.
+    // must be called on the GL thread.
+    size_t Trim(unsigned int textureID)
+    {
+        auto found = m_States.find(textureID);
+        if (found == m_States.end() || found->second.reloading || !found->second.uploaded || found->second.levels < 2)
+            return 0;
+        TextureState& state = found->second;
+
+        size_t before = GpuMemoryTracker::Instance().GetObjectBytes(GL_TEXTURE, textureID);
+        DecodedImage image = ReadBack(textureID, state);
+        DecodedImage smaller = image;
+        Park(std::move(image), state.usage);
+        if (smaller.isCompressed)
+            DropLevels(smaller.compressed, 1);
+        else
+            DropLevels(smaller.mips, 1);
+        Upload(smaller, false);
+        size_t after = GpuMemoryTracker::Instance().GetObjectBytes(GL_TEXTURE, textureID);
+        return before > after ? before - after : 0;
+    }
+
+    // uploads as many decoded images as fit in the free part of the staging ring.
+    // call once per frame on the GL thread.
+    void Update()
+    {
+        RetireRanges(false);
+
+        std::deque<DecodedImage> ready;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            ready.swap(m_Decoded);
+        }
+
+        while (!ready.empty())
+        {
+            DecodedImage& image = ready.front();
+            // superseded by a later Reload() or Evict(), or the texture was forgotten
+            auto state = m_States.find(image.textureID);
+            bool stale = state == m_States.end() || state->second.serial != image.serial;
+            if (!stale && !Upload(image))
+                break;
+            ready.pop_front();
+            m_Pending--;
+        }
+
+        // whatever did not fit goes back to the front of the queue for the next frame
+        if (!ready.empty())
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Decoded.insert(m_Decoded.begin(), ready.begin(), ready.end());
+        }
+    }
+
+    // blocks until every requested texture has been uploaded.
+    void Flush()
+    {
+        while (m_Pending > 0)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_DecodeReady.wait(lock, [this] { return !m_Decoded.empty() || m_Decoding == 0; });
+            }
+            Update();
+            if (m_Pending > 0)
+                RetireRanges(true);
+        }
+    }
+
+    // number of requested textures that are still showing their placeholder.
+    unsigned int GetPendingCount() const { return m_Pending; }
+
+private:
+    struct DecodedImage
+    {
+        unsigned int textureID;
+        unsigned int serial;
+        std::string path;
+        MipChain mips;     // empty if the file failed to load
+        bool isCompressed;
+        CompressedTexture compressed;
+    };
+
+    // what the GL thread knows about a texture it streams into
+    struct TextureState
+    {
+        unsigned int serial = 0;    // of the latest Reload() or Evict(), other images are dropped
+        bool reloading = false;
+        bool uploaded = false;      // holds a real image, not the placeholder
+        std::string path;
+        TextureUsage usage = TextureUsage::Linear;
+        bool isCompressed = false;
+        GLenum format = GL_RGBA;    // pixel format, or the compressed internal format
+        int channels = 4;
+        int levels = 1;             // mip levels with storage
+    };
+
+    struct ParkedImage
+    {
+        DecodedImage image;
+        TextureUsage usage;
+        std::list<unsigned int>::iterator lruPosition;
+    };
+
+    struct InFlightRange
+    {
+        GLsync fence;
+        size_t begin, end;
+    };
+
+    ThreadPool& m_Pool;
+    const TextureCooker* m_Cooker;
+    bool m_S3tc = false;
+    MipSettings m_MipSettings;
+    GLBuffer m_PBO;
+    size_t m_StagingSize;
+    size_t m_Head = 0;
+    bool m_Persistent = false;
+    unsigned char* m_Mapped = nullptr;
+    std::deque<InFlightRange> m_InFlight;
+
+    // GL thread only
+    std::unordered_map<unsigned int, TextureState> m_States;
+    unsigned int m_Serial = 0;      // last serial handed out, never reused across ids
+    std::unordered_map<unsigned int, ParkedImage> m_Parked;
+    std::list<unsigned int> m_ParkedLru;    // most recently parked at the front
+    size_t m_ParkingSize;
+    size_t m_ParkedBytes = 0;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_DecodeReady;
+    std::condition_variable m_DecodeDone;
+    std::deque<DecodedImage> m_Decoded;
+    unsigned int m_Decoding = 0;
+    std::atomic<unsigned int> m_Pending{ 0 };
+
+    // runs on a worker thread
+    void Decode(const std::string& filename, unsigned int textureID, TextureUsage usage, int firstLevel, unsigned int serial)
+    {
+        DecodedImage image;
+        image.textureID = textureID;
+        image.serial = serial;
+        image.path = filename;
+        image.isCompressed = m_Cooker && (usage == TextureUsage::NormalMap || m_S3tc) && m_Cooker->Load(filename, usage, image.compressed);
+        if (!image.isCompressed)
+        {
+            int width, height, nrComponents;
+            unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+            if (data)
+            {
+                image.mips = MipGenerator::Generate(data, width, height, nrComponents, m_MipSettings.ForUsage(usage));
+                stbi_image_free(data);
+            }
+        }
+        if (image.isCompressed)
+            DropLevels(image.compressed, firstLevel);
+        else
+            DropLevels(image.mips, firstLevel);
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Decoded.push_back(std::move(image));
+        m_Decoding--;
+        m_DecodeReady.notify_all();
+        if (m_Decoding == 0)
+            m_DecodeDone.notify_all();
+    }
+
+    // removes the count largest levels, the smallest one is always kept
+    template <typename Chain>
+    static void DropLevels(Chain& chain, int count)
+    {
+        count = std::min(count, (int)chain.levels.size() - 1);
+        if (count <= 0)
+            return;
+        size_t skipped = chain.levels[count].offset;
+        chain.data.erase(chain.data.begin(), chain.data.begin() + skipped);
+        chain.levels.erase(chain.levels.begin(), chain.levels.begin() + count);
+        for (auto& level : chain.levels)
+            level.offset -= skipped;
+    }
+
+    template <typename Chain>
+    static unsigned char* AppendLevel(Chain& chain, int width, int height, size_t size)
+    {
+        typename Chain::Level level;
+        level.width = width;
+        level.height = height;
+        level.offset = chain.data.size();
+        level.size = size;
+        chain.levels.push_back(level);
+        chain.data.resize(level.offset + size);
+        return chain.data.data() + level.offset;
+    }
+
+    // copies the texture's mip chain back from the GPU (stalls until it is rendered)
+    static DecodedImage ReadBack(unsigned int textureID, const TextureState& state)
+    {
+        DecodedImage image;
+        image.textureID = textureID;
+        image.serial = state.serial;
+        image.path = state.path;
+        image.isCompressed = state.isCompressed;
+        image.compressed.format = state.format;
+        image.mips.channels = state.channels;
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        for (int i = 0; i < state.levels; i++)
+        {
+            GLint width = 0, height = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_HEIGHT, &height);
+            if (state.isCompressed)
+            {
+                GLint size = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                glGetCompressedTexImage(GL_TEXTURE_2D, i, AppendLevel(image.compressed, width, height, size));
+            }
+            else
+            {
+                size_t size = (size_t)width * height * state.channels;
+                glGetTexImage(GL_TEXTURE_2D, i, state.format, GL_UNSIGNED_BYTE, AppendLevel(image.mips, width, height, size));
+            }
+        }
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return image;
+    }
+
+    // releases the storage of the levels from `from` on that are left over from a larger
+    // chain, the texture keeps `from` levels. expects the texture to be bound.
+    static void ClearLevels(TextureState& state, int from)
+    {
+        for (int i = from; i < state.levels; i++)
+            glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        state.levels = from;
+    }
+
+    static size_t ImageBytes(const DecodedImage& image)
+    {
+        return image.isCompressed ? image.compressed.data.size() : image.mips.data.size();
+    }
+
+    // keeps image for the next Reload() of its texture, unless a larger copy is already
+    // parked. The oldest images make room.
+    void Park(DecodedImage image, TextureUsage usage)
+    {
+        size_t bytes = ImageBytes(image);
+        if (bytes > m_ParkingSize)
+            return;
+        auto known = m_Parked.find(image.textureID);
+        if (known != m_Parked.end())
+        {
+            if (ImageBytes(known->second.image) >= bytes)
+                return;
+            Unpark(image.textureID);
+        }
+        while (m_ParkedBytes + bytes > m_ParkingSize)
+            Unpark(m_ParkedLru.back());
+
+        unsigned int textureID = image.textureID;
+        m_ParkedLru.push_front(textureID);
+        ParkedImage& parked = m_Parked[textureID];
+        parked.image = std::move(image);
+        parked.usage = usage;
+        parked.lruPosition = m_ParkedLru.begin();
+        m_ParkedBytes += bytes;
+    }
+
+    void Unpark(unsigned int textureID)
+    {
+        auto parked = m_Parked.find(textureID);
+        if (parked == m_Parked.end())
+            return;
+        m_ParkedBytes -= ImageBytes(parked->second.image);
+        m_ParkedLru.erase(parked->second.lruPosition);
+        m_Parked.erase(parked);
+    }
+
+    // frees staging ranges whose copies the GPU has finished. Ranges retire in order.
+    void RetireRanges(bool wait)
+    {
+        while (!m_InFlight.empty())
+        {
+            GLbitfield flags = wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0;
+            GLuint64 timeout = wait ? 1000000000ull : 0;
+            GLenum status = glClientWaitSync(m_InFlight.front().fence, flags, timeout);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                return;
+            glDeleteSync(m_InFlight.front().fence);
+            m_InFlight.pop_front();
+            if (wait)
+                return;
+        }
+    }
+
+    // finds size bytes in the ring that no in-flight copy is reading from.
+    bool Allocate(size_t size, size_t& offset)
+    {
+        size_t begin = m_Head;
+        if (begin + size > m_StagingSize)
+            begin = 0;
+        for (const InFlightRange& range : m_InFlight)
+        {
+            if (begin < range.end && range.begin < begin + size)
+                return false;
+        }
+        offset = begin;
+        m_Head = begin + size;
+        return true;
+    }
+
+    // returns false if the staging ring is full; the image is retried next frame.
+    // without allowStaging the levels are copied straight from client memory.
+    bool Upload(const DecodedImage& image, bool allowStaging = true)
+    {
+        TextureState& state = m_States[image.textureID];
+        if (image.isCompressed)
+        {
+            if (!UploadCompressed(image.textureID, image.compressed, state, allowStaging))
+                return false;
+            state.reloading = false;
+            state.uploaded = true;
+            state.isCompressed = true;
+            state.format = image.compressed.format;
+            return true;
+        }
+        const MipChain& mips = image.mips;
+        if (mips.levels.empty())
+        {
+            std::cout << "Texture failed to load at path: " << image.path << std::endl;
+            state.reloading = false;
+            return true;
+        }
+
+        GLenum format = GL_RGBA;
+        if (mips.channels == 1)
+            format = GL_RED;
+        else if (mips.channels == 2)
+            format = GL_RG;
+        else if (mips.channels == 3)
+            format = GL_RGB;
+
+        // like compressed images the whole chain goes through the ring in one piece
+        size_t size = mips.data.size();
+        const unsigned char* base = mips.data.data();
+        bool staged = allowStaging && size <= m_StagingSize;
+        size_t offset = 0;
+        if (staged)
+        {
+            if (!Allocate(size, offset))
+                return false;
+            Stage(offset, mips.data.data(), size);
+            base = reinterpret_cast<const unsigned char*>(offset);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, image.textureID);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t i = 0; i < mips.levels.size(); i++)
+        {
+            const MipChain::Level& level = mips.levels[i];
+            glTexImage2D(GL_TEXTURE_2D, (GLint)i, format, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, base + level.offset);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        if (staged)
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        ClearLevels(state, (int)mips.levels.size());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)mips.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        GpuMemoryTracker::Instance().Track(GL_TEXTURE, image.textureID, GpuCategory::Texture,
+            TextureBytes(format, mips.levels[0].width, mips.levels[0].height, (int)mips.levels.size()));
+
+        if (staged)
+            FenceRange(offset, size);
+        state.reloading = false;
+        state.uploaded = true;
+        state.isCompressed = false;
+        state.format = format;
+        state.channels = mips.channels;
+        return true;
+    }
+
+    // cooked chains are staged the same way
+    bool UploadCompressed(unsigned int textureID, const CompressedTexture& texture, TextureState& state, bool allowStaging)
+    {
+        size_t size = texture.data.size();
+        const unsigned char* base = texture.data.data();
+        bool staged = allowStaging && size <= m_StagingSize;
+        size_t offset = 0;
+        if (staged)
+        {
+            if (!Allocate(size, offset))
+                return false;
+            Stage(offset, texture.data.data(), size);
+            base = reinterpret_cast<const unsigned char*>(offset);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        for (size_t i = 0; i < texture.levels.size(); i++)
+        {
+            const CompressedTexture::Level& level = texture.levels[i];
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, texture.format, level.width, level.height, 0,
+                (GLsizei)level.size, base + level.offset);
+        }
+        if (staged)
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        ClearLevels(state, (int)texture.levels.size());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        GpuMemoryTracker::Instance().Track(GL_TEXTURE, textureID, GpuCategory::Texture, texture.data.size());
+
+        if (staged)
+            FenceRange(offset, size);
+        return true;
+    }
+
+    // copies into the ring and leaves the ring bound as GL_PIXEL_UNPACK_BUFFER
+    void Stage(size_t offset, const void* data, size_t size)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_PBO.Get());
+        if (m_Persistent)
+            std::memcpy(m_Mapped + offset, data, size);
+        else
+        {
+            void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            std::memcpy(dst, data, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+    }
+
+    // unbinds the ring and protects the range until the GPU has consumed it
+    void FenceRange(size_t offset, size_t size)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        InFlightRange range;
+        range.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        range.begin = offset;
+        range.end = offset + size;
+        m_InFlight.push_back(range);
+    }
+};
+#endif
@@ -0,0 +1,87 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// fixed size pool of worker threads consuming a FIFO job queue.
+// jobs must not touch OpenGL: there is no context current on the workers.
+class ThreadPool
+{
+public:
+    // a thread count of 0 picks one worker per hardware thread.
+    explicit ThreadPool(unsigned int numThreads = 0)
+    {
+        if (numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        m_Workers.reserve(numThreads);
+        for (unsigned int i = 0; i < numThreads; i++)
+            m_Workers.emplace_back([this] { WorkerLoop(); });
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // finishes all queued jobs before joining the workers.
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stop = true;
+        }
+        m_Condition.notify_all();
+        for (std::thread& worker : m_Workers)
+            worker.join();
+    }
+
+    // queues a job and returns a future for its result.
+    template<typename F>
+    auto Enqueue(F&& job) -> std::future<typename std::invoke_result<F>::type>
+    {
+        using Result = typename std::invoke_result<F>::type;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Jobs.emplace([task] { (*task)(); });
+        }
+        m_Condition.notify_one();
+        return result;
+    }
+
+    unsigned int GetThreadCount() const { return static_cast<unsigned int>(m_Workers.size()); }
+
+private:
+    std::vector<std::thread> m_Workers;
+    std::queue<std::function<void()>> m_Jobs;
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    bool m_Stop = false;
+
+    void WorkerLoop()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Condition.wait(lock, [this] { return m_Stop || !m_Jobs.empty(); });
+                if (m_Stop && m_Jobs.empty())
+                    return;
+                job = std::move(m_Jobs.front());
+                m_Jobs.pop();
+            }
+            job();
+        }
+    }
+};
+#endif
@@ -0,0 +1,343 @@
+#ifndef TRANSFORM_SYSTEM_H
+#define TRANSFORM_SYSTEM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
+#include <future>
+#include <vector>
+#include <learnopengl/thread_pool.h>
+#include <learnopengl/simd.h>
+
+// rotation of Transform's euler angles (degrees), applied Y * X * Z
+inline glm::quat eulerToQuat(const glm::vec3& degrees)
+{
+	const glm::quat x = glm::angleAxis(glm::radians(degrees.x), glm::vec3(1.0f, 0.0f, 0.0f));
+	const glm::quat y = glm::angleAxis(glm::radians(degrees.y), glm::vec3(0.0f, 1.0f, 0.0f));
+	const glm::quat z = glm::angleAxis(glm::radians(degrees.z), glm::vec3(0.0f, 0.0f, 1.0f));
+	return y * x * z;
+}
+
+// parent * (translation * rotation * scale), the rotation straight from the quaternion and
+// the product with the parent as four column combinations; parent may be null for roots
+inline void composeWorldMatrix(const glm::mat4* parent, const glm::vec3& t, const glm::quat& q, const glm::vec3& s, glm::mat4& out)
+{
+	const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+	const glm::vec3 right = glm::vec3(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy)) * s.x;
+	const glm::vec3 up = glm::vec3(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx)) * s.y;
+	const glm::vec3 back = glm::vec3(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy)) * s.z;
+	if (!parent)
+	{
+		out[0] = glm::vec4(right, 0.0f);
+		out[1] = glm::vec4(up, 0.0f);
+		out[2] = glm::vec4(back, 0.0f);
+		out[3] = glm::vec4(t, 1.0f);
+		return;
+	}
+#ifdef SIMD_SSE2
+	const float* p = &(*parent)[0][0];
+	const __m128 p0 = _mm_loadu_ps(p), p1 = _mm_loadu_ps(p + 4), p2 = _mm_loadu_ps(p + 8), p3 = _mm_loadu_ps(p + 12);
+	float* o = &out[0][0];
+	_mm_storeu_ps(o, _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(right.x)), _mm_mul_ps(p1, _mm_set1_ps(right.y))), _mm_mul_ps(p2, _mm_set1_ps(right.z))));
+	_mm_storeu_ps(o + 4, _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(up.x)), _mm_mul_ps(p1, _mm_set1_ps(up.y))), _mm_mul_ps(p2, _mm_set1_ps(up.z))));
+	_mm_storeu_ps(o + 8, _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(back.x)), _mm_mul_ps(p1, _mm_set1_ps(back.y))), _mm_mul_ps(p2, _mm_set1_ps(back.z))));
+	_mm_storeu_ps(o + 12, _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(t.x)), _mm_mul_ps(p1, _mm_set1_ps(t.y))), _mm_add_ps(_mm_mul_ps(p2, _mm_set1_ps(t.z)), p3)));
+#else
+	const glm::mat4& m = *parent;
+	out[0] = m[0] * right.x + m[1] * right.y + m[2] * right.z;
+	out[1] = m[0] * up.x + m[1] * up.y + m[2] * up.z;
+	out[2] = m[0] * back.x + m[1] * back.y + m[2] * back.z;
+	out[3] = m[0] * t.x + m[1] * t.y + m[2] * t.z + m[3];
+#endif
+}
+
+// Transforms of a whole scene as parallel arrays (position, quaternion rotation, scale,
+// parent, world matrix), sorted by depth in the hierarchy so every parent comes before its
+// children. Update() recomputes the world matrices in one forward pass, level by level, with
+// the levels split across a ThreadPool when they are big enough; it starts at the first
+// transform changed since the last update and skips everything that didn't change since.
+// Transforms are referred to by handles, which stay valid while the arrays get sorted.
+// Creating, destroying and reparenting only mark the order stale; it is rebuilt once, by
+// the next Update().
+class TransformSystem
+{
+public:
+	typedef unsigned int Handle;
+	static constexpr Handle Invalid = ~0u;
+
+	// without a pool everything runs on the calling thread
+	explicit TransformSystem(ThreadPool* pool = nullptr) : m_Pool(pool) {}
+
+	TransformSystem(const TransformSystem&) = delete;
+	TransformSystem& operator=(const TransformSystem&) = delete;
+
+	Handle Create(Handle parent = Invalid)
+	{
+		Handle handle;
+		if (!m_FreeHandles.empty())
+		{
+			handle = m_FreeHandles.back();
+			m_FreeHandles.pop_back();
+		}
+		else
+		{
+			handle = (Handle)m_Index.size();
+			m_Index.push_back(0);
+		}
+		unsigned int index = (unsigned int)m_Handles.size();
+		m_Index[handle] = index;
+		m_Handles.push_back(handle);
+		m_Positions.push_back(glm::vec3(0.0f));
+		m_Rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		m_Scales.push_back(glm::vec3(1.0f));
+		m_Parents.push_back(parent == Invalid ? -1 : (int)m_Index[parent]);
+		m_World.push_back(glm::mat4(1.0f));
+		m_Dirty.push_back(1);
+		m_Removed.push_back(0);
+		m_UpdatedFrame.push_back(0);
+		MarkDirty(index);
+		m_Unsorted = true;
+		return handle;
+	}
+
+	// destroys handle and all its descendants
+	void Destroy(Handle handle)
+	{
+		m_Removed[m_Index[handle]] = 1;
+		m_Unsorted = true;
+	}
+
+	// false (and nothing changes) when parent is handle or one of its descendants
+	bool SetParent(Handle handle, Handle parent)
+	{
+		unsigned int index = m_Index[handle];
+		int parentIndex = parent == Invalid ? -1 : (int)m_Index[parent];
+		for (int ancestor = parentIndex; ancestor >= 0; ancestor = m_Parents[ancestor])
+		{
+			if (ancestor == (int)index)
+				return false;
+		}
+		m_Parents[index] = parentIndex;
+		MarkDirty(index);
+		m_Unsorted = true;
+		return true;
+	}
+
+	Handle GetParent(Handle handle) const
+	{
+		int parent = m_Parents[m_Index[handle]];
+		return parent >= 0 ? m_Handles[parent] : Invalid;
+	}
+
+	void SetLocalPosition(Handle handle, const glm::vec3& position) { m_Positions[Touch(handle)] = position; }
+	void SetLocalRotation(Handle handle, const glm::quat& rotation) { m_Rotations[Touch(handle)] = rotation; }
+	// degrees, the convention of Transform
+	void SetLocalEulerRotation(Handle handle, const glm::vec3& degrees) { m_Rotations[Touch(handle)] = eulerToQuat(degrees); }
+	void SetLocalScale(Handle handle, const glm::vec3& scale) { m_Scales[Touch(handle)] = scale; }
+
+	const glm::vec3& GetLocalPosition(Handle handle) const { return m_Positions[m_Index[handle]]; }
+	const glm::quat& GetLocalRotation(Handle handle) const { return m_Rotations[m_Index[handle]]; }
+	const glm::vec3& GetLocalScale(Handle handle) const { return m_Scales[m_Index[handle]]; }
+	// as of the last Update()
+	const glm::mat4& GetWorldMatrix(Handle handle) const { return m_World[m_Index[handle]]; }
+	// whether the last Update() recomputed handle's world matrix
+	bool WasUpdated(Handle handle) const { return m_UpdatedFrame[m_Index[handle]] == m_Frame; }
+
+	// recomputes the world matrices of every transform that changed, or whose parent's did
+	void Update()
+	{
+		m_Frame++;
+		if (m_Unsorted)
+			Sort();
+		if (m_DirtyBegin >= m_Handles.size())
+			return;
+
+		unsigned int level = 0;
+		while (m_LevelEnds[level] <= m_DirtyBegin)
+			level++;
+		unsigned int begin = m_DirtyBegin;
+		for (; level < m_LevelEnds.size(); level++)
+		{
+			unsigned int end = m_LevelEnds[level];
+			UpdateLevel(begin, end);
+			begin = end;
+		}
+		m_DirtyBegin = Invalid;
+	}
+
+	unsigned int GetCount() const { return (unsigned int)m_Handles.size(); }
+	unsigned int GetLevelCount() const { return (unsigned int)m_LevelEnds.size(); }
+	// world matrices in depth order, e.g. for uploading them all at once
+	const glm::mat4* GetWorldMatrices() const { return m_World.data(); }
+
+private:
+	// levels smaller than this run on one thread
+	static const unsigned int MinParallelLevel = 4096;
+
+	ThreadPool* m_Pool;
+
+	// by position in depth order
+	std::vector<glm::vec3> m_Positions;
+	std::vector<glm::quat> m_Rotations;
+	std::vector<glm::vec3> m_Scales;
+	std::vector<int> m_Parents;	// -1 for roots
+	std::vector<glm::mat4> m_World;
+	std::vector<uint8_t> m_Dirty;	// local transform changed since the last update
+	std::vector<uint8_t> m_Removed;	// destroyed, dropped by the next sort
+	std::vector<uint32_t> m_UpdatedFrame;	// value of m_Frame when the world matrix was last computed
+	std::vector<Handle> m_Handles;
+
+	std::vector<unsigned int> m_Index;	// by handle
+	std::vector<Handle> m_FreeHandles;
+	std::vector<unsigned int> m_LevelEnds;	// one past the last transform of every depth
+	unsigned int m_DirtyBegin = Invalid;	// first dirty transform
+	uint32_t m_Frame = 0;
+	bool m_Unsorted = false;
+	std::vector<std::future<void>> m_Jobs;
+
+	void MarkDirty(unsigned int index)
+	{
+		m_Dirty[index] = 1;
+		if (index < m_DirtyBegin)
+			m_DirtyBegin = index;
+	}
+
+	unsigned int Touch(Handle handle)
+	{
+		unsigned int index = m_Index[handle];
+		MarkDirty(index);
+		return index;
+	}
+
+	void UpdateLevel(unsigned int begin, unsigned int end)
+	{
+		unsigned int count = end - begin;
+		unsigned int chunks = m_Pool ? std::min(m_Pool->GetThreadCount() + 1, count / (MinParallelLevel / 2)) : 1;
+		if (chunks <= 1)
+		{
+			UpdateRange(begin, end);
+			return;
+		}
+		unsigned int chunkSize = (count + chunks - 1) / chunks;
+		m_Jobs.clear();
+		for (unsigned int first = begin + chunkSize; first < end; first += chunkSize)
+		{
+			unsigned int last = std::min(first + chunkSize, end);
+			m_Jobs.push_back(m_Pool->Enqueue([this, first, last] { UpdateRange(first, last); }));
+		}
+		UpdateRange(begin, begin + chunkSize);
+		for (std::future<void>& job : m_Jobs)
+			job.wait();
+	}
+
+	// parents are on earlier levels, which are finished
+	void UpdateRange(unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			int parent = m_Parents[i];
+			bool parentUpdated = parent >= 0 && m_UpdatedFrame[parent] == m_Frame;
+			if (!m_Dirty[i] && !parentUpdated)
+				continue;
+			composeWorldMatrix(parent >= 0 ? &m_World[parent] : nullptr, m_Positions[i], m_Rotations[i], m_Scales[i], m_World[i]);
+			m_Dirty[i] = 0;
+			m_UpdatedFrame[i] = m_Frame;
+		}
+	}
+
+	// drops destroyed subtrees and restores the depth order with a counting sort, which
+	// keeps the relative order of the transforms on every level
+	void Sort()
+	{
+		unsigned int count = (unsigned int)m_Handles.size();
+		std::vector<int> depth(count, -1);
+		std::vector<unsigned int> chain;
+		unsigned int maxDepth = 0;
+		for (unsigned int i = 0; i < count; i++)
+		{
+			// walk up to a transform of known depth, then assign on the way back down
+			unsigned int node = i;
+			while (depth[node] < 0)
+			{
+				chain.push_back(node);
+				if (m_Parents[node] < 0)
+					break;
+				node = (unsigned int)m_Parents[node];
+			}
+			while (!chain.empty())
+			{
+				unsigned int child = chain.back();
+				chain.pop_back();
+				int parent = m_Parents[child];
+				depth[child] = parent >= 0 ? depth[parent] + 1 : 0;
+				if (parent >= 0 && m_Removed[parent])
+					m_Removed[child] = 1;
+				maxDepth = std::max(maxDepth, (unsigned int)depth[child]);
+			}
+		}
+
+		m_LevelEnds.assign(maxDepth + 1, 0);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (!m_Removed[i])
+				m_LevelEnds[depth[i]]++;
+		}
+		unsigned int total = 0;
+		std::vector<unsigned int> next(maxDepth + 1);
+		for (unsigned int level = 0; level <= maxDepth; level++)
+		{
+			next[level] = total;
+			total += m_LevelEnds[level];
+			m_LevelEnds[level] = total;
+		}
+
+		std::vector<unsigned int> order(count, Invalid);	// old position -> new
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (m_Removed[i])
+				m_FreeHandles.push_back(m_Handles[i]);
+			else
+				order[i] = next[depth[i]]++;
+		}
+		Permute(m_Positions, order, total);
+		Permute(m_Rotations, order, total);
+		Permute(m_Scales, order, total);
+		Permute(m_World, order, total);
+		Permute(m_Dirty, order, total);
+		Permute(m_Removed, order, total);
+		Permute(m_UpdatedFrame, order, total);
+		Permute(m_Handles, order, total);
+		std::vector<int> parents(total);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			if (order[i] != Invalid)
+				parents[order[i]] = m_Parents[i] >= 0 ? (int)order[m_Parents[i]] : -1;
+		}
+		m_Parents.swap(parents);
+		for (unsigned int i = 0; i < total; i++)
+			m_Index[m_Handles[i]] = i;
+
+		m_DirtyBegin = Invalid;
+		for (unsigned int i = 0; i < total && m_DirtyBegin == Invalid; i++)
+		{
+			if (m_Dirty[i])
+				m_DirtyBegin = i;
+		}
+		m_Unsorted = false;
+	}
+
+	template<typename T>
+	static void Permute(std::vector<T>& values, const std::vector<unsigned int>& order, unsigned int total)
+	{
+		std::vector<T> sorted(total);
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			if (order[i] != Invalid)
+				sorted[order[i]] = values[i];
+		}
+		values.swap(sorted);
+	}
+};
+#endif
@@ -0,0 +1,85 @@
+#version 330 core
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+layout(location = 2) in vec2 tex;
+layout(location = 3) in vec3 tangent;
+layout(location = 4) in vec3 bitangent;
+layout(location = 5) in ivec4 boneIds; 
+layout(location = 6) in vec4 weights;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform float time; // seconds
+
+// baked palettes, see BakedAnimationSet: one row per frame, three texels (matrix rows) per bone
+const int MAX_BAKED_CLIPS = 32;
+const int MAX_BONE_INFLUENCE = 4;
+uniform sampler2D bakedPalettes;
+uniform int bakedBoneCount;
+uniform vec4 bakedClips[MAX_BAKED_CLIPS]; // first row, segments, frames per second, loop
+
+// per instance, see BakedCrowd: model matrix columns, then clip / time offset / speed
+uniform samplerBuffer bakedInstances;
+
+out vec2 TexCoords;
+out vec3 FragPos;
+out vec3 Normal;
+
+// rows of the bone matrix, blended between the two frames around the instance's time
+void fetchBone(int id, int row0, int row1, float t, out vec4 r0, out vec4 r1, out vec4 r2)
+{
+    int x = id * 3;
+    r0 = mix(texelFetch(bakedPalettes, ivec2(x, row0), 0), texelFetch(bakedPalettes, ivec2(x, row1), 0), t);
+    r1 = mix(texelFetch(bakedPalettes, ivec2(x + 1, row0), 0), texelFetch(bakedPalettes, ivec2(x + 1, row1), 0), t);
+    r2 = mix(texelFetch(bakedPalettes, ivec2(x + 2, row0), 0), texelFetch(bakedPalettes, ivec2(x + 2, row1), 0), t);
+}
+
+void main()
+{
+    int base = gl_InstanceID * 5;
+    mat4 model = mat4(texelFetch(bakedInstances, base), texelFetch(bakedInstances, base + 1),
+                      texelFetch(bakedInstances, base + 2), texelFetch(bakedInstances, base + 3));
+    vec4 params = texelFetch(bakedInstances, base + 4);
+
+    vec4 clip = bakedClips[int(params.x)];
+    float frame = (time * params.z + params.y) * clip.z;
+    frame = clip.w > 0.5 ? mod(frame, clip.y) : clamp(frame, 0.0, clip.y);
+    int frame0 = min(int(frame), int(clip.y) - 1);
+    float t = frame - float(frame0);
+    int row0 = int(clip.x) + frame0;
+
+    vec3 skinnedPos = vec3(0.0);
+    vec3 skinnedNormal = vec3(0.0);
+    float totalWeight = 0.0;
+    vec4 p = vec4(pos, 1.0);
+    for (int i = 0; i < MAX_BONE_INFLUENCE; ++i)
+    {
+        int id = boneIds[i];
+        float w = weights[i];
+        if (w <= 0.0 || id < 0 || id >= bakedBoneCount) continue;
+
+        vec4 r0, r1, r2;
+        fetchBone(id, row0, row0 + 1, t, r0, r1, r2);
+        skinnedPos += vec3(dot(r0, p), dot(r1, p), dot(r2, p)) * w;
+        skinnedNormal += vec3(dot(r0.xyz, norm), dot(r1.xyz, norm), dot(r2.xyz, norm)) * w;
+        totalWeight += w;
+    }
+
+    if (totalWeight <= 0.0)
+    {
+        skinnedPos = pos;
+        skinnedNormal = norm;
+    }
+    else
+    {
+        skinnedPos /= totalWeight;
+        skinnedNormal /= totalWeight;
+    }
+
+    gl_Position = projection * view * model * vec4(skinnedPos, 1.0);
+
+    TexCoords = tex;
+    FragPos = vec3(model * vec4(skinnedPos, 1.0));
+    Normal = normalize(mat3(model) * skinnedNormal); // instances are scaled uniformly
+}
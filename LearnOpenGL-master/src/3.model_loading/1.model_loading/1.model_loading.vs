@@ -12,19 +12,61 @@ uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 model;
 
-const int MAX_BONES = 100;
 const int MAX_BONE_INFLUENCE = 4;
-uniform mat4 finalBonesMatrices[MAX_BONES];
+
+// bone palettes of every character in one texture buffer, see AnimationSystem::BindPalettes()
+const int PALETTE_MAT4 = 0;      // four texels (columns) per bone
+const int PALETTE_MAT3X4 = 1;    // three texels (rows)
+const int PALETTE_DUAL_QUAT = 2; // two texels (real and dual part), rigid transforms only
+uniform samplerBuffer bonePalettes;
+uniform int paletteFormat;
+uniform int paletteOffset; // first bone of this draw's palette
+uniform int paletteStride; // bones per instance for instanced draws
+uniform int paletteBones;  // bones per palette, ids beyond keep the bind pose
 
 out vec2 TexCoords;
 out vec3 FragPos;
 out vec3 Normal;
 
+int boneTexel(int id, int texelsPerBone)
+{
+    return (paletteOffset + gl_InstanceID * paletteStride + id) * texelsPerBone;
+}
+
+// rows of the bone matrix (the last row is always 0 0 0 1)
+void boneRows(int id, out vec4 r0, out vec4 r1, out vec4 r2)
+{
+    if (paletteFormat == PALETTE_MAT3X4)
+    {
+        int texel = boneTexel(id, 3);
+        r0 = texelFetch(bonePalettes, texel);
+        r1 = texelFetch(bonePalettes, texel + 1);
+        r2 = texelFetch(bonePalettes, texel + 2);
+    }
+    else
+    {
+        int texel = boneTexel(id, 4);
+        mat4 m = transpose(mat4(texelFetch(bonePalettes, texel), texelFetch(bonePalettes, texel + 1),
+                                texelFetch(bonePalettes, texel + 2), texelFetch(bonePalettes, texel + 3)));
+        r0 = m[0];
+        r1 = m[1];
+        r2 = m[2];
+    }
+}
+
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
 void main()
 {
-    vec4 skinnedPos = vec4(0.0);
-    vec3 skinnedNormal = vec3(0.0);
+    // linear blend of the matrix rows, or of the dual quaternions
+    vec4 r0 = vec4(0.0), r1 = vec4(0.0), r2 = vec4(0.0);
+    vec4 real = vec4(0.0), dual = vec4(0.0);
+    vec4 firstReal = vec4(0.0);
     float totalWeight = 0.0;
+    bool bindPose = false;
 
     for (int i = 0; i < MAX_BONE_INFLUENCE; ++i)
     {
@@ -32,34 +74,65 @@ void main()
         float w = weights[i];
         if (w <= 0.0 || id < 0) continue;
 
-        if (id >= MAX_BONES)
+        if (id >= paletteBones)
         {
-            skinnedPos = vec4(pos, 1.0);
-            skinnedNormal = norm;
-            totalWeight = 1.0;
+            bindPose = true;
             break;
         }
 
-        mat4 boneMat = finalBonesMatrices[id];
-        skinnedPos += boneMat * vec4(pos, 1.0) * w;
-        skinnedNormal += mat3(boneMat) * norm * w;
+        if (paletteFormat == PALETTE_DUAL_QUAT)
+        {
+            int texel = boneTexel(id, 2);
+            vec4 qr = texelFetch(bonePalettes, texel);
+            vec4 qd = texelFetch(bonePalettes, texel + 1);
+            // blend along the shortest arc
+            if (totalWeight == 0.0)
+                firstReal = qr;
+            float s = dot(firstReal, qr) < 0.0 ? -w : w;
+            real += qr * s;
+            dual += qd * s;
+        }
+        else
+        {
+            vec4 b0, b1, b2;
+            boneRows(id, b0, b1, b2);
+            r0 += b0 * w;
+            r1 += b1 * w;
+            r2 += b2 * w;
+        }
         totalWeight += w;
     }
 
-    if (totalWeight <= 0.0)
+    vec3 skinnedPos = pos;
+    vec3 skinnedNormal = norm;
+    if (!bindPose && totalWeight > 0.0)
     {
-        skinnedPos = vec4(pos, 1.0);
-        skinnedNormal = norm;
-    }
-    else if (abs(totalWeight - 1.0) > 1e-5)
-    {
-        skinnedPos /= totalWeight;
-        skinnedNormal /= totalWeight;
+        if (paletteFormat == PALETTE_DUAL_QUAT)
+        {
+            float len = length(real);
+            real /= len;
+            dual /= len;
+            vec3 translation = 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+            skinnedPos = rotate(real, pos) + translation;
+            skinnedNormal = rotate(real, norm);
+        }
+        else
+        {
+            float inv = 1.0 / totalWeight;
+            r0 *= inv;
+            r1 *= inv;
+            r2 *= inv;
+            vec4 p = vec4(pos, 1.0);
+            skinnedPos = vec3(dot(r0, p), dot(r1, p), dot(r2, p));
+            // cofactor matrix: the inverse transpose up to scale, right under non-uniform scale
+            vec3 c0 = vec3(r0.x, r1.x, r2.x), c1 = vec3(r0.y, r1.y, r2.y), c2 = vec3(r0.z, r1.z, r2.z);
+            skinnedNormal = mat3(cross(c1, c2), cross(c2, c0), cross(c0, c1)) * norm;
+        }
     }
 
-    gl_Position = projection * view * model * skinnedPos;
+    gl_Position = projection * view * model * vec4(skinnedPos, 1.0);
 
     TexCoords = tex;
-    FragPos = vec3(model * skinnedPos);
+    FragPos = vec3(model * vec4(skinnedPos, 1.0));
     Normal = normalize(mat3(transpose(inverse(model))) * skinnedNormal);
 }
@@ -0,0 +1,23 @@
+#version 330 core
+
+// characters skinned by 1.skinning.cs, drawn like static geometry (GpuSkinning::Draw())
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+layout(location = 2) in vec2 tex;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+out vec2 TexCoords;
+out vec3 FragPos;
+out vec3 Normal;
+
+void main()
+{
+    gl_Position = projection * view * model * vec4(pos, 1.0);
+
+    TexCoords = tex;
+    FragPos = vec3(model * vec4(pos, 1.0));
+    Normal = normalize(mat3(transpose(inverse(model))) * norm);
+}
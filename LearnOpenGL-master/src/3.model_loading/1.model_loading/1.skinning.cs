@@ -0,0 +1,146 @@
+#version 430 core
+
+// Skins one mesh of a character into a vertex buffer the draw passes read as static
+// geometry, see GpuSkinning. Blends like 1.model_loading.vs.
+layout(local_size_x = 64) in;
+
+const int MAX_BONE_INFLUENCE = 4;
+
+const int PALETTE_MAT4 = 0;      // four texels (columns) per bone
+const int PALETTE_MAT3X4 = 1;    // three texels (rows)
+const int PALETTE_DUAL_QUAT = 2; // two texels (real and dual part), rigid transforms only
+
+// every character's palette, AnimationSystem::BindPaletteStorage()
+layout(std430, binding = 0) readonly buffer Palettes { vec4 palettes[]; };
+// the mesh's vertex buffer, Vertex structs read as floats
+layout(std430, binding = 1) readonly buffer Vertices { float vertices[]; };
+// position and normal per vertex
+layout(std430, binding = 2) writeonly buffer Skinned { float skinned[]; };
+
+uniform int vertexCount;
+uniform int vertexStride; // floats per Vertex
+uniform int normalOffset; // in floats from the start of a Vertex
+uniform int boneIdOffset;
+uniform int weightOffset;
+
+uniform int paletteFormat;
+uniform int paletteOffset; // first bone of this character's palette
+uniform int paletteBones;  // bones per palette, ids beyond keep the bind pose
+
+vec3 readVec3(int index)
+{
+    return vec3(vertices[index], vertices[index + 1], vertices[index + 2]);
+}
+
+// rows of the bone matrix (the last row is always 0 0 0 1)
+void boneRows(int id, out vec4 r0, out vec4 r1, out vec4 r2)
+{
+    if (paletteFormat == PALETTE_MAT3X4)
+    {
+        int texel = (paletteOffset + id) * 3;
+        r0 = palettes[texel];
+        r1 = palettes[texel + 1];
+        r2 = palettes[texel + 2];
+    }
+    else
+    {
+        int texel = (paletteOffset + id) * 4;
+        mat4 m = transpose(mat4(palettes[texel], palettes[texel + 1], palettes[texel + 2], palettes[texel + 3]));
+        r0 = m[0];
+        r1 = m[1];
+        r2 = m[2];
+    }
+}
+
+vec3 rotate(vec4 q, vec3 v)
+{
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main()
+{
+    int vertex = int(gl_GlobalInvocationID.x);
+    if (vertex >= vertexCount)
+        return;
+
+    int base = vertex * vertexStride;
+    vec3 pos = readVec3(base);
+    vec3 norm = readVec3(base + normalOffset);
+
+    vec4 r0 = vec4(0.0), r1 = vec4(0.0), r2 = vec4(0.0);
+    vec4 real = vec4(0.0), dual = vec4(0.0);
+    vec4 firstReal = vec4(0.0);
+    float totalWeight = 0.0;
+    bool bindPose = false;
+
+    for (int i = 0; i < MAX_BONE_INFLUENCE; ++i)
+    {
+        int id = floatBitsToInt(vertices[base + boneIdOffset + i]);
+        float w = vertices[base + weightOffset + i];
+        if (w <= 0.0 || id < 0) continue;
+
+        if (id >= paletteBones)
+        {
+            bindPose = true;
+            break;
+        }
+
+        if (paletteFormat == PALETTE_DUAL_QUAT)
+        {
+            int texel = (paletteOffset + id) * 2;
+            vec4 qr = palettes[texel];
+            vec4 qd = palettes[texel + 1];
+            // blend along the shortest arc
+            if (totalWeight == 0.0)
+                firstReal = qr;
+            float s = dot(firstReal, qr) < 0.0 ? -w : w;
+            real += qr * s;
+            dual += qd * s;
+        }
+        else
+        {
+            vec4 b0, b1, b2;
+            boneRows(id, b0, b1, b2);
+            r0 += b0 * w;
+            r1 += b1 * w;
+            r2 += b2 * w;
+        }
+        totalWeight += w;
+    }
+
+    vec3 skinnedPos = pos;
+    vec3 skinnedNormal = norm;
+    if (!bindPose && totalWeight > 0.0)
+    {
+        if (paletteFormat == PALETTE_DUAL_QUAT)
+        {
+            float len = length(real);
+            real /= len;
+            dual /= len;
+            vec3 translation = 2.0 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+            skinnedPos = rotate(real, pos) + translation;
+            skinnedNormal = rotate(real, norm);
+        }
+        else
+        {
+            float inv = 1.0 / totalWeight;
+            r0 *= inv;
+            r1 *= inv;
+            r2 *= inv;
+            vec4 p = vec4(pos, 1.0);
+            skinnedPos = vec3(dot(r0, p), dot(r1, p), dot(r2, p));
+            // cofactor matrix: the inverse transpose up to scale, right under non-uniform scale
+            vec3 c0 = vec3(r0.x, r1.x, r2.x), c1 = vec3(r0.y, r1.y, r2.y), c2 = vec3(r0.z, r1.z, r2.z);
+            skinnedNormal = mat3(cross(c1, c2), cross(c2, c0), cross(c0, c1)) * norm;
+        }
+    }
+    skinnedNormal = normalize(skinnedNormal);
+
+    int dst = vertex * 6;
+    skinned[dst] = skinnedPos.x;
+    skinned[dst + 1] = skinnedPos.y;
+    skinned[dst + 2] = skinnedPos.z;
+    skinned[dst + 3] = skinnedNormal.x;
+    skinned[dst + 4] = skinnedNormal.y;
+    skinned[dst + 5] = skinnedNormal.z;
+}
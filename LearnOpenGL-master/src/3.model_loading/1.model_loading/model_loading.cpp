@@ -228,52 +228,55 @@ int main()
     }
 
     glEnable(GL_DEPTH_TEST);
-    Shader ourShader("1.model_loading.vs", "1.model_loading.fs");
+    // the shader owns its program, scoped so it is deleted while the context still exists
+    {
+        Shader ourShader("1.model_loading.vs", "1.model_loading.fs");
 
-    // === Initialize Game ===
-    std::fill(std::begin(chamber), std::end(chamber), false);
-    chamber[randomInt(0, 5)] = true;
-    currentChamber = 0;
-    gameMessage = "Player 1's turn";
-    updateHUD();
+        // === Initialize Game ===
+        std::fill(std::begin(chamber), std::end(chamber), false);
+        chamber[randomInt(0, 5)] = true;
+        currentChamber = 0;
+        gameMessage = "Player 1's turn";
+        updateHUD();
 
-    // --- Print Controls First ---
-    std::cout << "\n=== BULLET GAMBIT CONTROLS ===\n";
-    std::cout << "ESC .............. Exit Game\n";
-    std::cout << "L-Click .......... Shoot Opponent\n";
-    std::cout << "R-Click .......... Shoot Yourself (gain item if survive)\n";
-    std::cout << "1-4 .............. Use Item Slot\n";
-    std::cout << "R ................ Restart Game after Win\n";
-    std::cout << "=====================================\n\n";
+        // --- Print Controls First ---
+        std::cout << "\n=== BULLET GAMBIT CONTROLS ===\n";
+        std::cout << "ESC .............. Exit Game\n";
+        std::cout << "L-Click .......... Shoot Opponent\n";
+        std::cout << "R-Click .......... Shoot Yourself (gain item if survive)\n";
+        std::cout << "1-4 .............. Use Item Slot\n";
+        std::cout << "R ................ Restart Game after Win\n";
+        std::cout << "=====================================\n\n";
 
-    // --- THEN show player 1 items ---
-    printPlayerItems(true);
+        // --- THEN show player 1 items ---
+        printPlayerItems(true);
 
-    // === Game Loop ===
-    while (!glfwWindowShouldClose(g_window))
-    {
-        float currentFrame = (float)glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        // === Game Loop ===
+        while (!glfwWindowShouldClose(g_window))
+        {
+            float currentFrame = (float)glfwGetTime();
+            deltaTime = currentFrame - lastFrame;
+            lastFrame = currentFrame;
 
-        processInput(g_window);
+            processInput(g_window);
 
-        glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        ourShader.use();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),
-            (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
+            ourShader.use();
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),
+                (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
+            glm::mat4 view = camera.GetViewMatrix();
+            ourShader.setMat4("projection", projection);
+            ourShader.setMat4("view", view);
 
-        glm::mat4 model = glm::mat4(1.0f);
-        ourShader.setMat4("model", model);
-        renderCube();
+            glm::mat4 model = glm::mat4(1.0f);
+            ourShader.setMat4("model", model);
+            renderCube();
 
-        glfwSwapBuffers(g_window);
-        glfwPollEvents();
+            glfwSwapBuffers(g_window);
+            glfwPollEvents();
+        }
     }
 
     glfwTerminate();
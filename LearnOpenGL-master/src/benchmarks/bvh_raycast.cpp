@@ -0,0 +1,109 @@
+// Checks MeshBvh::Intersect() against a brute-force Moller-Trumbore loop over every triangle:
+// random rays (some with a max distance, and a count that leaves a partial packet) have to
+// report the same hits at the same distances, before and after a Refit() to moved vertices.
+// Exits with 1 on a mismatch.
+
+#include <learnopengl/bvh.h>
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static const float tolerance = 1e-4f;
+
+static RayHit BruteForce(const Ray& ray, const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices)
+{
+    RayHit hit;
+    for (size_t triangle = 0; triangle < indices.size() / 3; triangle++)
+    {
+        glm::vec3 a = positions[indices[triangle * 3]];
+        glm::vec3 edge1 = positions[indices[triangle * 3 + 1]] - a;
+        glm::vec3 edge2 = positions[indices[triangle * 3 + 2]] - a;
+        glm::vec3 p = glm::cross(ray.direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (std::abs(determinant) < 1e-12f)
+            continue;
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = ray.origin - a;
+        float u = glm::dot(s, p) * inverse;
+        glm::vec3 q = glm::cross(s, edge1);
+        float v = glm::dot(ray.direction, q) * inverse;
+        float t = glm::dot(edge2, q) * inverse;
+        if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < hit.distance && t <= ray.maxDistance)
+        {
+            hit.triangle = (int)triangle;
+            hit.distance = t;
+            hit.u = u;
+            hit.v = v;
+        }
+    }
+    return hit;
+}
+
+// number of rays whose BVH hit differs from the brute-force one
+static int CountMismatches(const MeshBvh& bvh, const std::vector<Ray>& rays, const std::vector<glm::vec3>& positions,
+    const std::vector<unsigned int>& indices, int& hitCount)
+{
+    std::vector<RayHit> hits(rays.size());
+    bvh.Intersect(rays.data(), hits.data(), rays.size(), 0);
+    int mismatches = 0;
+    hitCount = 0;
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+        RayHit expected = BruteForce(rays[i], positions, indices);
+        hitCount += expected.IsHit();
+        if (expected.IsHit() != hits[i].IsHit())
+            mismatches++;
+        else if (expected.IsHit() && (hits[i].mesh != 0 || std::abs(expected.distance - hits[i].distance) > tolerance))
+            mismatches++;
+        // a different triangle is only fine when it lies at the same distance
+        else if (expected.IsHit() && expected.triangle == hits[i].triangle &&
+            (std::abs(expected.u - hits[i].u) > tolerance || std::abs(expected.v - hits[i].v) > tolerance))
+            mismatches++;
+    }
+    return mismatches;
+}
+
+int main()
+{
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    // small triangles scattered through a box, half of them packed into its center
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+    for (int i = 0; i < 20000; i++)
+    {
+        glm::vec3 center = glm::vec3(unit(random), unit(random), unit(random)) * (i % 2 ? 2.0f : 10.0f);
+        for (int corner = 0; corner < 3; corner++)
+        {
+            positions.push_back(center + glm::vec3(unit(random), unit(random), unit(random)) * 0.3f);
+            indices.push_back((unsigned int)positions.size() - 1);
+        }
+    }
+    MeshBvh bvh;
+    bvh.Build(positions.data(), indices);
+
+    std::vector<Ray> rays(2003);
+    for (Ray& ray : rays)
+    {
+        ray.origin = glm::vec3(unit(random), unit(random), unit(random)) * 15.0f;
+        ray.direction = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)));
+        if (random() % 4 == 0)
+            ray.maxDistance = 5.0f;
+    }
+
+    int hitCount;
+    int built = CountMismatches(bvh, rays, positions, indices, hitCount);
+    printf("built    %zu nodes  %d of %zu rays hit  %d mismatches\n", bvh.GetNodeCount(), hitCount, rays.size(), built);
+
+    // moving the vertices apart changes the bounds the refit has to rebuild
+    for (glm::vec3& position : positions)
+        position = position * 1.5f + glm::vec3(3.0f, 0.0f, 0.0f);
+    bvh.Refit(positions.data());
+    int refit = CountMismatches(bvh, rays, positions, indices, hitCount);
+    printf("refitted %zu nodes  %d of %zu rays hit  %d mismatches\n", bvh.GetNodeCount(), hitCount, rays.size(), refit);
+
+    return built == 0 && refit == 0 && hitCount > 0 ? 0 : 1;
+}
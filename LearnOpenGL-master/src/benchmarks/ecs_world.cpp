@@ -0,0 +1,151 @@
+// Checks EcsWorld bookkeeping: components keep their values through ParallelEach(), deferred
+// destroys and adds and archetype moves, destructors run exactly once, and stale ids are
+// rejected. Then checks destroyModelEntity() takes the entities below the destroyed one with
+// it, so no live entity shares a TransformSystem node with a new one. Most useful in a build
+// with -fsanitize=address,undefined. Exits with 1 on a failure.
+
+#include <learnopengl/ecs_scene.h>
+#include <learnopengl/filesystem.h>
+
+#include <atomic>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+
+struct Position
+{
+    float x = 0.0f;
+};
+
+struct Velocity
+{
+    float x = 0.0f;
+};
+
+struct Name
+{
+    std::string text;
+};
+
+// counts live copies, so a destructor run twice or never shows up
+static std::atomic<int> liveTracked{ 0 };
+
+struct Tracked
+{
+    Tracked() { liveTracked++; }
+    Tracked(const Tracked&) { liveTracked++; }
+    Tracked(Tracked&&) noexcept { liveTracked++; }
+    ~Tracked() { liveTracked--; }
+};
+
+static bool Report(const char* name, int failures)
+{
+    printf("%-20s %d failures  %s\n", name, failures, failures == 0 ? "ok" : "FAILED");
+    return failures == 0;
+}
+
+static bool CheckWorld(ThreadPool& pool)
+{
+    const int count = 10000;
+    int failures = 0;
+    {
+        EcsWorld world;
+        std::vector<EntityId> entities;
+        for (int i = 0; i < count; i++)
+        {
+            if (i % 2)
+                entities.push_back(world.Create(Position{ (float)i }, Velocity{ 1.0f }));
+            else
+                entities.push_back(world.Create(Position{ (float)i }, Name{ std::to_string(i) }, Tracked()));
+        }
+        failures += liveTracked != count / 2;
+
+        world.ParallelEach<Position, Velocity>(pool, [](EntityId, Position& position, Velocity& velocity) { position.x += velocity.x; });
+
+        // destroy every entity at a multiple of 3, give the rest a velocity, from inside a query
+        EcsCommands commands;
+        world.Each<Position>([&](EntityId entity, Position& position)
+        {
+            if ((int)position.x % 3 == 0)
+                commands.Destroy(entity);
+            else if (!world.Has<Velocity>(entity))
+                commands.Add(entity, Velocity{ 2.0f });
+        });
+        world.Flush(commands);
+
+        int alive = 0;
+        for (int i = 0; i < count; i++)
+        {
+            int x = i + i % 2;
+            if (world.IsAlive(entities[i]) != (x % 3 != 0))
+            {
+                failures++;
+                continue;
+            }
+            if (!world.IsAlive(entities[i]))
+            {
+                failures += world.Get<Position>(entities[i]) != nullptr;
+                continue;
+            }
+            alive++;
+            failures += world.Get<Position>(entities[i])->x != (float)x;
+            failures += !world.Has<Velocity>(entities[i]);
+            if (i % 2 == 0)
+                failures += world.Get<Name>(entities[i])->text != std::to_string(i);
+        }
+        failures += (int)world.GetEntityCount() != alive;
+
+        int tracked = 0;
+        for (int i = 0; i < count; i += 2)
+            tracked += world.IsAlive(entities[i]);
+        failures += liveTracked != tracked;
+        world.Remove<Tracked>(entities[2]);
+        failures += liveTracked != tracked - 1 || world.Has<Tracked>(entities[2]);
+
+        // a new entity can reuse a destroyed index, the old id stays dead
+        EntityId reused = world.Create(Position());
+        failures += !world.IsAlive(reused) || world.IsAlive(entities[0]);
+    }
+    failures += liveTracked != 0;
+    return Report("world", failures);
+}
+
+static bool CheckHierarchy(Model& model)
+{
+    EcsWorld world;
+    TransformSystem transforms;
+    auto handleOf = [&world](EntityId entity) { return world.Get<TransformComponent>(entity)->handle; };
+
+    EntityId root = createModelEntity(world, transforms, model);
+    EntityId child = createModelEntity(world, transforms, model, handleOf(root));
+    EntityId grandchild = createModelEntity(world, transforms, model, handleOf(child));
+    EntityId other = createModelEntity(world, transforms, model);
+    EntityId otherChild = createModelEntity(world, transforms, model, handleOf(other));
+    transforms.Update();
+
+    destroyModelEntity(world, transforms, root);
+    transforms.Update();
+    for (int i = 0; i < 3; i++)
+        createModelEntity(world, transforms, model);
+
+    int failures = 0;
+    failures += world.IsAlive(root) || world.IsAlive(child) || world.IsAlive(grandchild);
+    failures += !world.IsAlive(other) || !world.IsAlive(otherChild);
+    failures += transforms.GetParent(handleOf(otherChild)) != handleOf(other);
+    std::set<TransformSystem::Handle> handles;
+    world.Each<TransformComponent>([&](EntityId, TransformComponent& transform) { failures += !handles.insert(transform.handle).second; });
+    failures += handles.size() != 5;
+    return Report("hierarchy", failures);
+}
+
+int main()
+{
+    ThreadPool pool(3);
+    // imported only, the check needs no GL context
+    Model model(FileSystem::getPath("resources/objects/rock/rock.obj"), false, nullptr, true);
+
+    bool passed = CheckWorld(pool);
+    passed = CheckHierarchy(model) && passed;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+// Keyframe lookup microbenchmark: what sampling one bone costs as clips get longer.
+// Compares the linear scan Bone used before the cursors, the cached cursor (monotonic
+// playback), the binary search fallback (random seeks) and uniformly resampled tracks,
+// first on synthetic tracks of growing length, then on the necoarc clips. No window or
+// GL context is needed.
+//
+// usage: keyframe_lookup [model clip...]   (defaults to the necoarc rig and its clips)
+
+#include <learnopengl/filesystem.h>
+#include <learnopengl/animation.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+static volatile float sink;
+
+// the lookup Bone did before the cursor: scan from the first key on every call
+template <typename Key>
+static int LinearKeyIndex(const std::vector<Key>& keys, float animationTime)
+{
+    for (int index = 0; index < (int)keys.size() - 1; ++index)
+    {
+        if (animationTime < keys[index + 1].timeStamp)
+            return index;
+    }
+    return (int)keys.size() - 2;
+}
+
+template <typename Key>
+static glm::vec3 LinearSampleTrack(const std::vector<Key>& keys, float animationTime, glm::vec3 Key::* value)
+{
+    if (keys.size() == 1)
+        return keys[0].*value;
+    int p0Index = LinearKeyIndex(keys, animationTime);
+    float scaleFactor = Bone::GetScaleFactor(keys[p0Index].timeStamp, keys[p0Index + 1].timeStamp, animationTime);
+    return glm::mix(keys[p0Index].*value, keys[p0Index + 1].*value, scaleFactor);
+}
+
+static void LinearSample(const Bone& bone, float animationTime, glm::vec3& position, glm::quat& rotation, glm::vec3& scale)
+{
+    position = LinearSampleTrack(bone.m_Positions, animationTime, &KeyPosition::position);
+    scale = LinearSampleTrack(bone.m_Scales, animationTime, &KeyScale::scale);
+    const std::vector<KeyRotation>& keys = bone.m_Rotations;
+    if (keys.size() == 1)
+    {
+        rotation = glm::normalize(keys[0].orientation);
+        return;
+    }
+    int p0Index = LinearKeyIndex(keys, animationTime);
+    float scaleFactor = Bone::GetScaleFactor(keys[p0Index].timeStamp, keys[p0Index + 1].timeStamp, animationTime);
+    rotation = glm::normalize(glm::slerp(keys[p0Index].orientation, keys[p0Index + 1].orientation, scaleFactor));
+}
+
+// nanoseconds per bone sample of sampling every bone at every time
+template <typename SampleBone>
+static double Measure(const std::vector<Bone>& bones, const std::vector<float>& times, SampleBone sample)
+{
+    float total = 0.0f;
+    auto start = std::chrono::steady_clock::now();
+    for (float time : times)
+    {
+        for (size_t i = 0; i < bones.size(); i++)
+        {
+            glm::vec3 position, scale;
+            glm::quat rotation;
+            sample(i, time, position, rotation, scale);
+            total += position.x + rotation.w + scale.z;
+        }
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    sink = total;
+    return elapsed / (times.size() * bones.size());
+}
+
+static void Report(const char* name, std::vector<Bone> bones, float duration, float ticksPerSecond)
+{
+    size_t maxKeys = 0;
+    for (const Bone& bone : bones)
+        maxKeys = std::max({ maxKeys, bone.m_Positions.size(), bone.m_Rotations.size(), bone.m_Scales.size() });
+
+    // ten seconds of playback at 60 Hz, looping, and as many random seeks
+    std::vector<float> playback, seeks;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> anyTime(0.0f, duration);
+    float time = 0.0f;
+    for (int frame = 0; frame < 600; frame++)
+    {
+        playback.push_back(time);
+        seeks.push_back(anyTime(random));
+        time = fmod(time + ticksPerSecond / 60.0f, duration);
+    }
+
+    std::vector<BoneCursor> cursors(bones.size());
+    double linear = Measure(bones, playback, [&](size_t i, float t, glm::vec3& p, glm::quat& r, glm::vec3& s) { LinearSample(bones[i], t, p, r, s); });
+    double cursor = Measure(bones, playback, [&](size_t i, float t, glm::vec3& p, glm::quat& r, glm::vec3& s) { bones[i].Sample(t, cursors[i], p, r, s); });
+    double seek = Measure(bones, seeks, [&](size_t i, float t, glm::vec3& p, glm::quat& r, glm::vec3& s) { bones[i].Sample(t, cursors[i], p, r, s); });
+
+    // resampled at the densest key spacing of the clip
+    float step = duration / std::max<size_t>(maxKeys - 1, 1);
+    for (Bone& bone : bones)
+        bone.ResampleUniform(step);
+    double uniform = Measure(bones, playback, [&](size_t i, float t, glm::vec3& p, glm::quat& r, glm::vec3& s) { bones[i].Sample(t, cursors[i], p, r, s); });
+
+    printf("%-24s %6zu %6zu %10.1f %10.1f %10.1f %10.1f\n", name, bones.size(), maxKeys, linear, cursor, seek, uniform);
+}
+
+// bones whose tracks have keyCount evenly spaced keys
+static std::vector<Bone> SyntheticBones(int boneCount, int keyCount, float duration)
+{
+    std::vector<Bone> bones;
+    std::mt19937 random(boneCount * 31 + keyCount);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    for (int id = 0; id < boneCount; id++)
+    {
+        aiNodeAnim channel;
+        channel.mNumPositionKeys = channel.mNumRotationKeys = channel.mNumScalingKeys = keyCount;
+        channel.mPositionKeys = new aiVectorKey[keyCount];
+        channel.mRotationKeys = new aiQuatKey[keyCount];
+        channel.mScalingKeys = new aiVectorKey[keyCount];
+        for (int key = 0; key < keyCount; key++)
+        {
+            double time = duration * key / (keyCount - 1);
+            channel.mPositionKeys[key] = aiVectorKey(time, aiVector3D(value(random), value(random), value(random)));
+            channel.mRotationKeys[key] = aiQuatKey(time, aiQuaternion(aiVector3D(0.0f, 1.0f, 0.0f), value(random)));
+            channel.mScalingKeys[key] = aiVectorKey(time, aiVector3D(1.0f, 1.0f, 1.0f));
+        }
+        bones.emplace_back("bone" + std::to_string(id), id, &channel);
+    }
+    return bones;
+}
+
+int main(int argc, char** argv)
+{
+    std::string modelPath = FileSystem::getPath("resources/objects/necoarc/neco.dae");
+    std::vector<std::string> clipPaths;
+    if (argc > 1)
+    {
+        modelPath = argv[1];
+        clipPaths.assign(argv + 2, argv + argc);
+    }
+    else
+    {
+        for (const char* clip : { "Breathing Idle.dae", "Rifle Idle.dae", "Rifle Run.dae", "Rifle Run To Stop.dae", "grab.dae", "put away.dae" })
+            clipPaths.push_back(FileSystem::getPath(std::string("resources/objects/necoarc/") + clip));
+    }
+
+    printf("nanoseconds per bone sample\n");
+    printf("%-24s %6s %6s %10s %10s %10s %10s\n", "clip", "bones", "keys", "linear", "cursor", "seek", "uniform");
+    for (int keyCount : { 8, 32, 128, 512, 2048 })
+        Report(("synthetic " + std::to_string(keyCount)).c_str(), SyntheticBones(50, keyCount, 100.0f), 100.0f, 30.0f);
+
+    if (!std::ifstream(modelPath).good())
+    {
+        printf("%s not found, skipping the clips\n", modelPath.c_str());
+        return 0;
+    }
+    Model model(modelPath, false, nullptr, true);
+    for (const std::string& clipPath : clipPaths)
+    {
+        if (!std::ifstream(clipPath).good())
+        {
+            printf("%s not found\n", clipPath.c_str());
+            continue;
+        }
+        Animation animation(clipPath, &model);
+        std::string name = clipPath.substr(clipPath.find_last_of("/\\") + 1);
+        Report(name.c_str(), animation.GetBones(), animation.GetDuration(), animation.GetTicksPerSecond());
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+// Palette format benchmark: what each PaletteFormat costs per frame for a crowd. Measures
+// encoding the composed palettes (what AnimationSystem does while writing the buffer), the
+// bytes uploaded, and the skinning of one vertex with a CPU port of 1.model_loading.vs as a
+// stand-in for the shader ALU. No window or GL context is needed.
+//
+// usage: palette_formats [instances] [bones]   (defaults to 500 instances of 100 bones)
+
+#include "palette_skinning.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static volatile float sink;
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    int instances = argc > 1 ? std::atoi(argv[1]) : 500;
+    int bones = argc > 2 ? std::atoi(argv[2]) : 100;
+    const int vertexCount = 200000;
+
+    // rigid bone matrices, like a composed skinning palette without scale
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<glm::mat4> palettes;
+    for (int i = 0; i < instances * bones; i++)
+    {
+        glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+        glm::mat4 matrix = glm::translate(glm::mat4(1.0f), glm::vec3(unit(random), unit(random), unit(random)));
+        palettes.push_back(glm::rotate(matrix, unit(random) * 3.0f, axis));
+    }
+
+    // four influences per vertex, weights summing to one
+    std::uniform_int_distribution<int> anyBone(0, bones - 1);
+    std::vector<SkinInfluences> influences(vertexCount);
+    std::vector<glm::vec3> positions(vertexCount), normals(vertexCount);
+    for (int v = 0; v < vertexCount; v++)
+    {
+        float total = 0.0f;
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        {
+            influences[v].ids[i] = anyBone(random);
+            influences[v].weights[i] = unit(random) * 0.5f + 0.5f;
+            total += influences[v].weights[i];
+        }
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+            influences[v].weights[i] /= total;
+        positions[v] = glm::vec3(unit(random), unit(random), unit(random));
+        normals[v] = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 1e-3f, 0.0f));
+    }
+
+    printf("%d instances x %d bones, %d vertices\n", instances, bones, vertexCount);
+    printf("%-10s %12s %14s %16s\n", "format", "KB / frame", "encode (ms)", "skin (ns/vertex)");
+    const PaletteFormat formats[] = { PaletteFormat::Mat4, PaletteFormat::Mat3x4, PaletteFormat::DualQuat };
+    const char* names[] = { "mat4", "mat3x4", "dual quat" };
+    for (int f = 0; f < 3; f++)
+    {
+        PaletteFormat format = formats[f];
+        std::vector<glm::vec4> texels((size_t)instances * bones * GetPaletteTexels(format));
+
+        // best of a few frames
+        double encode = 1e30;
+        for (int frame = 0; frame < 5; frame++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            EncodePalette(palettes.data(), instances * bones, format, texels.data());
+            encode = std::min(encode, MillisecondsSince(start));
+        }
+
+        float total = 0.0f;
+        auto start = std::chrono::steady_clock::now();
+        for (int v = 0; v < vertexCount; v++)
+        {
+            glm::vec3 skinnedPos, skinnedNormal;
+            SkinVertex(texels.data(), format, influences[v], positions[v], normals[v], skinnedPos, skinnedNormal);
+            total += skinnedPos.x + skinnedNormal.y;
+        }
+        double skin = MillisecondsSince(start) * 1e6 / vertexCount;
+        sink = total;
+
+        double kilobytes = texels.size() * sizeof(glm::vec4) / 1024.0;
+        printf("%-10s %12.1f %14.3f %16.1f\n", names[f], kilobytes, encode, skin);
+    }
+    return 0;
+}
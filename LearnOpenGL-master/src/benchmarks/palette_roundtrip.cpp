@@ -0,0 +1,97 @@
+// Checks EncodeSkinMatrix() against the matrix it encodes: a vertex skinned from the encoded
+// texels (the way 1.model_loading.vs does it) has to land where the matrix puts it, and its
+// normal has to match the inverse transpose. Mat4 and Mat3x4 are checked with non-uniform
+// scale as well, DualQuat only holds rigid transforms. Exits with 1 on a mismatch.
+
+#include "palette_skinning.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static const float tolerance = 1e-4f;
+
+struct Result
+{
+    float position = 0.0f, normal = 0.0f;
+};
+
+static Result Check(const std::vector<glm::mat4>& palette, PaletteFormat format, std::mt19937& random)
+{
+    std::vector<glm::vec4> texels(palette.size() * GetPaletteTexels(format));
+    EncodePalette(palette.data(), (int)palette.size(), format, texels.data());
+
+    std::uniform_real_distribution<float> coordinate(-2.0f, 2.0f);
+    Result result;
+    for (size_t bone = 0; bone < palette.size(); bone++)
+    {
+        SkinInfluences influences = { { (int)bone, -1, -1, -1 }, { 1.0f, 0.0f, 0.0f, 0.0f } };
+        for (int sample = 0; sample < 16; sample++)
+        {
+            glm::vec3 pos(coordinate(random), coordinate(random), coordinate(random));
+            glm::vec3 norm = glm::normalize(glm::vec3(coordinate(random), coordinate(random), coordinate(random)));
+            glm::vec3 skinnedPos, skinnedNormal;
+            SkinVertex(texels.data(), format, influences, pos, norm, skinnedPos, skinnedNormal);
+
+            const glm::mat4& matrix = palette[bone];
+            glm::vec3 expectedPos(matrix * glm::vec4(pos, 1.0f));
+            glm::vec3 expectedNormal = glm::normalize(glm::transpose(glm::inverse(glm::mat3(matrix))) * norm);
+            // relative to the size of the coordinates involved
+            float scale = 1.0f + glm::length(expectedPos);
+            result.position = std::max(result.position, glm::length(skinnedPos - expectedPos) / scale);
+            result.normal = std::max(result.normal, glm::length(skinnedNormal - expectedNormal));
+        }
+    }
+    return result;
+}
+
+static std::vector<glm::mat4> RandomPalette(std::mt19937& random, int count, bool scaled)
+{
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> angle(-3.14159265f, 3.14159265f);
+    std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+    std::vector<glm::mat4> palette;
+    for (int i = 0; i < count; i++)
+    {
+        glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+        glm::mat4 matrix = glm::translate(glm::mat4(1.0f), glm::vec3(unit(random), unit(random), unit(random)) * 10.0f);
+        matrix = glm::rotate(matrix, angle(random), axis);
+        if (scaled)
+            matrix = glm::scale(matrix, glm::vec3(scale(random), scale(random), scale(random)));
+        palette.push_back(matrix);
+    }
+    return palette;
+}
+
+int main()
+{
+    std::mt19937 random(42);
+    std::vector<glm::mat4> rigid = RandomPalette(random, 100, false);
+    std::vector<glm::mat4> scaled = RandomPalette(random, 100, true);
+
+    struct Case
+    {
+        const char* name;
+        PaletteFormat format;
+        const std::vector<glm::mat4>* palette;
+    };
+    const Case cases[] = {
+        { "mat4 rigid", PaletteFormat::Mat4, &rigid },
+        { "mat4 scaled", PaletteFormat::Mat4, &scaled },
+        { "mat3x4 rigid", PaletteFormat::Mat3x4, &rigid },
+        { "mat3x4 scaled", PaletteFormat::Mat3x4, &scaled },
+        { "dual quat rigid", PaletteFormat::DualQuat, &rigid },
+    };
+
+    bool passed = true;
+    for (const Case& c : cases)
+    {
+        Result result = Check(*c.palette, c.format, random);
+        bool ok = result.position <= tolerance && result.normal <= tolerance;
+        passed = passed && ok;
+        printf("%-16s position %.2e  normal %.2e  %s\n", c.name, result.position, result.normal, ok ? "ok" : "FAILED");
+    }
+    return passed ? 0 : 1;
+}
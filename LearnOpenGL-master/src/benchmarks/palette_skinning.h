@@ -0,0 +1,90 @@
+#pragma once
+
+// CPU port of the skinning in 1.model_loading.vs for every PaletteFormat, shared by the
+// palette benchmark and the round-trip check. texels hold palettes as EncodePalette()
+// writes them.
+
+#include <learnopengl/pose.h>
+
+#include <glm/glm.hpp>
+
+struct SkinInfluences
+{
+    int ids[MAX_BONE_INFLUENCE];
+    float weights[MAX_BONE_INFLUENCE];
+};
+
+inline glm::vec3 RotateByQuat(const glm::vec4& q, const glm::vec3& v)
+{
+    glm::vec3 axis(q);
+    return v + 2.0f * glm::cross(axis, glm::cross(axis, v) + q.w * v);
+}
+
+// skins one vertex like the vertex shader; the normal comes out unit length
+inline void SkinVertex(const glm::vec4* texels, PaletteFormat format, const SkinInfluences& influences,
+    const glm::vec3& pos, const glm::vec3& norm, glm::vec3& skinnedPos, glm::vec3& skinnedNormal)
+{
+    glm::vec4 r0(0.0f), r1(0.0f), r2(0.0f);
+    glm::vec4 real(0.0f), dual(0.0f), firstReal(0.0f);
+    float totalWeight = 0.0f;
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+    {
+        int id = influences.ids[i];
+        float w = influences.weights[i];
+        if (w <= 0.0f || id < 0)
+            continue;
+
+        if (format == PaletteFormat::DualQuat)
+        {
+            const glm::vec4* bone = texels + id * 2;
+            // blend along the shortest arc
+            if (totalWeight == 0.0f)
+                firstReal = bone[0];
+            float s = glm::dot(firstReal, bone[0]) < 0.0f ? -w : w;
+            real += bone[0] * s;
+            dual += bone[1] * s;
+        }
+        else if (format == PaletteFormat::Mat3x4)
+        {
+            const glm::vec4* bone = texels + id * 3;
+            r0 += bone[0] * w;
+            r1 += bone[1] * w;
+            r2 += bone[2] * w;
+        }
+        else
+        {
+            // columns, transposed into rows
+            const glm::vec4* bone = texels + id * 4;
+            r0 += glm::vec4(bone[0].x, bone[1].x, bone[2].x, bone[3].x) * w;
+            r1 += glm::vec4(bone[0].y, bone[1].y, bone[2].y, bone[3].y) * w;
+            r2 += glm::vec4(bone[0].z, bone[1].z, bone[2].z, bone[3].z) * w;
+        }
+        totalWeight += w;
+    }
+
+    skinnedPos = pos;
+    skinnedNormal = norm;
+    if (totalWeight <= 0.0f)
+        return;
+    if (format == PaletteFormat::DualQuat)
+    {
+        float length = glm::length(real);
+        real /= length;
+        dual /= length;
+        glm::vec3 translation = 2.0f * (real.w * glm::vec3(dual) - dual.w * glm::vec3(real) + glm::cross(glm::vec3(real), glm::vec3(dual)));
+        skinnedPos = RotateByQuat(real, pos) + translation;
+        skinnedNormal = RotateByQuat(real, norm);
+    }
+    else
+    {
+        float inv = 1.0f / totalWeight;
+        r0 *= inv;
+        r1 *= inv;
+        r2 *= inv;
+        glm::vec4 p(pos, 1.0f);
+        skinnedPos = glm::vec3(glm::dot(r0, p), glm::dot(r1, p), glm::dot(r2, p));
+        glm::vec3 c0(r0.x, r1.x, r2.x), c1(r0.y, r1.y, r2.y), c2(r0.z, r1.z, r2.z);
+        skinnedNormal = glm::mat3(glm::cross(c1, c2), glm::cross(c2, c0), glm::cross(c0, c1)) * norm;
+    }
+    skinnedNormal = glm::normalize(skinnedNormal);
+}
@@ -0,0 +1,139 @@
+// Checks SkinnedBounds::Compute() against vertices skinned the way 1.model_loading.vs does it,
+// for random palettes with non-uniform scale: every skinned vertex has to lie inside the box,
+// and the box has to match the one built from the corners of each moved bone box. Vertices
+// without weights and bones past the palette keep the bind pose. Exits with 1 on a mismatch.
+
+#include <learnopengl/skinned_bounds.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cfloat>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static const float tolerance = 1e-4f;
+
+static glm::vec3 SkinPosition(const Vertex& vertex, const std::vector<glm::mat4>& palette)
+{
+    glm::vec4 total(0.0f);
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+    {
+        if (vertex.m_BoneIDs[i] < 0 || vertex.m_Weights[i] <= 0.0f)
+            continue;
+        if (vertex.m_BoneIDs[i] >= (int)palette.size())
+            return vertex.Position;
+        total += palette[vertex.m_BoneIDs[i]] * glm::vec4(vertex.Position, 1.0f) * vertex.m_Weights[i];
+    }
+    return total.w > 0.0f ? glm::vec3(total) : vertex.Position;
+}
+
+// box through the corners of every bone's bind box, the tightest Compute() can give
+static void CornerBox(const std::vector<Vertex>& vertices, const std::vector<glm::mat4>& palette, int boneCount, glm::vec3& min, glm::vec3& max)
+{
+    std::vector<glm::vec3> boneMin(boneCount, glm::vec3(FLT_MAX)), boneMax(boneCount, glm::vec3(-FLT_MAX));
+    min = glm::vec3(FLT_MAX);
+    max = glm::vec3(-FLT_MAX);
+    for (const Vertex& vertex : vertices)
+    {
+        bool skinned = false;
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        {
+            int bone = vertex.m_BoneIDs[i];
+            if (bone < 0 || vertex.m_Weights[i] <= 0.0f)
+                continue;
+            boneMin[bone] = glm::min(boneMin[bone], vertex.Position);
+            boneMax[bone] = glm::max(boneMax[bone], vertex.Position);
+            skinned = true;
+        }
+        if (!skinned)
+        {
+            min = glm::min(min, vertex.Position);
+            max = glm::max(max, vertex.Position);
+        }
+    }
+    for (int bone = 0; bone < boneCount; bone++)
+    {
+        if (boneMin[bone].x > boneMax[bone].x)
+            continue;
+        glm::mat4 matrix = bone < (int)palette.size() ? palette[bone] : glm::mat4(1.0f);
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 point(corner & 1 ? boneMax[bone].x : boneMin[bone].x, corner & 2 ? boneMax[bone].y : boneMin[bone].y,
+                corner & 4 ? boneMax[bone].z : boneMin[bone].z);
+            glm::vec3 moved = glm::vec3(matrix * glm::vec4(point, 1.0f));
+            min = glm::min(min, moved);
+            max = glm::max(max, moved);
+        }
+    }
+}
+
+int main()
+{
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> coordinate(-3.0f, 3.0f);
+    const int boneCount = 10;
+
+    // up to three influences with normalized weights; a few vertices have none
+    std::vector<Vertex> vertices(4000);
+    for (Vertex& vertex : vertices)
+    {
+        vertex.Position = glm::vec3(coordinate(random), coordinate(random), coordinate(random));
+        for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+        {
+            vertex.m_BoneIDs[i] = -1;
+            vertex.m_Weights[i] = 0.0f;
+        }
+        int influences = random() % 4;
+        float total = 0.0f;
+        for (int i = 0; i < influences; i++)
+        {
+            vertex.m_BoneIDs[i] = random() % boneCount;
+            vertex.m_Weights[i] = 1.0f + random() % 3;
+            total += vertex.m_Weights[i];
+        }
+        for (int i = 0; i < influences; i++)
+            vertex.m_Weights[i] /= total;
+    }
+    SkinnedBounds bounds;
+    bounds.AddVertices(vertices);
+
+    bool passed = true;
+    // the smaller palettes leave the last bones in the bind pose
+    for (int paletteSize : { boneCount, boneCount - 3 })
+    {
+        for (int pose = 0; pose < 20; pose++)
+        {
+            std::vector<glm::mat4> palette;
+            for (int bone = 0; bone < paletteSize; bone++)
+            {
+                glm::vec3 axis = glm::normalize(glm::vec3(coordinate(random), coordinate(random), coordinate(random)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+                glm::mat4 matrix = glm::translate(glm::mat4(1.0f), glm::vec3(coordinate(random), coordinate(random), coordinate(random)));
+                matrix = glm::rotate(matrix, coordinate(random), axis);
+                palette.push_back(glm::scale(matrix, glm::vec3(1.5f, 0.7f, 1.0f)));
+            }
+
+            glm::vec3 min, max;
+            if (!bounds.Compute(palette.data(), paletteSize, min, max))
+            {
+                printf("palette %2d pose %2d  no box  FAILED\n", paletteSize, pose);
+                passed = false;
+                continue;
+            }
+            int outside = 0;
+            for (const Vertex& vertex : vertices)
+            {
+                glm::vec3 position = SkinPosition(vertex, palette);
+                outside += glm::any(glm::lessThan(position, min - tolerance)) || glm::any(glm::greaterThan(position, max + tolerance));
+            }
+            glm::vec3 expectedMin, expectedMax;
+            CornerBox(vertices, palette, boneCount, expectedMin, expectedMax);
+            float difference = std::max(glm::length(min - expectedMin), glm::length(max - expectedMax));
+            bool ok = outside == 0 && difference <= tolerance * 10.0f;
+            passed = passed && ok;
+            if (!ok || pose == 0)
+                printf("palette %2d pose %2d  %d vertices outside  box off by %.2e  %s\n", paletteSize, pose, outside, difference, ok ? "ok" : "FAILED");
+        }
+    }
+    return passed ? 0 : 1;
+}